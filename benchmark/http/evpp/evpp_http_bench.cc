@@ -15,6 +15,25 @@ void DefaultHandler(evpp::EventLoop* loop,
     cb(oss.str());
 }
 
+// Run a server of the engine at the ports
+std::shared_ptr<evpp::http::Server> StartServer(evpp::http::Server::Engine engine, bool multi_acceptor, const std::vector<int>& ports, int thread_num) {
+    std::shared_ptr<evpp::http::Server> server(new evpp::http::Server(thread_num));
+    server->SetEngine(engine);
+    server->SetMultiAcceptor(multi_acceptor);
+    server->SetThreadDispatchPolicy(evpp::ThreadDispatchPolicy::kIPAddressHashing);
+    server->RegisterDefaultHandler(&DefaultHandler);
+    server->RegisterHandler("/ind",
+                            [](evpp::EventLoop* loop,
+                               const evpp::http::ContextPtr& ctx,
+                               const evpp::http::HTTPSendResponseCallback& cb) {
+        cb(ctx->body().ToString()); }
+    );
+
+    server->Init(ports);
+    server->Start();
+    return server;
+}
+
 int main(int argc, char* argv[]) {
     std::vector<int> ports = {9009, 23456, 23457};
     int port = 29099;
@@ -27,6 +46,11 @@ int main(int argc, char* argv[]) {
                 std::string("--help") == argv[1]) {
             std::cout << "usage : " << argv[0] << " <listen_port> <thread_num>\n";
             std::cout << " e.g. : " << argv[0] << " 8080 24\n";
+            std::cout << " The servers listen at :\n"
+                      << "   <listen_port>   : evhttp in the listening thread, dispatching to the working threads\n"
+                      << "   <listen_port>+1 : native engine in the listening thread, dispatching to the working threads\n"
+                      << "   <listen_port>+2 : evhttp in every working thread with SO_REUSEPORT\n"
+                      << "   <listen_port>+3 : native engine in every working thread with SO_REUSEPORT\n";
             return 0;
         }
     }
@@ -40,20 +64,19 @@ int main(int argc, char* argv[]) {
 
     ports.push_back(port);
 
-    evpp::http::Server server(thread_num);
-    server.SetThreadDispatchPolicy(evpp::ThreadDispatchPolicy::kIPAddressHashing);
-    server.RegisterDefaultHandler(&DefaultHandler);
-    server.RegisterHandler("/ind",
-                           [](evpp::EventLoop* loop,
-                              const evpp::http::ContextPtr& ctx,
-                              const evpp::http::HTTPSendResponseCallback& cb) {
-        cb(ctx->body().ToString()); }
-    );
-
-    server.Init(ports);
-    server.Start();
-    while (!server.IsStopped()) {
-        usleep(1);
+    // The engines run side by side with the same handlers and the same number of threads
+    std::vector<std::shared_ptr<evpp::http::Server>> servers;
+    servers.push_back(StartServer(evpp::http::Server::kEvhttp, false, ports, thread_num));
+    servers.push_back(StartServer(evpp::http::Server::kNative, false, std::vector<int>(1, port + 1), thread_num));
+    servers.push_back(StartServer(evpp::http::Server::kEvhttp, true, std::vector<int>(1, port + 2), thread_num));
+    servers.push_back(StartServer(evpp::http::Server::kNative, true, std::vector<int>(1, port + 3), thread_num));
+    for (;;) {
+        for (auto& s : servers) {
+            if (s->IsStopped()) {
+                return 0;
+            }
+        }
+        usleep(1000);
     }
     return 0;
 }
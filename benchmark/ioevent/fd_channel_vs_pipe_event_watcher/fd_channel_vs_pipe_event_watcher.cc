@@ -25,6 +25,9 @@ int numWrites;
 EventLoop* g_loop;
 std::vector<FdChannel*> g_channels;
 std::vector<std::shared_ptr<PipeEventWatcher>> g_pipe_event_watchers;
+#ifdef __linux__
+std::vector<std::shared_ptr<EventFdWatcher>> g_eventfd_watchers;
+#endif
 
 int g_reads, g_writes, g_fired;
 
@@ -63,6 +66,25 @@ void ReadCallbackOfPipeEventWatcher(int idx) {
     }
 }
 
+#ifdef __linux__
+void ReadCallbackOfEventFdWatcher(int idx) {
+    g_reads++;
+    if (g_writes > 0) {
+        int widx = idx + 1;
+        if (widx >= numPipes) {
+            widx -= numPipes;
+        }
+        g_eventfd_watchers[widx]->Notify();
+        g_writes--;
+        g_fired++;
+    }
+
+    if (g_fired == g_reads) {
+        g_loop->Stop();
+    }
+}
+#endif
+
 std::pair<int, int> FdChannelRunOnce() {
     Timestamp beforeInit(Timestamp::Now());
 
@@ -104,6 +126,35 @@ std::pair<int, int> PipeEventWatcherRunOnce() {
     return std::make_pair(iterTime, loopTime);
 }
 
+#ifdef __linux__
+std::pair<int, int> EventFdWatcherRunOnce() {
+    Timestamp beforeInit(Timestamp::Now());
+    for (int i = 0; i < numActive; ++i) {
+        g_eventfd_watchers[i]->Notify();
+    }
+
+    g_fired = numActive;
+    g_reads = 0;
+    g_writes = numWrites;
+    Timestamp beforeLoop(Timestamp::Now());
+    g_loop->Run();
+    Timestamp end(Timestamp::Now());
+
+    int iterTime = static_cast<int>(end.UnixMicro() - beforeInit.UnixMicro());
+    int loopTime = static_cast<int>(end.UnixMicro() - beforeLoop.UnixMicro());
+    return std::make_pair(iterTime, loopTime);
+}
+#endif
+
+void PrintAverage(const char* prog, const char* name, const std::vector<std::pair<int, int>>& cost) {
+    int sum1 = 0, sum2 = 0;
+    for (auto t : cost) {
+        sum1 += t.first;
+        sum2 += t.second;
+    }
+    printf("%s %23s Average : %8d %8d\n", prog, name, sum1 / int(cost.size()), sum2 / int(cost.size()));
+}
+
 int main(int argc, char* argv[]) {
     numPipes = 5000;
     numActive = 100;
@@ -134,10 +185,18 @@ int main(int argc, char* argv[]) {
         w->Init();
         w->AsyncWait();
         g_pipe_event_watchers.push_back(w);
+
+#ifdef __linux__
+        std::shared_ptr<EventFdWatcher> e(new EventFdWatcher(g_loop, std::bind(&ReadCallbackOfEventFdWatcher, i)));
+        e->Init();
+        e->AsyncWait();
+        g_eventfd_watchers.push_back(e);
+#endif
     }
 
     std::vector<std::pair<int, int>> fd_channel_cost;
     std::vector<std::pair<int, int>> pipe_event_watcher_cost;
+    std::vector<std::pair<int, int>> eventfd_watcher_cost;
     for (int i = 0; i < 25; ++i) {
         std::pair<int, int> t = FdChannelRunOnce();
         printf("       FdChannelRunOnce %8d %8d\n", t.first, t.second);
@@ -145,21 +204,18 @@ int main(int argc, char* argv[]) {
         t = PipeEventWatcherRunOnce();
         printf("PipeEventWatcherRunOnce %8d %8d\n", t.first, t.second);
         pipe_event_watcher_cost.push_back(t);
+#ifdef __linux__
+        t = EventFdWatcherRunOnce();
+        printf("  EventFdWatcherRunOnce %8d %8d\n", t.first, t.second);
+        eventfd_watcher_cost.push_back(t);
+#endif
     }
 
-    int sum1 = 0, sum2 = 0;
-    for (auto t : fd_channel_cost) {
-        sum1 += t.first;
-        sum2 += t.second;
-    }
-    printf("%s        FdChannelRunOnce Average : %8d %8d\n", argv[0], sum1 / int(fd_channel_cost.size()), sum2 / int(fd_channel_cost.size()));
-
-    sum1 = 0, sum2 = 0;
-    for (auto t : pipe_event_watcher_cost) {
-        sum1 += t.first;
-        sum2 += t.second;
+    PrintAverage(argv[0], "FdChannelRunOnce", fd_channel_cost);
+    PrintAverage(argv[0], "PipeEventWatcherRunOnce", pipe_event_watcher_cost);
+    if (!eventfd_watcher_cost.empty()) {
+        PrintAverage(argv[0], "EventFdWatcherRunOnce", eventfd_watcher_cost);
     }
-    printf("%s PipeEventWatcherRunOnce Average : %8d %8d\n", argv[0], sum1 / int(pipe_event_watcher_cost.size()), sum2 / int(pipe_event_watcher_cost.size()));
 
     for (auto it = g_channels.begin();
          it != g_channels.end(); ++it) {
@@ -15,4 +15,7 @@ done
     ../../build-release/bin/benchmark_post_task_boost_lockfree_queue_queue4 $count
     ../../build-release/bin/benchmark_post_task5 $count
     ../../build-release/bin/benchmark_post_task_boost_lockfree_queue_queue5 $count
+    ../../build-release/bin/benchmark_post_task7 $count
+    ../../build-release/bin/benchmark_post_task8 $count
+    ../../build-release/bin/benchmark_post_task_boost_lockfree_queue8 $count
 done
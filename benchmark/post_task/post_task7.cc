@@ -0,0 +1,138 @@
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/event_watcher.h>
+
+#include "examples/winmain-inl.h"
+
+// post_task7 compares the watchers used to wake up an EventLoop from another thread :
+//  1. Wakeup latency : two loops notify each other back and forth, so every
+//     notification wakes up an idle loop.
+//  2. Cross-thread throughput : one thread keeps notifying a busy loop, which
+//     is the cost paid by QueueInLoop when the notifications can be merged.
+
+uint64_t clock_us() {
+    return std::chrono::steady_clock::now().time_since_epoch().count() / 1000;
+}
+
+template<typename Watcher>
+class WakeupBench {
+public:
+    WakeupBench(uint64_t count) : count_(count) {}
+
+    void Start() {
+        loop1_.Start(true);
+        loop2_.Start(true);
+        Create(loop1_.loop(), &w1_, [this]() {
+            if (done_) {
+                return;
+            }
+            if (++pong_count_ == count_) {
+                done_ = true;
+            } else {
+                w2_->Notify();
+            }
+        });
+        Create(loop2_.loop(), &w2_, [this]() {
+            wakeup_count_++;
+            if (!done_) {
+                w1_->Notify();
+            }
+        });
+    }
+
+    // Return the average latency of a wakeup in microseconds
+    double PingPong() {
+        uint64_t start = clock_us();
+        w2_->Notify();
+        while (!done_) {
+            usleep(1000);
+        }
+        return double(clock_us() - start) / double(count_ * 2);
+    }
+
+    // Return the count of notifications per second of one thread
+    // and the count of the wakeups they cause
+    std::pair<double, uint64_t> Throughput() {
+        uint64_t wakeup_count = wakeup_count_;
+        uint64_t start = clock_us();
+        for (uint64_t i = 0; i < count_; ++i) {
+            w2_->Notify();
+        }
+        uint64_t cost = clock_us() - start;
+        usleep(100 * 1000);
+        return std::make_pair(double(count_) * 1000000.0 / double(cost ? cost : 1), wakeup_count_ - wakeup_count);
+    }
+
+    void Stop() {
+        Destroy(loop1_.loop(), &w1_);
+        Destroy(loop2_.loop(), &w2_);
+        loop1_.Stop(true);
+        loop2_.Stop(true);
+    }
+
+private:
+    // The watchers must be initialized and deleted in their own threads
+    static void Create(evpp::EventLoop* loop, std::shared_ptr<Watcher>* w, const std::function<void()>& handler) {
+        std::atomic<bool> created(false);
+        loop->RunInLoop([loop, w, handler, &created]() {
+            w->reset(new Watcher(loop, handler));
+            (*w)->Init();
+            (*w)->AsyncWait();
+            created = true;
+        });
+        while (!created) {
+            usleep(1000);
+        }
+    }
+
+    static void Destroy(evpp::EventLoop* loop, std::shared_ptr<Watcher>* w) {
+        std::atomic<bool> destroyed(false);
+        loop->RunInLoop([w, &destroyed]() {
+            w->reset();
+            destroyed = true;
+        });
+        while (!destroyed) {
+            usleep(1000);
+        }
+    }
+
+private:
+    const uint64_t count_;
+    evpp::EventLoopThread loop1_;
+    evpp::EventLoopThread loop2_;
+    std::shared_ptr<Watcher> w1_;
+    std::shared_ptr<Watcher> w2_;
+    uint64_t pong_count_ = 0;
+    std::atomic<uint64_t> wakeup_count_ = { 0 };
+    std::atomic<bool> done_ = { false };
+};
+
+template<typename Watcher>
+void Run(const char* prog, const char* name, uint64_t count) {
+    WakeupBench<Watcher> b(count);
+    b.Start();
+    double latency = b.PingPong();
+    std::pair<double, uint64_t> t = b.Throughput();
+    b.Stop();
+    LOG_WARN << prog << " " << name << " count=" << count
+        << " wakeup latency: " << latency << " us"
+        << " notify throughput: " << t.first << " per second"
+        << " wakeups: " << t.second;
+}
+
+int main(int argc, char* argv[]) {
+    long long count = 100000;
+
+    if (argc == 2) {
+        count = std::atoll(argv[1]);
+    } else {
+        printf("Usage : %s <notify-count>\n", argv[0]);
+        return 0;
+    }
+
+    Run<evpp::PipeEventWatcher>(argv[0], "PipeEventWatcher", count);
+#ifdef __linux__
+    Run<evpp::EventFdWatcher>(argv[0], "EventFdWatcher", count);
+#endif
+    return 0;
+}
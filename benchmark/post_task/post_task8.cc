@@ -0,0 +1,89 @@
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+
+#include <atomic>
+#include <new>
+
+#include "examples/winmain-inl.h"
+
+// post_task8 counts the memory allocations per posted task. The task captures
+// a shared_ptr and a short string, like the one posted by TCPConn::Send.
+// It is posted as a lambda, which is stored inside an evpp::Task, and as an
+// EventLoop::Functor, which allocates its target from the heap.
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void* operator new(size_t n) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(n ? n : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+uint64_t clock_us() {
+    return std::chrono::steady_clock::now().time_since_epoch().count() / 1000;
+}
+
+struct Session {
+    uint64_t bytes = 0;
+};
+
+template<typename Post>
+void Run(const char* prog, const char* name, uint64_t post_count, Post post) {
+    evpp::EventLoopThread t;
+    t.Start(true);
+    std::shared_ptr<Session> session(new Session);
+    std::atomic<uint64_t> count(0);
+    std::string message("0123456789");
+
+    uint64_t allocations = g_allocations.load();
+    uint64_t start = clock_us();
+    for (uint64_t i = 0; i < post_count; ++i) {
+        post(t.loop(), session, message, &count);
+    }
+    while (count.load() != post_count) {
+        usleep(1000);
+    }
+    uint64_t cost = clock_us() - start;
+    double per_task = double(g_allocations.load() - allocations) / double(post_count);
+
+    t.Stop(true);
+    LOG_WARN << prog << " " << name << " post_count=" << post_count
+        << " allocations per task: " << per_task
+        << " use time: " << double(cost) / 1000000.0 << " seconds";
+}
+
+int main(int argc, char* argv[]) {
+    long long post_count = 1000000;
+
+    if (argc == 2) {
+        post_count = std::atoll(argv[1]);
+    } else {
+        printf("Usage : %s <post-count>\n", argv[0]);
+        return 0;
+    }
+
+    Run(argv[0], "Task", post_count,
+        [](evpp::EventLoop* loop, std::shared_ptr<Session> s, std::string m, std::atomic<uint64_t>* count) {
+        loop->QueueInLoop([s, m, count]() {
+            s->bytes += m.size();
+            count->fetch_add(1);
+        });
+    });
+
+    Run(argv[0], "Functor", post_count,
+        [](evpp::EventLoop* loop, std::shared_ptr<Session> s, std::string m, std::atomic<uint64_t>* count) {
+        evpp::EventLoop::Functor f([s, m, count]() {
+            s->bytes += m.size();
+            count->fetch_add(1);
+        });
+        loop->QueueInLoop(std::move(f));
+    });
+    return 0;
+}
@@ -0,0 +1,120 @@
+// The round trip latency of the ping pong test with one connection in one
+// process, with and without the busy polling of the EventLoops.
+// The client sends a message once it receives the echo of the last one, and
+// records the time of every round trip.
+
+#include <evpp/tcp_server.h>
+#include <evpp/tcp_client.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/buffer.h>
+#include <evpp/tcp_conn.h>
+
+#include <algorithm>
+
+static int64_t clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+    std::vector<int64_t> rtt_ns;
+
+    int64_t Percentile(double p) const {
+        return rtt_ns[static_cast<size_t>(p * (rtt_ns.size() - 1))];
+    }
+};
+
+static void Run(const std::string& addr, int message_count, int block_size, evpp::Duration busy_poll, Result* result) {
+    evpp::EventLoopThread server_thread;
+    evpp::EventLoopThread client_thread;
+    server_thread.Start(true);
+    client_thread.Start(true);
+    server_thread.loop()->SetBusyPollDuration(busy_poll);
+    client_thread.loop()->SetBusyPollDuration(busy_poll);
+
+    evpp::TCPServer server(server_thread.loop(), addr, "LatencyServer", 0);
+    server.SetConnectionCallback([](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->SetTCPNoDelay(true);
+        }
+    });
+    server.SetMessageCallback([](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        conn->Send(msg);
+    });
+    server.Init();
+    server.Start();
+
+    std::string message(block_size, 'x');
+    std::atomic<bool> done(false);
+    int64_t sent_time = 0;
+    result->rtt_ns.clear();
+    result->rtt_ns.reserve(message_count);
+
+    evpp::TCPClient client(client_thread.loop(), addr, "LatencyClient");
+    client.SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->SetTCPNoDelay(true);
+            sent_time = clock_ns();
+            conn->Send(message);
+        }
+    });
+    client.SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        if (msg->size() < message.size()) {
+            return;
+        }
+        msg->Retrieve(message.size());
+        int64_t now = clock_ns();
+        result->rtt_ns.push_back(now - sent_time);
+        if (result->rtt_ns.size() == static_cast<size_t>(message_count)) {
+            done = true;
+            return;
+        }
+        sent_time = now;
+        conn->Send(message);
+    });
+    client.Connect();
+
+    while (!done) {
+        usleep(10 * 1000);
+    }
+
+    client.Disconnect();
+    server.Stop();
+    while (!server.IsStopped()) {
+        usleep(1000);
+    }
+    client_thread.Stop(true);
+    server_thread.Stop(true);
+    std::sort(result->rtt_ns.begin(), result->rtt_ns.end());
+}
+
+static void Report(const char* name, const Result& r) {
+    LOG_WARN << name << " round trips=" << r.rtt_ns.size()
+        << " p50=" << r.Percentile(0.50) / 1000.0 << "us"
+        << " p99=" << r.Percentile(0.99) / 1000.0 << "us"
+        << " p99.9=" << r.Percentile(0.999) / 1000.0 << "us"
+        << " max=" << r.rtt_ns.back() / 1000.0 << "us";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        printf("Usage: %s <port> <message-count> <block-size> <busy-poll-us>\n", argv[0]);
+        printf("  e.g: %s 9099 100000 64 50\n", argv[0]);
+        return 0;
+    }
+
+    std::string addr = std::string("127.0.0.1:") + argv[1];
+    int message_count = atoi(argv[2]);
+    int block_size = atoi(argv[3]);
+    evpp::Duration busy_poll(atoi(argv[4]) / 1000000.0);
+
+    Result blocking;
+    Run(addr, message_count, block_size, evpp::Duration(), &blocking);
+    Report("blocking", blocking);
+
+    Result busy_polling;
+    Run(addr, message_count, block_size, busy_poll, &busy_polling);
+    Report("busy-polling", busy_polling);
+    return 0;
+}
+
+#include "../../../examples/echo/tcpecho/winmain-inl.h"
@@ -0,0 +1,76 @@
+#include <evpp/event_loop.h>
+#include <evpp/timestamp.h>
+
+#include "examples/winmain-inl.h"
+
+// timer compares the backends of InvokeTimer with lots of timers :
+//  1. add    : start timer_count timers with the timeouts spread over 10 seconds
+//  2. cancel : cancel all of them before they expire
+//  3. fire   : start timer_count timers with the timeouts spread over 1ms~100ms
+//     and wait until all of them expire
+// All the work is done in the thread of the EventLoop, like the request
+// timeouts set by a server.
+
+uint64_t clock_us() {
+    return std::chrono::steady_clock::now().time_since_epoch().count() / 1000;
+}
+
+static double Seconds(uint64_t us) {
+    return double(us) / 1000000.0;
+}
+
+void Run(const char* prog, const char* name, evpp::InvokeTimer::Backend backend, int timer_count) {
+    evpp::EventLoop loop;
+    loop.SetTimerBackend(backend);
+    std::vector<evpp::InvokeTimerPtr> timers;
+    timers.reserve(timer_count);
+    int fired = 0;
+    auto f = [&fired]() {
+        fired++;
+    };
+
+    uint64_t start = clock_us();
+    for (int i = 0; i < timer_count; ++i) {
+        timers.push_back(loop.RunAfter(evpp::Duration(1.0 + (i % 9000) * 0.001), f));
+    }
+    uint64_t add_cost = clock_us() - start;
+
+    start = clock_us();
+    for (auto& t : timers) {
+        t->Cancel();
+    }
+    uint64_t cancel_cost = clock_us() - start;
+    timers.clear();
+    assert(fired == 0);
+
+    start = clock_us();
+    for (int i = 0; i < timer_count; ++i) {
+        loop.RunAfter(evpp::Duration((1 + i % 100) * 0.001), f);
+    }
+    loop.RunAfter(evpp::Duration(0.2), [&loop]() {
+        loop.Stop();
+    });
+    loop.Run();
+    uint64_t fire_cost = clock_us() - start;
+
+    LOG_WARN << prog << " " << name << " timer_count=" << timer_count
+        << " fired=" << fired
+        << " add: " << Seconds(add_cost) << " seconds"
+        << " cancel: " << Seconds(cancel_cost) << " seconds"
+        << " add and fire within 200ms: " << Seconds(fire_cost) << " seconds";
+}
+
+int main(int argc, char* argv[]) {
+    int timer_count = 1000000;
+
+    if (argc == 2) {
+        timer_count = std::atoi(argv[1]);
+    } else {
+        printf("Usage : %s <timer-count>\n", argv[0]);
+        return 0;
+    }
+
+    Run(argv[0], "libevent", evpp::InvokeTimer::kLibevent, timer_count);
+    Run(argv[0], "timing-wheel", evpp::InvokeTimer::kTimingWheel, timer_count);
+    return 0;
+}
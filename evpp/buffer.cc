@@ -11,6 +11,7 @@
 
 #include "evpp/inner_pre.h"
 #include "evpp/buffer.h"
+#include "evpp/buffer_pool.h"
 #include "evpp/sockets.h"
 
 namespace evpp {
@@ -19,18 +20,43 @@ const char Buffer::kCRLF[] = "\r\n";
 const size_t Buffer::kCheapPrependSize = 8;
 const size_t Buffer::kInitialSize  = 1024;
 
+char* Buffer::AllocateStorage(size_t n, size_t* actual_size) {
+    if (pool_) {
+        return pool_->Allocate(n, actual_size);
+    }
+
+    *actual_size = n;
+    return new char[n];
+}
+
+void Buffer::FreeStorage(char* p, size_t n) {
+    if (!p) {
+        return;
+    }
+
+    if (pool_) {
+        pool_->Deallocate(p, n);
+    } else {
+        delete[] p;
+    }
+}
+
 ssize_t Buffer::ReadFromFD(evpp_socket_t fd, int* savedErrno) {
     // saved an ioctl()/FIONREAD call to tell how much to read
     char extrabuf[65536];
+    return ReadFromFD(fd, extrabuf, sizeof extrabuf, savedErrno);
+}
+
+ssize_t Buffer::ReadFromFD(evpp_socket_t fd, char* extrabuf, size_t extrabuf_len, int* savedErrno) {
     struct iovec vec[2];
     const size_t writable = WritableBytes();
     vec[0].iov_base = begin() + write_index_;
     vec[0].iov_len = writable;
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_len = extrabuf_len;
     // when there is enough space in this buffer, don't read into extrabuf.
-    // when extrabuf is used, we read 64k bytes at most.
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    // when extrabuf is used, we read extrabuf_len bytes at most.
+    const int iovcnt = (writable < extrabuf_len) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
 
     if (n < 0) {
@@ -10,6 +10,8 @@
 #include <algorithm>
 
 namespace evpp {
+class BufferPool;
+
 class EVPP_EXPORT Buffer {
 public:
     static const size_t kCheapPrependSize;
@@ -26,18 +28,55 @@ public:
         assert(PrependableBytes() == reserved_prepend_size);
     }
 
+    // @brief Create an empty Buffer without any storage. The storage is
+    //  allocated from pool when the first data is written into the Buffer,
+    //  and given back to pool when the Buffer is destructed or shrunk.
+    // @note The Buffer must only be modified and destructed in the thread of pool.
+    explicit Buffer(BufferPool& pool, size_t reserved_prepend_size = kCheapPrependSize)
+        : buffer_(nullptr)
+        , capacity_(0)
+        , read_index_(0)
+        , write_index_(0)
+        , reserved_prepend_size_(reserved_prepend_size)
+        , pool_(&pool) {
+    }
+
+    // Move constructor takes the underlying storage of rhs without copying,
+    // rhs is left empty without any storage. rhs keeps its pool, so its
+    // storage is still allocated from the pool when it is written again.
+    Buffer(Buffer&& rhs)
+        : buffer_(nullptr)
+        , capacity_(0)
+        , read_index_(0)
+        , write_index_(0)
+        , reserved_prepend_size_(rhs.reserved_prepend_size_)
+        , pool_(rhs.pool_) {
+        Swap(rhs);
+    }
+
+    Buffer& operator=(Buffer&& rhs) {
+        if (this != &rhs) {
+            Buffer tmp(std::move(rhs));
+            Swap(tmp);
+        }
+        return *this;
+    }
+
     ~Buffer() {
-        delete[] buffer_;
+        FreeStorage(buffer_, capacity_);
         buffer_ = nullptr;
         capacity_ = 0;
     }
 
+    // Swap exchanges the storage of the two Buffers,
+    // together with the pools which the storage belongs to.
     void Swap(Buffer& rhs) {
         std::swap(buffer_, rhs.buffer_);
         std::swap(capacity_, rhs.capacity_);
         std::swap(read_index_, rhs.read_index_);
         std::swap(write_index_, rhs.write_index_);
         std::swap(reserved_prepend_size_, rhs.reserved_prepend_size_);
+        std::swap(pool_, rhs.pool_);
     }
 
     // Skip advances the reading index of the buffer
@@ -60,8 +99,9 @@ public:
     // It does nothing if n is greater than the length of the buffer.
     void Truncate(size_t n) {
         if (n == 0) {
-            read_index_ = reserved_prepend_size_;
-            write_index_ = reserved_prepend_size_;
+            // A Buffer without storage has no room to prepend
+            read_index_ = std::min(reserved_prepend_size_, capacity_);
+            write_index_ = read_index_;
         } else if (write_index_ > read_index_ + n) {
             write_index_ = read_index_ + n;
         }
@@ -176,6 +216,9 @@ public:
 
     // Insert content, specified by the parameter, into the front of reading index
     void Prepend(const void* /*restrict*/ d, size_t len) {
+        if (!buffer_ && reserved_prepend_size_ > 0) {
+            grow(0);
+        }
         assert(len <= PrependableBytes());
         read_index_ -= len;
         const char* p = static_cast<const char*>(d);
@@ -227,16 +270,37 @@ public:
         return std::string(data(), length());
     }
 
+    // Shrink reallocates the storage to hold the unread data and reserve
+    // more bytes. If both are 0, the storage is released totally.
     void Shrink(size_t reserve) {
-        Buffer other(length() + reserve);
-        other.Append(ToSlice());
-        Swap(other);
+        size_t m = length();
+        char* d = nullptr;
+        size_t n = 0;
+        if (m + reserve > 0) {
+            d = AllocateStorage(m + reserve + reserved_prepend_size_, &n);
+            memcpy(d + reserved_prepend_size_, begin() + read_index_, m);
+        }
+        FreeStorage(buffer_, capacity_);
+        buffer_ = d;
+        capacity_ = n;
+        read_index_ = std::min(reserved_prepend_size_, capacity_);
+        write_index_ = read_index_ + m;
+    }
+
+    // The pool which the storage is allocated from, or nullptr
+    BufferPool* pool() const {
+        return pool_;
     }
 
     // ReadFromFD reads data from a fd directly into buffer,
     // and return result of readv, errno is saved into saved_errno
     ssize_t ReadFromFD(evpp_socket_t fd, int* saved_errno);
 
+    // ReadFromFD reads data from a fd into the writable space of buffer and
+    // the scratch memory extrabuf with one readv call. The data which overflows
+    // into extrabuf is appended to buffer then.
+    ssize_t ReadFromFD(evpp_socket_t fd, char* extrabuf, size_t extrabuf_len, int* saved_errno);
+
     // Next returns a slice containing the next n bytes from the buffer,
     // advancing the buffer as if the bytes had been returned by Read.
     // If there are fewer than n bytes in the buffer, Next returns the entire buffer.
@@ -402,14 +466,14 @@ private:
     void grow(size_t len) {
         if (WritableBytes() + PrependableBytes() < len + reserved_prepend_size_) {
             //grow the capacity
-            size_t n = (capacity_ << 1) + len;
+            size_t n = std::max((capacity_ << 1) + len, len + reserved_prepend_size_);
             size_t m = length();
-            char* d = new char[n];
+            char* d = AllocateStorage(n, &n);
             memcpy(d + reserved_prepend_size_, begin() + read_index_, m);
             write_index_ = m + reserved_prepend_size_;
             read_index_ = reserved_prepend_size_;
+            FreeStorage(buffer_, capacity_);
             capacity_ = n;
-            delete[] buffer_;
             buffer_ = d;
         } else {
             // move readable data to the front, make space inside buffer
@@ -423,12 +487,17 @@ private:
         }
     }
 
+    // Allocate at least n bytes from pool_ or the system
+    char* AllocateStorage(size_t n, size_t* actual_size);
+    void FreeStorage(char* p, size_t n);
+
 private:
     char* buffer_;
     size_t capacity_;
     size_t read_index_;
     size_t write_index_;
     size_t reserved_prepend_size_;
+    BufferPool* pool_ = nullptr;
     static const char kCRLF[];
 };
 
@@ -0,0 +1,89 @@
+#include "evpp/inner_pre.h"
+
+#include "evpp/buffer_pool.h"
+
+namespace evpp {
+
+const size_t BufferPool::kMinBlockSize = 256;
+const size_t BufferPool::kMaxBlockSize = 64 * 1024;
+const size_t BufferPool::kDefaultMaxCachedBytes = 4 * 1024 * 1024;
+
+BufferPool::BufferPool(size_t max_cached_bytes)
+    : max_cached_bytes_(max_cached_bytes)
+    , allocated_bytes_(0)
+    , cached_bytes_(0)
+    , hit_count_(0)
+    , miss_count_(0) {
+    assert(kMaxBlockSize == (kMinBlockSize << (kSizeClassCount - 1)));
+    for (int i = 0; i < kSizeClassCount; ++i) {
+        free_lists_[i] = nullptr;
+    }
+}
+
+BufferPool::~BufferPool() {
+    Clear();
+}
+
+int BufferPool::SizeClassOf(size_t n) {
+    int index = 0;
+    size_t size = kMinBlockSize;
+    while (size < n) {
+        size <<= 1;
+        ++index;
+    }
+    return index;
+}
+
+char* BufferPool::Allocate(size_t n, size_t* actual_size) {
+    if (n > kMaxBlockSize) {
+        Add(miss_count_, uint64_t(1));
+        Add(allocated_bytes_, n);
+        *actual_size = n;
+        return new char[n];
+    }
+
+    int index = SizeClassOf(n);
+    size_t size = kMinBlockSize << index;
+    *actual_size = size;
+    Add(allocated_bytes_, size);
+
+    FreeBlock* b = free_lists_[index];
+    if (b) {
+        free_lists_[index] = b->next;
+        Sub(cached_bytes_, size);
+        Add(hit_count_, uint64_t(1));
+        return reinterpret_cast<char*>(b);
+    }
+
+    Add(miss_count_, uint64_t(1));
+    return new char[size];
+}
+
+void BufferPool::Deallocate(char* p, size_t n) {
+    assert(p);
+    Sub(allocated_bytes_, n);
+
+    if (n > kMaxBlockSize || cached_bytes() + n > max_cached_bytes_) {
+        delete[] p;
+        return;
+    }
+
+    int index = SizeClassOf(n);
+    assert(n == (kMinBlockSize << index));
+    FreeBlock* b = reinterpret_cast<FreeBlock*>(p);
+    b->next = free_lists_[index];
+    free_lists_[index] = b;
+    Add(cached_bytes_, n);
+}
+
+void BufferPool::Clear() {
+    for (int i = 0; i < kSizeClassCount; ++i) {
+        while (free_lists_[i]) {
+            FreeBlock* b = free_lists_[i];
+            free_lists_[i] = b->next;
+            delete[] reinterpret_cast<char*>(b);
+        }
+    }
+    cached_bytes_.store(0, std::memory_order_relaxed);
+}
+}
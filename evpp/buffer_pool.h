@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+
+#include "evpp/inner_pre.h"
+
+namespace evpp {
+
+// BufferPool caches the storage blocks of Buffers.
+//
+// The size of a block is rounded up to a power of two between
+// kMinBlockSize and kMaxBlockSize, and a drained block is kept in the free list
+// of its size to serve the next allocation of the same size. The blocks bigger
+// than kMaxBlockSize are not cached.
+//
+// Every EventLoop owns a BufferPool shared by all the connections of the loop,
+// so it also tells how many bytes are held by the buffers of the loop.
+//
+// It is not thread safe except the statistics methods. A block must be
+// allocated and deallocated in the same thread.
+class EVPP_EXPORT BufferPool {
+public:
+    static const size_t kMinBlockSize;  // = 256
+    static const size_t kMaxBlockSize;  // = 64K
+    static const size_t kDefaultMaxCachedBytes; // = 4M
+
+    explicit BufferPool(size_t max_cached_bytes = kDefaultMaxCachedBytes);
+    ~BufferPool();
+
+    // Allocate returns a block of at least n bytes.
+    // The actual size of the block is saved into actual_size.
+    char* Allocate(size_t n, size_t* actual_size);
+
+    // Deallocate gives back a block returned by Allocate.
+    // n must be the actual size of the block.
+    void Deallocate(char* p, size_t n);
+
+    // Release all the cached blocks to the system
+    void Clear();
+
+    // The max count of bytes of the cached blocks. 0 disables the cache.
+    void set_max_cached_bytes(size_t n) {
+        max_cached_bytes_ = n;
+    }
+
+    size_t max_cached_bytes() const {
+        return max_cached_bytes_;
+    }
+
+public:
+    // The count of bytes held by the Buffers allocated from this pool
+    size_t allocated_bytes() const {
+        return allocated_bytes_.load(std::memory_order_relaxed);
+    }
+
+    // The count of bytes of the blocks cached in the free lists
+    size_t cached_bytes() const {
+        return cached_bytes_.load(std::memory_order_relaxed);
+    }
+
+    // The count of allocations served by the free lists
+    uint64_t hit_count() const {
+        return hit_count_.load(std::memory_order_relaxed);
+    }
+
+    // The count of allocations served by the system
+    uint64_t miss_count() const {
+        return miss_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // The statistics are only modified in the owner thread,
+    // so a relaxed load and store is enough.
+    template<typename T>
+    static void Add(std::atomic<T>& v, T n) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    static void Sub(std::atomic<T>& v, T n) {
+        v.store(v.load(std::memory_order_relaxed) - n, std::memory_order_relaxed);
+    }
+
+    static int SizeClassOf(size_t n);
+
+private:
+    enum { kSizeClassCount = 9, }; // 256, 512, ..., 64K
+
+    // The free lists are linked through the first bytes of the blocks
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    FreeBlock* free_lists_[kSizeClassCount];
+
+    size_t max_cached_bytes_;
+    std::atomic<size_t> allocated_bytes_;
+    std::atomic<size_t> cached_bytes_;
+    std::atomic<uint64_t> hit_count_;
+    std::atomic<uint64_t> miss_count_;
+};
+}
@@ -1,11 +1,19 @@
 #include "evpp/inner_pre.h"
 
+#include <limits>
+
 #include "evpp/libevent.h"
 #include "evpp/event_watcher.h"
 #include "evpp/event_loop.h"
 #include "evpp/invoke_timer.h"
+#include "evpp/timestamp.h"
 
 namespace evpp {
+namespace {
+// The EventLoop running in this thread, see QueueInLoop
+thread_local EventLoop* g_running_loop = nullptr;
+}
+
 EventLoop::EventLoop()
     : create_evbase_myself_(true), notified_(false), pending_functor_count_(0) {
     DLOG_TRACE;
@@ -34,7 +42,7 @@ EventLoop::EventLoop(struct event_base* base)
     bool rc = watcher_->AsyncWait();
     assert(rc);
     if (!rc) {
-        LOG_FATAL << "PipeEventWatcher init failed.";
+        LOG_FATAL << "NotifyEventWatcher init failed.";
     }
     status_.store(kRunning);
 }
@@ -43,6 +51,9 @@ EventLoop::~EventLoop() {
     DLOG_TRACE;
     watcher_.reset();
 
+    // The libevent timer of the wheel must be freed before evbase_
+    timing_wheel_.reset();
+
     if (evbase_ != nullptr && create_evbase_myself_) {
         event_base_free(evbase_);
         evbase_ = nullptr;
@@ -57,15 +68,19 @@ void EventLoop::Init() {
     status_.store(kInitializing);
 #ifdef H_HAVE_BOOST
     const size_t kPendingFunctorCount = 1024 * 16;
-    this->pending_functors_ = new boost::lockfree::queue<Functor*>(kPendingFunctorCount);
+    this->pending_functors_ = new boost::lockfree::queue<Task*>(kPendingFunctorCount);
 #elif defined(H_HAVE_CAMERON314_CONCURRENTQUEUE)
-    this->pending_functors_ = new moodycamel::ConcurrentQueue<Functor>();
+    this->pending_functors_ = new moodycamel::ConcurrentQueue<Task>();
 #else
-    this->pending_functors_ = new std::vector<Functor>();
+    this->pending_functors_ = new std::vector<Task>();
 #endif
 
     tid_ = std::this_thread::get_id(); // The default thread id
 
+    buffer_pool_.reset(new BufferPool);
+    tcp_conn_pool_ = std::make_shared<MemoryPool>();
+    fd_channel_pool_ = std::make_shared<MemoryPool>();
+
     InitNotifyPipeWatcher();
 
     status_.store(kInitialized);
@@ -73,6 +88,13 @@ void EventLoop::Init() {
 
 void EventLoop::InitNotifyPipeWatcher() {
     // Initialized task queue notify pipe watcher
+#ifdef __linux__
+    watcher_.reset(new EventFdWatcher(this, std::bind(&EventLoop::DoPendingFunctors, this)));
+    if (watcher_->Init()) {
+        return;
+    }
+    LOG_WARN << "EventFdWatcher init failed, fall back to PipeEventWatcher.";
+#endif
     watcher_.reset(new PipeEventWatcher(this, std::bind(&EventLoop::DoPendingFunctors, this)));
     int rc = watcher_->Init();
     assert(rc);
@@ -89,13 +111,30 @@ void EventLoop::Run() {
     int rc = watcher_->AsyncWait();
     assert(rc);
     if (!rc) {
-        LOG_FATAL << "PipeEventWatcher init failed.";
+        LOG_FATAL << "NotifyEventWatcher init failed.";
     }
 
     // After everything have initialized, we set the status to kRunning
     status_.store(kRunning);
+    g_running_loop = this;
+
+    // It works as event_base_dispatch, but we know when an iteration ends
+    cache_now_ = true;
+    for (;;) {
+        if (busy_poll_ns_.load(std::memory_order_relaxed) > 0 && !BusyPoll(&rc)) {
+            break;
+        }
+
+        now_cached_ = false;
+        rc = event_base_loop(evbase_, EVLOOP_ONCE);
+        if (IsLoopExited(rc)) {
+            break;
+        }
+    }
+    cache_now_ = false;
+    now_cached_ = false;
+    g_running_loop = nullptr;
 
-    rc = event_base_dispatch(evbase_);
     if (rc == 1) {
         LOG_ERROR << "event_base_dispatch error: no event registered";
     } else if (rc == -1) {
@@ -110,6 +149,47 @@ void EventLoop::Run() {
     status_.store(kStopped);
 }
 
+bool EventLoop::IsLoopExited(int rc) {
+    return rc != 0 || event_base_got_exit(evbase_) || event_base_got_break(evbase_);
+}
+
+bool EventLoop::BusyPoll(int* rc) {
+    // The producers do not wake us up while notified_ is true,
+    // since the pending tasks are checked in every poll.
+    notified_.store(true);
+    std::chrono::steady_clock::time_point idle_since = std::chrono::steady_clock::now();
+    for (;;) {
+        uint64_t io_event_count = io_event_count_;
+        now_cached_ = false;
+        *rc = event_base_loop(evbase_, EVLOOP_NONBLOCK);
+        if (IsLoopExited(*rc)) {
+            return false;
+        }
+
+        bool busy = io_event_count_ != io_event_count;
+        if (pending_functor_count_.load() > 0) {
+            DoPendingFunctors();
+            notified_.store(true);
+            busy = true;
+        }
+
+        std::chrono::steady_clock::time_point now = Now();
+        if (busy) {
+            idle_since = now;
+        } else if (std::chrono::duration_cast<std::chrono::nanoseconds>(now - idle_since).count() >= busy_poll_ns_.load(std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    // The tasks queued before notified_ is reset can not wake us up. Run them
+    // now, then the loop can block.
+    notified_.store(false);
+    if (pending_functor_count_.load() > 0) {
+        DoPendingFunctors();
+    }
+    return true;
+}
+
 void EventLoop::Stop() {
     DLOG_TRACE;
     assert(status_.load() == kRunning);
@@ -207,37 +287,59 @@ evpp::InvokeTimerPtr EventLoop::RunEvery(Duration interval, Functor&& f) {
     return t;
 }
 
-void EventLoop::RunInLoop(const Functor& functor) {
+void EventLoop::RunInLoop(Task&& task) {
     DLOG_TRACE;
     if (IsRunning() && IsInLoopThread()) {
-        functor();
+        task();
     } else {
-        QueueInLoop(functor);
+        QueueInLoop(std::move(task));
     }
 }
 
-void EventLoop::RunInLoop(Functor&& functor) {
-    DLOG_TRACE;
-    if (IsRunning() && IsInLoopThread()) {
-        functor();
-    } else {
-        QueueInLoop(std::move(functor));
+void EventLoop::QueueInLoop(Task&& task) {
+    size_t capacity = pending_queue_capacity_.load(std::memory_order_relaxed);
+    if (capacity > 0 && !IsInLoopThread()) {
+        if (g_running_loop) {
+            // Another loop posts the task, e.g. TCPServer or ResponseWriter
+            if (static_cast<size_t>(pending_functor_count_.load()) >= capacity) {
+                pending_task_stats_.overflow_count.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            // Backpressure : wait for the loop to drain the queue
+            while (static_cast<size_t>(pending_functor_count_.load()) >= capacity && IsRunning()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    EnqueuePendingFunctor(std::move(task));
+}
+
+bool EventLoop::TryQueueInLoop(Task&& task) {
+    size_t capacity = pending_queue_capacity_.load(std::memory_order_relaxed);
+    if (capacity > 0 && static_cast<size_t>(pending_functor_count_.load()) >= capacity) {
+        pending_task_stats_.rejected_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
+    EnqueuePendingFunctor(std::move(task));
+    return true;
 }
 
-void EventLoop::QueueInLoop(const Functor& cb) {
+void EventLoop::EnqueuePendingFunctor(Task&& task) {
     DLOG_TRACE << "pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
     {
 #ifdef H_HAVE_BOOST
-        auto f = new Functor(cb);
+        // boost::lockfree::queue only holds trivial types, so the task is
+        // allocated from the heap. The callable object is moved into it without
+        // another allocation when it fits in Task::kInlineSize.
+        auto f = new Task(std::move(task));
         while (!pending_functors_->push(f)) {
         }
 #elif defined(H_HAVE_CAMERON314_CONCURRENTQUEUE)
-        while (!pending_functors_->enqueue(cb)) {
+        while (!pending_functors_->enqueue(std::move(task))) {
         }
 #else
         std::lock_guard<std::mutex> lock(mutex_);
-        pending_functors_->emplace_back(cb);
+        pending_functors_->emplace_back(std::move(task));
 #endif
     }
     ++pending_functor_count_;
@@ -260,78 +362,109 @@ void EventLoop::QueueInLoop(const Functor& cb) {
         if (watcher_) {
             watcher_->Notify();
         } else {
-            DLOG_TRACE << "status=" << StatusToString();
+            DLOG_TRACE << "watcher_ is empty, maybe we call EventLoop::QueueInLoop on a stopped EventLoop. status=" << StatusToString();
             assert(!IsRunning());
         }
     } else {
-         DLOG_TRACE << "No need to call watcher_->Nofity()";
+        DLOG_TRACE << "No need to call watcher_->Nofity()";
     }
 }
 
-void EventLoop::QueueInLoop(Functor&& cb) {
+void EventLoop::DoPendingFunctors() {
     DLOG_TRACE << "pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
-    {
-#ifdef H_HAVE_BOOST
-        auto f = new Functor(std::move(cb)); // TODO Add test code for it
-        while (!pending_functors_->push(f)) {
-        }
-#elif defined(H_HAVE_CAMERON314_CONCURRENTQUEUE)
-        while (!pending_functors_->enqueue(std::move(cb))) {
-        }
-#else
-        std::lock_guard<std::mutex> lock(mutex_);
-        pending_functors_->emplace_back(std::move(cb));
-#endif
+    PendingTaskStats& st = pending_task_stats_;
+    uint64_t depth = static_cast<uint64_t>(pending_functor_count_.load());
+    if (depth > st.max_depth.load(std::memory_order_relaxed)) {
+        st.max_depth.store(depth, std::memory_order_relaxed);
     }
-    ++pending_functor_count_;
-    DLOG_TRACE << "queued a new Functor. pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
-    if (!notified_.load()) {
-        DLOG_TRACE << "call watcher_->Nofity() notified_.store(true)";
+
+    size_t budget = max_tasks_per_iteration_ > 0 ? max_tasks_per_iteration_ : std::numeric_limits<size_t>::max();
+    Timestamp begin = Timestamp::Now();
+    size_t count = RunPendingFunctors(budget);
+    uint64_t cost = static_cast<uint64_t>(Timestamp::Now().UnixMicro() - begin.UnixMicro());
+
+    // The statistics are only modified in this thread
+    st.batch_count.store(st.batch_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    st.task_count.store(st.task_count.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    st.total_time_us.store(st.total_time_us.load(std::memory_order_relaxed) + cost, std::memory_order_relaxed);
+    if (cost > st.max_time_us.load(std::memory_order_relaxed)) {
+        st.max_time_us.store(cost, std::memory_order_relaxed);
+    }
+
+    if (count == budget && !IsPendingQueueEmpty()) {
+        // The budget is used up. Wake up ourself to run the tasks left
+        // after the IO events of this iteration are handled.
+        DLOG_TRACE << "the budget " << budget << " is used up, PendingQueueSize=" << GetPendingQueueSize();
+        st.deferred_count.store(st.deferred_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
         notified_.store(true);
         if (watcher_) {
             watcher_->Notify();
-        } else {
-            DLOG_TRACE << "watcher_ is empty, maybe we call EventLoop::QueueInLoop on a stopped EventLoop. status=" << StatusToString();
-            assert(!IsRunning());
         }
-    } else {
-        DLOG_TRACE << "No need to call watcher_->Nofity()";
     }
 }
 
-void EventLoop::DoPendingFunctors() {
-    DLOG_TRACE << "pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
-
+size_t EventLoop::RunPendingFunctors(size_t budget) {
+    size_t count = 0;
 #ifdef H_HAVE_BOOST
     notified_.store(false);
-    Functor* f = nullptr;
-    while (pending_functors_->pop(f)) {
+    Task* f = nullptr;
+    while (count < budget && pending_functors_->pop(f)) {
         (*f)();
         delete f;
         --pending_functor_count_;
+        ++count;
     }
 #elif defined(H_HAVE_CAMERON314_CONCURRENTQUEUE)
     notified_.store(false);
-    Functor f;
-    while (pending_functors_->try_dequeue(f)) {
-        f();
-        --pending_functor_count_;
+    enum { kBulkSize = 32, };
+    Task tasks[kBulkSize];
+    while (count < budget) {
+        size_t n = pending_functors_->try_dequeue_bulk(tasks, std::min<size_t>(kBulkSize, budget - count));
+        if (n == 0) {
+            break;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            tasks[i]();
+            tasks[i].Reset();
+            --pending_functor_count_;
+        }
+        count += n;
     }
 #else
-    std::vector<Functor> functors;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        notified_.store(false);
-        pending_functors_->swap(functors);
-        DLOG_TRACE << "pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
-    }
-    DLOG_TRACE << "pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
-    for (size_t i = 0; i < functors.size(); ++i) {
-        functors[i]();
+    notified_.store(false);
+    bool swapped = false;
+    while (count < budget) {
+        if (running_functor_index_ == running_functors_.size()) {
+            // Take the pending tasks only once, so a task queueing another
+            // task does not keep us here.
+            if (swapped) {
+                break;
+            }
+
+            // The capacity of running_functors_ is given back to pending_functors_,
+            // so the producers don't have to grow it again.
+            running_functors_.clear();
+            running_functor_index_ = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_functors_->swap(running_functors_);
+            }
+            swapped = true;
+            if (running_functors_.empty()) {
+                break;
+            }
+        }
+
+        // Move the task out since it may call DoPendingFunctors again,
+        // e.g. StopInLoop, which changes running_functors_.
+        Task f(std::move(running_functors_[running_functor_index_++]));
+        f();
         --pending_functor_count_;
+        ++count;
     }
     DLOG_TRACE << "pending_functor_count_=" << pending_functor_count_ << " PendingQueueSize=" << GetPendingQueueSize() << " notified_=" << notified_.load();
 #endif
+    return count;
 }
 
 size_t EventLoop::GetPendingQueueSize() {
@@ -350,7 +483,7 @@ bool EventLoop::IsPendingQueueEmpty() {
 #elif defined(H_HAVE_CAMERON314_CONCURRENTQUEUE)
     return pending_functors_->size_approx() == 0;
 #else
-    return pending_functors_->empty();
+    return pending_functors_->empty() && running_functor_index_ == running_functors_.size();
 #endif
 }
 
@@ -8,9 +8,14 @@
 #include "evpp/inner_pre.h"
 #include "evpp/event_watcher.h"
 #include "evpp/duration.h"
+#include "evpp/timestamp.h"
 #include "evpp/any.h"
 #include "evpp/invoke_timer.h"
+#include "evpp/timing_wheel.h"
 #include "evpp/server_status.h"
+#include "evpp/buffer_pool.h"
+#include "evpp/memory_pool.h"
+#include "evpp/task.h"
 
 #ifdef H_HAVE_BOOST
 #include <boost/lockfree/queue.hpp>
@@ -29,6 +34,23 @@
 
 namespace evpp {
 
+namespace http {
+class Server;
+}
+
+// The statistics of the tasks queued by EventLoop::QueueInLoop. A batch is
+// the tasks run in one iteration of the loop. They can be read in any thread.
+struct PendingTaskStats {
+    std::atomic<uint64_t> batch_count = { 0 };
+    std::atomic<uint64_t> task_count = { 0 }; // The count of the tasks which have been run
+    std::atomic<uint64_t> deferred_count = { 0 }; // The batches stopped by the budget with tasks left
+    std::atomic<uint64_t> rejected_count = { 0 }; // The tasks rejected by TryQueueInLoop because the queue is full
+    std::atomic<uint64_t> overflow_count = { 0 }; // The tasks queued over the capacity by another EventLoop
+    std::atomic<uint64_t> max_depth = { 0 }; // The max count of the pending tasks at the beginning of a batch
+    std::atomic<uint64_t> total_time_us = { 0 }; // The time spent in running the tasks
+    std::atomic<uint64_t> max_time_us = { 0 }; // The longest time spent in one batch
+};
+
 // This is the IO Event driving kernel. Reactor model.
 // This class is a wrapper of event_base but not only a wrapper.
 // It provides a simple way to run a IO Event driving loop.
@@ -61,8 +83,55 @@ public:
     // RunEvery executes Functor f every period interval time.
     InvokeTimerPtr RunEvery(Duration interval, const Functor& f);
 
-    void RunInLoop(const Functor& handler);
-    void QueueInLoop(const Functor& handler);
+    // @brief Run the task in the IO Event thread. It is run at once if it
+    //  is called in the IO Event thread, otherwise it is queued.
+    // @note A lambda or a std::bind capturing less than Task::kInlineSize
+    //  bytes is queued without allocating memory.
+    void RunInLoop(Task&& task);
+
+    // @brief Queue the task to be run in the IO Event thread.
+    //  When the pending queue is bounded by SetPendingQueueCapacity and it is
+    //  full, the caller waits until the loop has run some tasks, unless it is
+    //  called in the IO Event thread or the loop is not running.
+    //  The thread of another running EventLoop never waits, since that would
+    //  stall its own IO, and two loops could wait for each other. Its task
+    //  is queued over the capacity and counted in PendingTaskStats::overflow_count.
+    void QueueInLoop(Task&& task);
+
+    // @brief Queue the task if the pending queue is not full.
+    // @return false if the queue is full. The task is not moved in this case.
+    bool TryQueueInLoop(Task&& task);
+
+    // @brief Set the max count of the queued tasks run in one iteration of
+    //  the loop. The tasks left are run after the IO events are handled, so a
+    //  burst of tasks does not starve the connections. 0 means no limit,
+    //  which is the default.
+    // @note It must be called before Run or in the IO Event thread.
+    void SetMaxTasksPerIteration(size_t n) {
+        max_tasks_per_iteration_ = n;
+    }
+
+    // @brief Bound the count of the pending tasks. It is approximate since
+    //  the producers do not lock each other. 0 means no limit, which is the default.
+    void SetPendingQueueCapacity(size_t n) {
+        pending_queue_capacity_ = n;
+    }
+
+    // @brief Spin instead of sleeping when the loop is idle, to cut the
+    //  latency of waking up at the cost of a busy CPU. The loop polls the IO
+    //  events without blocking and checks the pending tasks, which are queued
+    //  without writing the wakeup pipe while it is spinning. It blocks as
+    //  usual after it has found nothing to do for d.
+    //  The sockets of the TCPConns created in this loop are set SO_BUSY_POLL
+    //  of d too, if it is supported. See also the busy_read sysctl of Linux,
+    //  raising it above the system default needs CAP_NET_ADMIN.
+    //  A zero duration, the default, disables it. It is thread safe.
+    void SetBusyPollDuration(Duration d) {
+        busy_poll_ns_.store(d.Nanoseconds(), std::memory_order_relaxed);
+    }
+    Duration busy_poll_duration() const {
+        return Duration(busy_poll_ns_.load(std::memory_order_relaxed));
+    }
 
 public:
 
@@ -72,9 +141,6 @@ public:
     // RunEvery executes Functor f every period interval time.
     InvokeTimerPtr RunEvery(Duration interval, Functor&& f);
 
-    void RunInLoop(Functor&& handler);
-    void QueueInLoop(Functor&& handler);
-
     // Getter and Setter
 public:
     struct event_base* event_base() {
@@ -100,14 +166,105 @@ public:
     int pending_functor_count() const {
         return pending_functor_count_.load();
     }
+
+    // @brief Return the count of the TCPConns attached to this loop and the
+    //  HTTP requests being processed in it. It is thread safe.
+    //  See ThreadDispatchPolicy::kLeastConnections.
+    int connection_count() const {
+        return connection_count_.load(std::memory_order_relaxed);
+    }
+    const PendingTaskStats& pending_task_stats() const {
+        return pending_task_stats_;
+    }
     const std::thread::id& tid() const {
         return tid_;
     }
+
+    // @brief Return the current time, which is read from the clock at most
+    //  once in every iteration of the loop. It is read at the first call after
+    //  the loop wakes up, and the later calls in the same iteration return the
+    //  same time. It is used by the activity tracking of the connections,
+    //  which does not need a preciser time. It is the monotonic clock, the
+    //  same as TimingWheel, so the intervals measured by it are not changed
+    //  when the wall clock is set. Use Timestamp::Now() for the wall time.
+    //  The time is not cached when the loop is not run by Run(), e.g. it is
+    //  built from an existing event_base.
+    // @note It must only be called in the IO Event thread.
+    std::chrono::steady_clock::time_point Now() {
+        if (!now_cached_) {
+            now_ = std::chrono::steady_clock::now();
+            now_cached_ = cache_now_;
+        }
+        return now_;
+    }
+
+    // The size of the memory returned by read_scratch()
+    enum { kReadScratchSize = 64 * 1024, };
+
+    // @brief The scratch memory shared by all the connections of this loop.
+    //  A connection reads the data which overflows its input buffer into it,
+    //  so the input buffer can be kept small.
+    // @note It must only be used in the IO Event thread.
+    char* read_scratch() {
+        if (!read_scratch_) {
+            read_scratch_.reset(new char[kReadScratchSize]);
+        }
+        return read_scratch_.get();
+    }
+
+    // @brief The pool of the buffer storage of the connections of this loop.
+    //  Its statistics tell how many bytes are held by the buffers of this loop,
+    //  and they can be read in any thread.
+    // @note The other methods must only be used in the IO Event thread.
+    BufferPool* buffer_pool() const {
+        return buffer_pool_.get();
+    }
+
+    // @brief The pools of the memory of the TCPConn and FdChannel objects
+    //  created in this loop. Their statistics can be read in any thread.
+    const std::shared_ptr<MemoryPool>& tcp_conn_pool() const {
+        return tcp_conn_pool_;
+    }
+    const std::shared_ptr<MemoryPool>& fd_channel_pool() const {
+        return fd_channel_pool_;
+    }
+
+    // @brief Set the default backend of the InvokeTimers created in this loop,
+    //  including the ones created by RunAfter and RunEvery. Use
+    //  InvokeTimer::kTimingWheel when there are lots of timers which are
+    //  usually canceled before they expire, e.g. the request timeouts.
+    //  The default is InvokeTimer::kLibevent.
+    void SetTimerBackend(InvokeTimer::Backend b) {
+        timer_backend_ = b;
+    }
+    InvokeTimer::Backend timer_backend() const {
+        return timer_backend_;
+    }
+
+    // @brief The timing wheel of this loop. It is created at the first call
+    //  with the default tick of 1ms.
+    // @note It must only be used in the IO Event thread.
+    TimingWheel* timing_wheel() {
+        if (!timing_wheel_) {
+            timing_wheel_.reset(new TimingWheel(this));
+        }
+        return timing_wheel_.get();
+    }
 private:
     void Init();
     void InitNotifyPipeWatcher();
+
+    // Return true if event_base_loop returns rc because the loop is done
+    bool IsLoopExited(int rc);
+
+    // Spin until there is nothing to do for busy_poll_ns_.
+    // Return false if the loop is done, and rc is set to the result of event_base_loop.
+    bool BusyPoll(int* rc);
     void StopInLoop();
     void DoPendingFunctors();
+    void EnqueuePendingFunctor(Task&& task);
+    // Run the pending tasks, at most budget of them. Return the count of the tasks run.
+    size_t RunPendingFunctors(size_t budget);
     size_t GetPendingQueueSize();
     bool IsPendingQueueEmpty();
 private:
@@ -118,19 +275,53 @@ private:
     Any context_[kContextCount];
 
     std::mutex mutex_;
-    // We use this to notify the thread when we put a task into the pending_functors_ queue
-    std::shared_ptr<PipeEventWatcher> watcher_;
+    // We use this to notify the thread when we put a task into the pending_functors_ queue.
+    // It is an EventFdWatcher on Linux, or a PipeEventWatcher if eventfd is not available.
+    std::shared_ptr<NotifyEventWatcher> watcher_;
     // When we put a task into the pending_functors_ queue,
     // we need to notify the thread to execute it. But we don't want to notify repeatedly.
     std::atomic<bool> notified_;
 #ifdef H_HAVE_BOOST
-    boost::lockfree::queue<Functor*>* pending_functors_;
+    boost::lockfree::queue<Task*>* pending_functors_;
 #elif defined(H_HAVE_CAMERON314_CONCURRENTQUEUE)
-    moodycamel::ConcurrentQueue<Functor>* pending_functors_;
+    moodycamel::ConcurrentQueue<Task>* pending_functors_;
 #else
-    std::vector<Functor>* pending_functors_; // @Guarded By mutex_
+    std::vector<Task>* pending_functors_; // @Guarded By mutex_
+
+    // The tasks taken from pending_functors_ and not run yet because of the budget.
+    // Only accessed in the IO Event thread.
+    std::vector<Task> running_functors_;
+    size_t running_functor_index_ = 0;
 #endif
 
     std::atomic<int> pending_functor_count_;
+    size_t max_tasks_per_iteration_ = 0;
+    std::atomic<size_t> pending_queue_capacity_ = { 0 };
+    PendingTaskStats pending_task_stats_;
+
+    std::unique_ptr<char[]> read_scratch_;
+    std::unique_ptr<BufferPool> buffer_pool_;
+    std::shared_ptr<MemoryPool> tcp_conn_pool_;
+    std::shared_ptr<MemoryPool> fd_channel_pool_;
+
+    // The time cached by Now() in the current iteration
+    std::chrono::steady_clock::time_point now_;
+    bool now_cached_ = false;
+    bool cache_now_ = false; // Whether the loop is run by Run()
+
+    // The busy polling. io_event_count_ is the count of the IO events of the
+    // FdChannels, so the loop knows whether it has done something in a poll.
+    friend class FdChannel;
+    std::atomic<int64_t> busy_poll_ns_ = { 0 };
+    uint64_t io_event_count_ = 0;
+
+    // It is updated by TCPConn, TCPServer and http::Server
+    friend class TCPConn;
+    friend class TCPServer;
+    friend class http::Server;
+    std::atomic<int> connection_count_ = { 0 };
+
+    std::atomic<InvokeTimer::Backend> timer_backend_ = { InvokeTimer::kLibevent };
+    std::unique_ptr<TimingWheel> timing_wheel_;
 };
 }
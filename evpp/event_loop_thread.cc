@@ -3,6 +3,11 @@
 #include "evpp/event_loop.h"
 #include "evpp/event_loop_thread.h"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace evpp {
 
 EventLoopThread::EventLoopThread()
@@ -39,6 +44,7 @@ void EventLoopThread::Run(const Functor& pre, const Functor& post) {
         name_ = os.str();
     }
 
+    InitSystemThread();
 
     DLOG_TRACE << "loop=" << event_loop_ << " execute pre functor.";
     auto fn = [this, pre]() {
@@ -63,6 +69,25 @@ void EventLoopThread::Run(const Functor& pre, const Functor& post) {
     status_ = kStopped;
 }
 
+void EventLoopThread::InitSystemThread() {
+    SetCurrentThreadName(name_);
+
+#ifdef __linux__
+    if (!cpu_affinity_.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpu_affinity_) {
+            assert(cpu >= 0 && cpu < CPU_SETSIZE);
+            CPU_SET(cpu, &set);
+        }
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            LOG_ERROR << "pthread_setaffinity_np failed, name=" << name_ << " errno=" << rc << " " << strerror(rc);
+        }
+    }
+#endif
+}
+
 void EventLoopThread::Stop(bool wait_thread_exit) {
     DLOG_TRACE << "loop=" << event_loop_ << " wait_thread_exit=" << wait_thread_exit;
     assert(status_ == kRunning && IsRunning());
@@ -103,6 +128,11 @@ const std::string& EventLoopThread::name() const {
     return name_;
 }
 
+void EventLoopThread::set_cpu_affinity(const std::vector<int>& cpus) {
+    assert(status_ == kNull || status_ == kStopped);
+    cpu_affinity_ = cpus;
+}
+
 
 EventLoop* EventLoopThread::loop() const {
     return event_loop_.get();
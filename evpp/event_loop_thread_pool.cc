@@ -41,15 +41,33 @@ bool EventLoopThreadPool::Start(bool wait_thread_started) {
         };
 
         EventLoopThreadPtr t(new EventLoopThread());
+
+        // The name and the CPUs are taken when the thread starts
+        std::stringstream ss;
+        if (name_prefix_.empty()) {
+            ss << "EventLoopThreadPool-thread-" << i << "th";
+        } else {
+            ss << name_prefix_ << i;
+        }
+        t->set_name(ss.str());
+        if (!cpu_sets_.empty()) {
+            const std::vector<int>& cpus = cpu_sets_[i % cpu_sets_.size()];
+            t->set_cpu_affinity(cpus);
+            for (int cpu : cpus) {
+                if (cpu >= static_cast<int>(cpu_loops_.size())) {
+                    cpu_loops_.resize(cpu + 1, nullptr);
+                }
+                if (!cpu_loops_[cpu]) {
+                    cpu_loops_[cpu] = t->loop();
+                }
+            }
+        }
+
         if (!t->Start(wait_thread_started, prefn, postfn)) {
             //FIXME error process
             LOG_ERROR << "start thread failed!";
             return false;
         }
-
-        std::stringstream ss;
-        ss << "EventLoopThreadPool-thread-" << i << "th";
-        t->set_name(ss.str());
         threads_.push_back(t);
     }
 
@@ -160,6 +178,69 @@ EventLoop* EventLoopThreadPool::GetNextLoopWithHash(uint64_t hash) {
     return loop;
 }
 
+EventLoop* EventLoopThreadPool::GetLoopForCPU(int cpu) {
+    if (IsRunning() && cpu >= 0 && cpu < static_cast<int>(cpu_loops_.size()) && cpu_loops_[cpu]) {
+        return cpu_loops_[cpu];
+    }
+
+    return GetNextLoop();
+}
+
+template<typename LoadFunc>
+EventLoop* EventLoopThreadPool::GetLeastLoadedLoop(LoadFunc load) {
+    if (!IsRunning() || threads_.empty()) {
+        return base_loop_;
+    }
+
+    // The loads change all the time, so they are read without any lock
+    size_t start = static_cast<size_t>(next_.fetch_add(1)) % threads_.size();
+    EventLoop* loop = threads_[start]->loop();
+    int least = load(loop);
+    for (size_t i = 1; i < threads_.size() && least > 0; ++i) {
+        EventLoop* l = threads_[(start + i) % threads_.size()]->loop();
+        int n = load(l);
+        if (n < least) {
+            least = n;
+            loop = l;
+        }
+    }
+
+    return loop;
+}
+
+EventLoop* EventLoopThreadPool::GetLeastConnectionsLoop() {
+    return GetLeastLoadedLoop([](EventLoop* l) {
+        return l->connection_count();
+    });
+}
+
+EventLoop* EventLoopThreadPool::GetLeastPendingTasksLoop() {
+    return GetLeastLoadedLoop([](EventLoop* l) {
+        return l->pending_functor_count();
+    });
+}
+
+int EventLoopThreadPool::GetCPU(uint32_t index) const {
+    if (cpu_sets_.empty() || cpu_sets_[index % cpu_sets_.size()].empty()) {
+        return -1;
+    }
+
+    return cpu_sets_[index % cpu_sets_.size()][0];
+}
+
+void EventLoopThreadPool::SetCPUAffinity(const std::vector<int>& cpus) {
+    std::vector<std::vector<int>> sets;
+    for (int cpu : cpus) {
+        sets.push_back(std::vector<int>(1, cpu));
+    }
+    SetCPUAffinity(sets);
+}
+
+void EventLoopThreadPool::SetCPUAffinity(const std::vector<std::vector<int>>& cpu_sets) {
+    assert(status_ == kNull);
+    cpu_sets_ = cpu_sets;
+}
+
 uint32_t EventLoopThreadPool::thread_num() const {
     return thread_num_;
 }
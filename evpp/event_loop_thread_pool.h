@@ -25,10 +25,38 @@ public:
 
     // @brief Reinitialize some data fields after a fork
     void AfterFork();
+
+    // @brief Pin the i-th thread to cpus[i % cpus.size()].
+    //  See EventLoopThread::set_cpu_affinity. It must be called before Start().
+    void SetCPUAffinity(const std::vector<int>& cpus);
+
+    // @brief Pin the i-th thread to the CPU set cpu_sets[i % cpu_sets.size()],
+    //  e.g. to all the cores of a NUMA node. It must be called before Start().
+    void SetCPUAffinity(const std::vector<std::vector<int>>& cpu_sets);
+
+    // @brief Name the i-th thread prefix + i, e.g. "evpp-io-0". It must be called before Start().
+    void SetThreadNamePrefix(const std::string& prefix) {
+        name_prefix_ = prefix;
+    }
 public:
     EventLoop* GetNextLoop();
     EventLoop* GetNextLoopWithHash(uint64_t hash);
 
+    // @brief Return the loop whose thread is pinned to cpu. If there is not
+    //  such a loop, it works as GetNextLoop().
+    //  Use it with the CPU which received a connection, see sock::GetIncomingCPU.
+    EventLoop* GetLoopForCPU(int cpu);
+
+    // @brief Return the loop serving the least connections, see EventLoop::connection_count().
+    //  The loops are compared from the next one of GetNextLoop(), so the ties are spread.
+    EventLoop* GetLeastConnectionsLoop();
+
+    // @brief Return the loop with the least pending tasks, see EventLoop::pending_functor_count().
+    EventLoop* GetLeastPendingTasksLoop();
+
+    // @brief Return the first CPU the i-th thread is pinned to, or -1 if it is not pinned.
+    int GetCPU(uint32_t index) const;
+
     uint32_t thread_num() const;
 
 private:
@@ -36,6 +64,10 @@ private:
     void OnThreadStarted(uint32_t count);
     void OnThreadExited(uint32_t count);
 
+    // Return the loop of the least load(loop)
+    template<typename LoadFunc>
+    EventLoop* GetLeastLoadedLoop(LoadFunc load);
+
 private:
     EventLoop* base_loop_;
 
@@ -44,6 +76,10 @@ private:
 
     DoneCallback stopped_cb_;
 
+    std::string name_prefix_;
+    std::vector<std::vector<int>> cpu_sets_;
+    std::vector<EventLoop*> cpu_loops_; // The loop of every CPU, it is built in Start()
+
     typedef std::shared_ptr<EventLoopThread> EventLoopThreadPtr;
     std::vector<EventLoopThreadPtr> threads_;
 };
@@ -2,6 +2,10 @@
 
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #include "evpp/libevent.h"
 #include "evpp/event_watcher.h"
 #include "evpp/event_loop.h"
@@ -102,15 +106,33 @@ void EventWatcher::SetCancelCallback(const Handler& cb) {
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+NotifyEventWatcher::NotifyEventWatcher(struct event_base* evbase,
+                                       const Handler& handler)
+    : EventWatcher(evbase, handler) {}
+
+NotifyEventWatcher::NotifyEventWatcher(struct event_base* evbase,
+                                       Handler&& h)
+    : EventWatcher(evbase, std::move(h)) {}
+
+bool NotifyEventWatcher::AsyncWait() {
+    return Watch(Duration());
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
 PipeEventWatcher::PipeEventWatcher(EventLoop* loop,
                                    const Handler& handler)
-    : EventWatcher(loop->event_base(), handler) {
+    : NotifyEventWatcher(loop->event_base(), handler) {
     memset(pipe_, 0, sizeof(pipe_[0]) * 2);
 }
 
 PipeEventWatcher::PipeEventWatcher(EventLoop* loop,
                                    Handler&& h)
-    : EventWatcher(loop->event_base(), std::move(h)) {
+    : NotifyEventWatcher(loop->event_base(), std::move(h)) {
     memset(pipe_, 0, sizeof(pipe_[0]) * 2);
 }
 
@@ -168,10 +190,6 @@ void PipeEventWatcher::HandlerFn(evpp_socket_t fd, short /*which*/, void* v) {
     }
 }
 
-bool PipeEventWatcher::AsyncWait() {
-    return Watch(Duration());
-}
-
 void PipeEventWatcher::Notify() {
     char buf[1] = {};
 
@@ -180,6 +198,67 @@ void PipeEventWatcher::Notify() {
     }
 }
 
+#ifdef __linux__
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+EventFdWatcher::EventFdWatcher(EventLoop* loop,
+                               const Handler& handler)
+    : NotifyEventWatcher(loop->event_base(), handler), fd_(-1) {}
+
+EventFdWatcher::EventFdWatcher(EventLoop* loop,
+                               Handler&& h)
+    : NotifyEventWatcher(loop->event_base(), std::move(h)), fd_(-1) {}
+
+EventFdWatcher::~EventFdWatcher() {
+    Close();
+}
+
+bool EventFdWatcher::DoInit() {
+    assert(fd_ < 0);
+
+    fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd_ < 0) {
+        int err = errno;
+        LOG_ERROR << "create eventfd ERROR errno=" << err << " " << strerror(err);
+        return false;
+    }
+
+    ::event_set(event_, fd_, EV_READ | EV_PERSIST,
+                &EventFdWatcher::HandlerFn, this);
+    return true;
+}
+
+void EventFdWatcher::DoClose() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void EventFdWatcher::HandlerFn(evpp_socket_t /*fd*/, short /*which*/, void* v) {
+    EventFdWatcher* e = (EventFdWatcher*)v;
+
+    // Reading the counter resets it to 0, so the notifications made before
+    // are all consumed by this handler call.
+    uint64_t count = 0;
+    if (::read(e->fd_, &count, sizeof(count)) == sizeof(count)) {
+        e->handler_();
+    }
+}
+
+void EventFdWatcher::Notify() {
+    uint64_t one = 1;
+
+    if (::write(fd_, &one, sizeof(one)) < 0) {
+        return;
+    }
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -223,6 +302,10 @@ bool TimerEventWatcher::AsyncWait() {
     return Watch(timeout_);
 }
 
+bool TimerEventWatcher::AsyncWait(Duration timeout) {
+    return Watch(timeout);
+}
+
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -49,14 +49,28 @@ protected:
     Handler cancel_callback_;
 };
 
-class EVPP_EXPORT PipeEventWatcher : public EventWatcher {
+// NotifyEventWatcher is a watcher which can be notified from any thread to
+// call its handler in the event thread. An EventLoop is waked up by one of them
+// when a task is queued from another thread.
+// The notifications before the handler is called may be merged into one call.
+class EVPP_EXPORT NotifyEventWatcher : public EventWatcher {
+public:
+    bool AsyncWait();
+
+    // @note It is thread safe.
+    virtual void Notify() = 0;
+protected:
+    NotifyEventWatcher(struct event_base* evbase, const Handler& handler);
+    NotifyEventWatcher(struct event_base* evbase, Handler&& handler);
+};
+
+class EVPP_EXPORT PipeEventWatcher : public NotifyEventWatcher {
 public:
     PipeEventWatcher(EventLoop* loop, const Handler& handler);
     PipeEventWatcher(EventLoop* loop, Handler&& handler);
     ~PipeEventWatcher();
 
-    bool AsyncWait();
-    void Notify();
+    virtual void Notify();
     evpp_socket_t wfd() const { return pipe_[0]; }
 private:
     virtual bool DoInit();
@@ -66,6 +80,27 @@ private:
     evpp_socket_t pipe_[2]; // Write to pipe_[0] , Read from pipe_[1]
 };
 
+#ifdef __linux__
+// EventFdWatcher is a NotifyEventWatcher on an eventfd(2). It needs only one
+// file descriptor instead of the two of a socketpair, and all the pending
+// notifications are consumed by one 8 bytes read.
+class EVPP_EXPORT EventFdWatcher : public NotifyEventWatcher {
+public:
+    EventFdWatcher(EventLoop* loop, const Handler& handler);
+    EventFdWatcher(EventLoop* loop, Handler&& handler);
+    ~EventFdWatcher();
+
+    virtual void Notify();
+    int fd() const { return fd_; }
+private:
+    virtual bool DoInit();
+    virtual void DoClose();
+    static void HandlerFn(evpp_socket_t fd, short which, void* v);
+
+    int fd_;
+};
+#endif
+
 class EVPP_EXPORT TimerEventWatcher : public EventWatcher {
 public:
     TimerEventWatcher(EventLoop* loop, const Handler& handler, Duration timeout);
@@ -75,6 +110,9 @@ public:
 
     bool AsyncWait();
 
+    // Wait for another timeout instead of the one given to the constructor
+    bool AsyncWait(Duration timeout);
+
 private:
     virtual bool DoInit();
     static void HandlerFn(evpp_socket_t fd, short which, void* v);
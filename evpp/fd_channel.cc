@@ -155,6 +155,7 @@ void FdChannel::HandleEvent(evpp_socket_t sockfd, short which, void* v) {
 void FdChannel::HandleEvent(evpp_socket_t sockfd, short which) {
     assert(sockfd == fd_);
     DLOG_TRACE << "fd=" << sockfd << " " << EventsToString();
+    ++loop_->io_event_count_;
 
     if ((which & kReadable) && read_fn_) {
         read_fn_();
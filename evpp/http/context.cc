@@ -1,32 +1,104 @@
 #include "context.h"
 #include "service.h"
+#include "request_parser.h"
 #include "evpp/libevent.h"
 #include "evpp/memmem.h"
+#include "evpp/tcp_conn.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace evpp {
 namespace http {
+namespace {
+const char* MethodName(enum evhttp_cmd_type type) {
+    switch (type) {
+    case EVHTTP_REQ_GET: return "GET";
+    case EVHTTP_REQ_POST: return "POST";
+    case EVHTTP_REQ_HEAD: return "HEAD";
+    case EVHTTP_REQ_PUT: return "PUT";
+    case EVHTTP_REQ_DELETE: return "DELETE";
+    case EVHTTP_REQ_OPTIONS: return "OPTIONS";
+    case EVHTTP_REQ_TRACE: return "TRACE";
+    case EVHTTP_REQ_CONNECT: return "CONNECT";
+    case EVHTTP_REQ_PATCH: return "PATCH";
+    default: return "";
+    }
+}
+}
+
+Slice RouteParams::Find(const Slice& name) const {
+    for (size_t i = 0; i < size(); ++i) {
+        if (name == (*names)[i]) {
+            return values[i];
+        }
+    }
+    return Slice();
+}
+
 Context::Context(struct evhttp_request* r)
     : req_(r) {
 }
 
+Context::Context(const TCPConnPtr& conn, const RequestParser& parser)
+    : req_(nullptr), conn_(conn) {
+    const std::vector<RequestParser::Header>& headers = parser.headers();
+    size_t size = parser.method().size() + 1 + parser.uri().size() + 1 + parser.body().size() + 1;
+    for (auto& h : headers) {
+        size += h.name.size() + 1 + h.value.size() + 1;
+    }
+
+    auto append = [this](const Slice& s) {
+        request_data_.append(s.data(), s.size());
+        request_data_.push_back('\0');
+    };
+    request_data_.reserve(size);
+    append(parser.method());
+    append(parser.uri());
+    for (auto& h : headers) {
+        append(h.name);
+        append(h.value);
+    }
+    append(parser.body());
+
+    // Take the fields in the same order
+    const char* p = request_data_.data();
+    method_ = Slice(p, parser.method().size());
+    p += parser.method().size() + 1;
+    original_uri_ = p;
+    p += parser.uri().size() + 1;
+    request_headers_.resize(headers.size());
+    for (size_t i = 0; i < headers.size(); ++i) {
+        request_headers_[i].first = p;
+        p += headers[i].name.size() + 1;
+        request_headers_[i].second = p;
+        p += headers[i].value.size() + 1;
+    }
+    body_ = Slice(p, parser.body().size());
+
+    const char* q = static_cast<const char*>(memchr(original_uri_, '?', parser.uri().size()));
+    uri_ = q ? std::string(original_uri_, q) : std::string(original_uri_, parser.uri().size());
+    headers_indexed_ = true;
+}
+
 Context::~Context() {
 }
 
 bool Context::Init() {
-    if (req_->type == EVHTTP_REQ_POST) {
-#if LIBEVENT_VERSION_NUMBER >= 0x02001500
-        struct evbuffer* evbuf = evhttp_request_get_input_buffer(req_);
-        size_t buffer_size = evbuffer_get_length(evbuf);
-        if (buffer_size > 0) {
-            this->body_ = Slice((char*)evbuffer_pullup(evbuf, -1), buffer_size);
-        }
-#else
-        if (req_->input_buffer->off > 0) {
-            this->body_ = Slice((char*)req_->input_buffer->buffer, req_->input_buffer->off);
-        }
-#endif
+    if (!req_) {
+        // It is initialized by the constructor
+        return true;
     }
 
+    InitRequestLine();
+    InitBody();
+    return true;
+}
+
+void Context::InitRequestLine() {
+    method_ = MethodName(req_->type);
+
 #if LIBEVENT_VERSION_NUMBER >= 0x02001500
     uri_ = evhttp_uri_get_path(req_->uri_elems);
 #else
@@ -38,25 +110,227 @@ bool Context::Init() {
     }
 
 #endif
-    const char* original_url = original_uri();
-    remote_ip_ = FindClientIPFromURI(original_url, strlen(original_url));
-    if (remote_ip_.empty()) {
-        remote_ip_ = req_->remote_host;
+}
+
+void Context::InitBody() {
+    if (req_->type == EVHTTP_REQ_POST) {
+#if LIBEVENT_VERSION_NUMBER >= 0x02001500
+        struct evbuffer* evbuf = evhttp_request_get_input_buffer(req_);
+        size_t buffer_size = evbuffer_get_length(evbuf);
+        if (buffer_size > 0) {
+            this->body_ = Slice((char*)evbuffer_pullup(evbuf, -1), buffer_size);
+        }
+#else
+        if (req_->input_buffer->off > 0) {
+            this->body_ = Slice((char*)req_->input_buffer->buffer, req_->input_buffer->off);
+        }
+#endif
     }
+}
 
-    return true;
+const std::string& Context::remote_ip() const {
+    if (!remote_ip_parsed_) {
+        remote_ip_parsed_ = true;
+        remote_ip_ = FindQuery(Slice("clientip", 8)).ToString();
+        if (!remote_ip_.empty()) {
+            // The request is forwarded by the reverse proxy
+        } else if (req_) {
+            remote_ip_ = req_->remote_host ? req_->remote_host : "";
+        } else {
+            const std::string& addr = conn_->remote_addr();
+            remote_ip_ = addr.substr(0, addr.rfind(':'));
+        }
+    }
+    return remote_ip_;
 }
 
 const char* Context::original_uri() const {
-    return req_->uri;
+    return req_ ? req_->uri : original_uri_;
 }
 
 void Context::AddResponseHeader(const std::string& key, const std::string& value) {
+    if (!req_) {
+        response_headers_.push_back(std::make_pair(key, value));
+        return;
+    }
+
     evhttp_add_header(req_->output_headers, key.data(), value.data());
 }
 
 const char* Context::FindRequestHeader(const char* key) {
-    return evhttp_find_header(req_->input_headers, key);
+    if (req_ && !headers_indexed_) {
+        // A single lookup is cheaper than indexing all the headers
+        return evhttp_find_header(req_->input_headers, key);
+    }
+
+    return LookupHeader(Slice(key));
+}
+
+void Context::IndexHeaders() {
+    headers_indexed_ = true;
+    if (!req_) {
+        return;
+    }
+
+    // TAILQ_FOREACH is not defined on all the platforms
+    for (struct evkeyval* header = req_->input_headers->tqh_first; header; header = header->next.tqe_next) {
+        request_headers_.push_back(std::make_pair(header->key, header->value));
+    }
+}
+
+Slice Context::FindHeader(const Slice& key) {
+    const char* value = LookupHeader(key);
+    return value ? Slice(value) : Slice();
+}
+
+const char* Context::LookupHeader(const Slice& key) {
+    if (!headers_indexed_) {
+        IndexHeaders();
+    }
+
+    // The field names are case-insensitive
+    for (auto& h : request_headers_) {
+        const char* a = h.first;
+        size_t i = 0;
+        for (; i < key.size() && a[i]; ++i) {
+            if (::tolower(static_cast<unsigned char>(a[i])) != ::tolower(static_cast<unsigned char>(key[i]))) {
+                break;
+            }
+        }
+        if (i == key.size() && a[i] == '\0') {
+            return h.second;
+        }
+    }
+    return nullptr;
+}
+
+void Context::ParseQuery() const {
+    query_parsed_ = true;
+    const char* u = original_uri();
+    const char* end = u + strlen(u);
+    const char* q = static_cast<const char*>(memchr(u, '?', end - u));
+    if (!q) {
+        return;
+    }
+
+    // Most of the requests have less than 16 parameters
+    query_params_.reserve(16);
+
+    // Called with the position of every '&' and '=', and the end
+    const char* key = q + 1;
+    const char* eq = nullptr;
+    auto on_separator = [this, end, &key, &eq](const char* p) {
+        if (p == end || *p == '&') {
+            if (p > key) {
+                QueryParam param;
+                if (eq) {
+                    param.key = Slice(key, eq - key);
+                    param.value = Slice(eq + 1, p - eq - 1);
+                } else {
+                    param.key = Slice(key, p - key);
+                }
+                param.is_decoded = false;
+                query_params_.push_back(param);
+            }
+            key = p + 1;
+            eq = nullptr;
+        } else if (!eq) {
+            eq = p;
+        }
+    };
+
+    const char* p = q + 1;
+#if defined(__SSE2__)
+    // Find the separators in 16 bytes at a time
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i equal = _mm_set1_epi8('=');
+    for (; p + 16 <= end; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, equal))));
+        while (mask) {
+            on_separator(p + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '&' || *p == '=') {
+            on_separator(p);
+        }
+    }
+    on_separator(end);
+}
+
+Slice Context::FindQuery(const Slice& key) const {
+    if (!query_parsed_) {
+        ParseQuery();
+    }
+
+    for (auto& q : query_params_) {
+        if (q.key == key) {
+            return q.value;
+        }
+    }
+    return Slice();
+}
+
+namespace {
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+}
+
+Slice Context::FindDecodedQuery(const Slice& key) {
+    if (!query_parsed_) {
+        ParseQuery();
+    }
+
+    for (auto& q : query_params_) {
+        if (q.key != key) {
+            continue;
+        }
+
+        if (q.is_decoded) {
+            return q.decoded;
+        }
+
+        q.is_decoded = true;
+        const char* v = q.value.data();
+        size_t n = q.value.size();
+        if (!memchr(v, '%', n) && !memchr(v, '+', n)) {
+            q.decoded = q.value;
+            return q.decoded;
+        }
+
+        if (arena_.capacity() == 0) {
+            // A decoded value is not longer than the raw one,
+            // so all the values fit in the length of the URI
+            arena_.reserve(strlen(original_uri()));
+        }
+        size_t offset = arena_.size();
+        for (size_t i = 0; i < n; ++i) {
+            int hi, lo;
+            if (v[i] == '+') {
+                arena_.push_back(' ');
+            } else if (v[i] == '%' && i + 2 < n && (hi = HexValue(v[i + 1])) >= 0 && (lo = HexValue(v[i + 2])) >= 0) {
+                arena_.push_back(static_cast<char>(hi * 16 + lo));
+                i += 2;
+            } else {
+                arena_.push_back(v[i]);
+            }
+        }
+        q.decoded = Slice(arena_.data() + offset, arena_.size() - offset);
+        return q.decoded;
+    }
+    return Slice();
 }
 
 std::string Context::FindQueryFromURI(const char* uri, size_t uri_len, const char* key, size_t key_len) {
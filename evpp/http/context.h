@@ -3,8 +3,10 @@
 #include "evpp/inner_pre.h"
 #include "evpp/slice.h"
 #include "evpp/timestamp.h"
+#include "evpp/tcp_callbacks.h"
 
 #include <map>
+#include <vector>
 
 struct evhttp_request;
 
@@ -16,10 +18,39 @@ namespace evpp {
 namespace http {
 
 class Service;
+class NativeService;
+class RequestParser;
+
+// The parameters captured from the path of a request by Router,
+// e.g. the id of the route /users/:id. The values point into the path.
+struct EVPP_EXPORT RouteParams {
+    enum { kMaxParams = 8, };
+
+    // The names of the parameters of the matched route, owned by Router
+    const std::vector<std::string>* names = nullptr;
+    Slice values[kMaxParams];
+
+    size_t size() const {
+        return names ? names->size() : 0;
+    }
+
+    // @return the value of the parameter, or an empty Slice if there is no such parameter
+    Slice Find(const Slice& name) const;
+};
+
+// The callback of the body of a streamed request, see Server::RegisterStreamHandler.
+// It is invoked for every piece of the body as it comes, and last is true for
+// the last piece, which may be empty. The piece is valid only in the callback.
+typedef std::function<void(const Slice& data, bool last)> HTTPBodyCallback;
 
 struct EVPP_EXPORT Context {
 public:
     Context(struct evhttp_request* r);
+
+    // @brief Create the context of a request parsed by the native engine,
+    //  see NativeService. The request is copied out of the input buffer of
+    //  conn at once, with one allocation for the whole request.
+    Context(const TCPConnPtr& conn, const RequestParser& parser);
     ~Context();
 
     bool Init();
@@ -33,6 +64,11 @@ public:
     // could not be found.
     const char* FindRequestHeader(const char* key);
 
+    // @brief The same as FindRequestHeader, but returns a view of the value.
+    //  The headers are indexed on the first call, and the names are case-insensitive.
+    // @return the value of the header, or an empty Slice if it could not be found.
+    Slice FindHeader(const Slice& key);
+
     // The original URI, with original parameters, e.g. : /status.html?code=utf8
     const char* original_uri() const;
 
@@ -41,18 +77,50 @@ public:
         return uri_;
     }
 
-    const std::string& remote_ip() const {
-        return remote_ip_;
-    }
+    // It is parsed on the first call
+    const std::string& remote_ip() const;
 
+    // It is empty for a streamed request, see SetBodyCallback
     const Slice& body() const {
         return body_;
     }
 
+    // @brief Receive the body of a streamed request piece by piece, instead
+    //  of body(). It must be called by the stream handler before it returns,
+    //  otherwise the body is discarded. See Server::RegisterStreamHandler.
+    void SetBodyCallback(const HTTPBodyCallback& cb) {
+        body_callback_ = cb;
+    }
+
+    // The request method, e.g. GET
+    const Slice& method() const {
+        return method_;
+    }
+
+    // The parameters captured from the path, see Router
+    const RouteParams& params() const {
+        return params_;
+    }
+    RouteParams* mutable_params() {
+        return &params_;
+    }
+
+    // @return the value of the path parameter, e.g. FindParam("id") of the
+    //  route /users/:id, or an empty Slice if there is no such parameter
+    Slice FindParam(const Slice& name) const {
+        return params_.Find(name);
+    }
+
+    // It is nullptr if the request is served by the native engine
     struct evhttp_request* req() const {
         return req_;
     }
 
+    // The connection of the request served by the native engine, or nullptr
+    const TCPConnPtr& conn() const {
+        return conn_;
+    }
+
     void set_response_http_code(int code) {
         response_http_code_ = code;
     }
@@ -63,13 +131,23 @@ public:
 
     // Get the first value associated with the given key from the URI.
     std::string GetQuery(const char* query_key, size_t key_len) {
-        const char* u = original_uri();
-        return FindQueryFromURI(u, strlen(u), query_key, key_len);
+        return FindQuery(Slice(query_key, key_len)).ToString();
     }
     std::string GetQuery(const std::string& query_key) {
         return GetQuery(query_key.data(), query_key.size());
     }
 
+    // @brief Get the first value associated with the given key from the URI
+    //  without copying it. The query string is parsed only once on the first
+    //  call, so it is cheap to get many parameters of a request.
+    // @return the raw value, e.g. "a%20b", or an empty Slice if there is no such key.
+    Slice FindQuery(const Slice& key) const;
+
+    // @brief The same as FindQuery, but the value is percent-decoded, e.g. "a b".
+    //  '+' is decoded as ' '. The decoded value is kept in the arena of this
+    //  context, so it is valid as long as this context.
+    Slice FindDecodedQuery(const Slice& key);
+
 public:
     static std::string FindClientIPFromURI(const char* uri, size_t uri_len) {
         static const std::string __s_clientip = "clientip";
@@ -95,14 +173,54 @@ private:
     // If the HTTP request is forwarded by Nginx,
     // we will prefer to use the value of 'clientip' parameter in URL
     // @see The reverse proxy Nginx configuration : proxy_pass http://127.0.0.1:8080/get/?clientip=$remote_addr;
-    std::string remote_ip_;
+    mutable std::string remote_ip_;
 
     int response_http_code_ = 200;
 
     // The HTTP request body data
     Slice body_;
 
+    Slice method_;
+    RouteParams params_;
+
+    // The query parameters of the URI, parsed lazily, see FindQuery
+    struct QueryParam {
+        Slice key;
+        Slice value;
+        Slice decoded;
+        bool is_decoded;
+    };
+    void InitRequestLine();
+    void InitBody();
+    void ParseQuery() const;
+    void IndexHeaders();
+    const char* LookupHeader(const Slice& key);
+
+    // Parsed lazily by the const getters too, see remote_ip and FindQuery
+    mutable bool query_parsed_ = false;
+    bool headers_indexed_ = false;
+    mutable bool remote_ip_parsed_ = false;
+    mutable std::vector<QueryParam> query_params_;
+
+    // The decoded query values. The capacity is reserved for all the values
+    // at once, so the Slices into it are never invalidated.
+    std::string arena_;
+
     struct evhttp_request* req_;
+
+    // The body of a streamed request goes to it, see Service and NativeService
+    friend class Service;
+    HTTPBodyCallback body_callback_;
+
+    // The request served by the native engine.
+    // The fields are the NUL terminated strings in request_data_.
+    // request_headers_ is also the index of the headers of evhttp, see FindHeader.
+    friend class NativeService;
+    TCPConnPtr conn_;
+    std::string request_data_;
+    const char* original_uri_ = nullptr;
+    std::vector<std::pair<const char*, const char*>> request_headers_;
+    std::vector<std::pair<std::string, std::string>> response_headers_;
 };
 
 typedef std::shared_ptr<Context> ContextPtr;
@@ -1,11 +1,14 @@
 #include "http_server.h"
-
+#include "native_service.h"
 
 #include "evpp/libevent.h"
 #include "evpp/event_watcher.h"
 #include "evpp/event_loop.h"
 #include "evpp/event_loop_thread.h"
 #include "evpp/event_loop_thread_pool.h"
+#include "evpp/work_stealing_pool.h"
+#include "evpp/tcp_conn.h"
+#include "evpp/sockets.h"
 #include "evpp/utility.h"
 
 #include <future>
@@ -13,6 +16,29 @@
 namespace evpp {
 namespace http {
 
+namespace {
+// RequestCounter counts a request in EventLoop::connection_count() of the
+// loop processing it, until it is responded or its response callback is
+// destroyed without being called, e.g. the handler never responds.
+class RequestCounter {
+public:
+    explicit RequestCounter(std::atomic<int>* count) : count_(count) {
+        count_->fetch_add(1, std::memory_order_relaxed);
+    }
+    ~RequestCounter() {
+        Done();
+    }
+    void Done() {
+        if (!done_.exchange(true)) {
+            count_->fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+private:
+    std::atomic<int>* count_;
+    std::atomic<bool> done_ = { false };
+};
+}
+
 Server::Server(uint32_t thread_num) {
     DLOG_TRACE;
     tpool_.reset(new EventLoopThreadPool(nullptr, thread_num));
@@ -60,20 +86,33 @@ void Server::setPortSSLDefaultOption(
 
 bool Server::Init(int listen_port) {
     status_.store(kInitializing);
+#ifdef SO_REUSEPORT
+    if (multi_acceptor_ && tpool_->thread_num() > 0) {
+        // The services are created in Start() when the working threads are running
+        worker_ports_.push_back(listen_port);
+        status_.store(kInitialized);
+        return true;
+    }
+#endif
+    multi_acceptor_ = false;
+
     ListenThread lt;
     lt.thread = std::make_shared<EventLoopThread>();
     lt.thread->set_name(std::string("StandaloneHTTPServer-Main-") + std::to_string(listen_port));
 
-#if defined(EVPP_HTTP_SERVER_SUPPORTS_SSL)
-	PortSSLOption option = ssl_option_map_[0];
-	if(ssl_option_map_.find(listen_port) != ssl_option_map_.end()){
-		option = ssl_option_map_[listen_port];
-	}
-	lt.hservice = std::make_shared<Service>(lt.thread->loop(), option.enable_ssl_,
-				option.certificate_chain_file_.c_str(),option.private_key_file_.c_str());
-#else
-    lt.hservice = std::make_shared<Service>(lt.thread->loop());
-#endif
+    if (engine_ == kNative) {
+        lt.nservice = std::make_shared<NativeService>(lt.thread->loop());
+        if (!lt.nservice->Listen(listen_port)) {
+            LOG_ERROR << "this=" << this << " http server listen at port " << listen_port << " failed.";
+            lt.nservice->Stop();
+            return false;
+        }
+        listen_threads_.push_back(lt);
+        status_.store(kInitialized);
+        return true;
+    }
+
+    lt.hservice = NewService(lt.thread->loop(), listen_port);
     if (!lt.hservice->Listen(listen_port)) {
         int serrno = errno;
         LOG_ERROR << "this=" << this << " http server listen at port " << listen_port << " failed. errno=" << serrno << " " << strerror(serrno);
@@ -85,6 +124,19 @@ bool Server::Init(int listen_port) {
     return true;
 }
 
+std::shared_ptr<Service> Server::NewService(EventLoop* loop, int listen_port) {
+#if defined(EVPP_HTTP_SERVER_SUPPORTS_SSL)
+	PortSSLOption option = ssl_option_map_[0];
+	if(ssl_option_map_.find(listen_port) != ssl_option_map_.end()){
+		option = ssl_option_map_[listen_port];
+	}
+	return std::make_shared<Service>(loop, option.enable_ssl_,
+				option.certificate_chain_file_.c_str(),option.private_key_file_.c_str());
+#else
+    return std::make_shared<Service>(loop);
+#endif
+}
+
 bool Server::Init(const std::vector<int>& listen_ports) {
     status_.store(kInitializing);
     bool rc = true;
@@ -132,6 +184,11 @@ void Server::AfterFork() {
 
 bool Server::Start() {
     assert(status_.load() == kInitialized);
+    if (has_compute_handlers_ && !compute_pool_) {
+        LOG_ERROR << "this=" << this << " RegisterComputeHandler is called without SetComputePool.";
+        return false;
+    }
+
     status_.store(kStarting);
     bool rc = tpool_->Start(true);
     if (!rc) {
@@ -139,17 +196,33 @@ bool Server::Start() {
         return false;
     }
 
+    if (multi_acceptor_) {
+        rc = StartWorkerServices();
+        if (!rc) {
+            LOG_ERROR << "this=" << this << " start the services of the working threads failed.";
+            StopWorkerServices();
+            worker_services_.clear();
+            return false;
+        }
+    }
+
     for (auto& lt : listen_threads_) {
         auto& hservice = lt.hservice;
+        auto& nservice = lt.nservice;
         auto& lthread = lt.thread;
-        auto http_close_fn = [hservice, this]() {
-            hservice->Stop();
-            DLOG_TRACE << "http service at 0.0.0.0:" << hservice->port() << " has stopped.";
-            return EventLoopThread::kOK;
-        };
-        rc = lthread->Start(true,
-                            EventLoopThread::Functor(),
-                            http_close_fn);
+        if (nservice) {
+            // The native service is stopped in Server::Stop, since it closes its connections asynchronously
+            rc = lthread->Start(true);
+        } else {
+            auto http_close_fn = [hservice, this]() {
+                hservice->Stop();
+                DLOG_TRACE << "http service at 0.0.0.0:" << hservice->port() << " has stopped.";
+                return EventLoopThread::kOK;
+            };
+            rc = lthread->Start(true,
+                                EventLoopThread::Functor(),
+                                http_close_fn);
+        }
         if (!rc) {
             LOG_ERROR << "this=" << this << " start listening thread failed.";
             return false;
@@ -159,12 +232,38 @@ bool Server::Start() {
         assert(lthread->IsRunning());
         for (auto& c : callbacks_) {
             auto cb = std::bind(&Server::Dispatch, this, _1, _2, _3, c.second);
-            hservice->RegisterHandler(c.first, cb);
+            if (nservice) {
+                nservice->RegisterHandler(c.first, cb);
+            } else {
+                hservice->RegisterHandler(c.first, cb);
+            }
+        }
+
+        for (auto& r : routes_) {
+            auto cb = std::bind(&Server::Dispatch, this, _1, _2, _3, r.callback);
+            if (nservice) {
+                nservice->RegisterRoute(r.method, r.pattern, cb);
+            } else {
+                hservice->RegisterRoute(r.method, r.pattern, cb);
+            }
+        }
+
+        // The stream handlers run in the listening thread, where the body is read
+        for (auto& r : stream_routes_) {
+            if (nservice) {
+                nservice->RegisterStreamHandler(r.method, r.pattern, r.callback);
+            } else {
+                hservice->RegisterStreamHandler(r.method, r.pattern, r.callback);
+            }
         }
 
         if (default_callback_) {
             auto cb = std::bind(&Server::Dispatch, this, _1, _2, _3, default_callback_);
-            hservice->RegisterDefaultHandler(cb);
+            if (nservice) {
+                nservice->RegisterDefaultHandler(cb);
+            } else {
+                hservice->RegisterDefaultHandler(cb);
+            }
         }
     }
 
@@ -172,7 +271,7 @@ bool Server::Start() {
 
 
     auto is_running = [this]() {
-        if (listen_threads_.empty()) {
+        if (listen_threads_.empty() && worker_services_.empty()) {
             return false;
         }
 
@@ -206,11 +305,21 @@ void Server::Stop() {
     std::atomic<int> count(0);
 
     // Firstly we pause all the listening threads to accept new requests.
+    // The services of the working threads are stopped at once.
     substatus_.store(kStoppingListener);
+    StopWorkerServices();
+    if (listen_threads_.empty()) {
+        promise.set_value();
+    }
     for (auto& lt : listen_threads_) {
         std::shared_ptr<Service>& hs = lt.hservice;
-        auto fn = [&count, &promise, this, hs]() {
-            hs->Pause();
+        std::shared_ptr<NativeService>& ns = lt.nservice;
+        auto fn = [&count, &promise, this, hs, ns]() {
+            if (ns) {
+                ns->Pause();
+            } else {
+                hs->Pause();
+            }
             if (count.fetch_add(1) + 1 == static_cast<int>(listen_threads_.size())) {
                 promise.set_value();
             }
@@ -223,6 +332,21 @@ void Server::Stop() {
     substatus_.store(kStoppingThreadPool);
     tpool_->Stop(true);
 
+    // The native services close their connections in the listening threads
+    for (auto& lt : listen_threads_) {
+        if (!lt.nservice) {
+            continue;
+        }
+        std::promise<void> stopped;
+        std::shared_ptr<NativeService>& ns = lt.nservice;
+        lt.thread->loop()->RunInLoop([ns, &stopped]() {
+            ns->Stop([&stopped]() {
+                stopped.set_value();
+            });
+        });
+        stopped.get_future().wait();
+    }
+
     // Thirdly we stop the listening threads
     for (auto& lt : listen_threads_) {
         // Service::Stop will be called automatically when listen_thread_ is existing
@@ -242,16 +366,119 @@ void Server::Stop() {
     }
     listen_threads_.clear();
 
+    // The requests handled in the working threads refer to the routes of
+    // the services, so they are destroyed after the working threads exit
+    worker_services_.clear();
+
     DLOG_TRACE << "http server stopped";
 }
 
+bool Server::StartWorkerServices() {
+    assert(tpool_->IsRunning());
+    for (uint32_t i = 0; i < tpool_->thread_num(); ++i) {
+        EventLoop* loop = tpool_->GetNextLoopWithHash(i);
+        for (int port : worker_ports_) {
+            WorkerService ws;
+            ws.loop = loop;
+            if (engine_ == kNative) {
+                ws.nservice = std::make_shared<NativeService>(loop);
+            } else {
+                ws.hservice = NewService(loop, port);
+            }
+
+            // The handlers are invoked in loop directly, without Server::Dispatch
+            for (auto& c : callbacks_) {
+                if (ws.nservice) {
+                    ws.nservice->RegisterHandler(c.first, c.second);
+                } else {
+                    ws.hservice->RegisterHandler(c.first, c.second);
+                }
+            }
+            for (auto& r : routes_) {
+                if (ws.nservice) {
+                    ws.nservice->RegisterRoute(r.method, r.pattern, r.callback);
+                } else {
+                    ws.hservice->RegisterRoute(r.method, r.pattern, r.callback);
+                }
+            }
+            for (auto& r : stream_routes_) {
+                if (ws.nservice) {
+                    ws.nservice->RegisterStreamHandler(r.method, r.pattern, r.callback);
+                } else {
+                    ws.hservice->RegisterStreamHandler(r.method, r.pattern, r.callback);
+                }
+            }
+            if (default_callback_) {
+                if (ws.nservice) {
+                    ws.nservice->RegisterDefaultHandler(default_callback_);
+                } else {
+                    ws.hservice->RegisterDefaultHandler(default_callback_);
+                }
+            }
+
+            std::promise<bool> listened;
+            loop->RunInLoop([&ws, &listened, port]() {
+                if (ws.nservice) {
+                    listened.set_value(ws.nservice->Listen(port));
+                } else {
+                    listened.set_value(ws.hservice->Listen(port, true));
+                }
+            });
+            bool rc = listened.get_future().get();
+            worker_services_.push_back(ws);
+            if (!rc) {
+                LOG_ERROR << "this=" << this << " http server listen at port " << port << " in working thread " << i << " failed.";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Server::StopWorkerServices() {
+    for (auto& ws : worker_services_) {
+        std::promise<void> stopped;
+        std::shared_ptr<Service>& hs = ws.hservice;
+        std::shared_ptr<NativeService>& ns = ws.nservice;
+        ws.loop->RunInLoop([hs, ns, &stopped]() {
+            if (ns) {
+                ns->Stop([&stopped]() {
+                    stopped.set_value();
+                });
+            } else {
+                hs->Stop();
+                stopped.set_value();
+            }
+        });
+        stopped.get_future().wait();
+    }
+}
+
 void Server::Pause() {
     DLOG_TRACE << "http server pause";
+    for (auto& ws : worker_services_) {
+        std::shared_ptr<Service>& hs = ws.hservice;
+        std::shared_ptr<NativeService>& ns = ws.nservice;
+        auto f = [hs, ns]() {
+            if (ns) {
+                ns->Pause();
+            } else {
+                hs->Pause();
+            }
+        };
+        ws.loop->RunInLoop(f);
+    }
+
     for (auto& lt : listen_threads_) {
         EventLoop* loop = lt.thread->loop();
         std::shared_ptr<Service>& hs = lt.hservice;
-        auto f = [hs]() {
-            hs->Pause();
+        std::shared_ptr<NativeService>& ns = lt.nservice;
+        auto f = [hs, ns]() {
+            if (ns) {
+                ns->Pause();
+            } else {
+                hs->Pause();
+            }
         };
         loop->RunInLoop(f);
     }
@@ -259,11 +486,29 @@ void Server::Pause() {
 
 void Server::Continue() {
     DLOG_TRACE << "http server continue";
+    for (auto& ws : worker_services_) {
+        std::shared_ptr<Service>& hs = ws.hservice;
+        std::shared_ptr<NativeService>& ns = ws.nservice;
+        auto f = [hs, ns]() {
+            if (ns) {
+                ns->Continue();
+            } else {
+                hs->Continue();
+            }
+        };
+        ws.loop->RunInLoop(f);
+    }
+
     for (auto& lt : listen_threads_) {
         EventLoop* loop = lt.thread->loop();
         std::shared_ptr<Service>& hs = lt.hservice;
-        auto f = [hs]() {
-            hs->Continue();
+        std::shared_ptr<NativeService>& ns = lt.nservice;
+        auto f = [hs, ns]() {
+            if (ns) {
+                ns->Continue();
+            } else {
+                hs->Continue();
+            }
         };
         loop->RunInLoop(f);
     }
@@ -274,11 +519,64 @@ void Server::RegisterHandler(const std::string& uri, HTTPRequestCallback callbac
     callbacks_[uri] = callback;
 }
 
+bool Server::RegisterRoute(const std::string& method, const std::string& pattern, HTTPRequestCallback callback) {
+    assert(!IsRunning());
+
+    // Check the pattern now, instead of in every service
+    if (!Router().Add(method, pattern, callback)) {
+        return false;
+    }
+
+    Route r;
+    r.method = method;
+    r.pattern = pattern;
+    r.callback = callback;
+    routes_.push_back(r);
+    return true;
+}
+
+bool Server::RegisterStreamHandler(const std::string& method, const std::string& pattern, HTTPStreamCallback callback) {
+    assert(!IsRunning());
+    if (!Router().AddStream(method, pattern, callback)) {
+        return false;
+    }
+
+    StreamRoute r;
+    r.method = method;
+    r.pattern = pattern;
+    r.callback = callback;
+    stream_routes_.push_back(r);
+    return true;
+}
+
 void Server::RegisterDefaultHandler(HTTPRequestCallback callback) {
     assert(!IsRunning());
     default_callback_ = callback;
 }
 
+void Server::RegisterComputeHandler(const std::string& uri, HTTPRequestCallback callback) {
+    assert(!IsRunning());
+    has_compute_handlers_ = true;
+    callbacks_[uri] = std::bind(&Server::RunInComputePool, this,
+                                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, callback);
+}
+
+void Server::RunInComputePool(EventLoop* loop,
+                              const ContextPtr& ctx,
+                              const HTTPSendResponseCallback& response_callback,
+                              const HTTPRequestCallback& user_callback) {
+    assert(loop->IsInLoopThread());
+    assert(compute_pool_);
+
+    // The response goes back through loop, as if it is sent by a handler running in loop
+    HTTPSendResponseCallback cb = [loop, response_callback](const std::string& response_data) {
+        loop->RunInLoop(std::bind(response_callback, response_data));
+    };
+    compute_pool_->Submit([loop, ctx, cb, user_callback]() {
+        user_callback(loop, ctx, cb);
+    });
+}
+
 void Server::Dispatch(EventLoop* listening_loop,
                       const ContextPtr& ctx,
                       const HTTPSendResponseCallback& response_callback,
@@ -295,8 +593,16 @@ void Server::Dispatch(EventLoop* listening_loop,
     EventLoop* loop = nullptr;
     loop = GetNextLoop(listening_loop, ctx);
 
+    // The request is counted in the connections of loop until it is responded,
+    // see ThreadDispatchPolicy::kLeastConnections
+    std::shared_ptr<RequestCounter> counter = std::make_shared<RequestCounter>(&loop->connection_count_);
+    HTTPSendResponseCallback counted_response_callback = [counter, response_callback](const std::string& response_data) {
+        counter->Done();
+        response_callback(response_data);
+    };
+
     // Forward this HTTP request to a worker thread to process
-    auto f = [loop, ctx, response_callback, user_callback, this]() {
+    auto f = [loop, ctx, counted_response_callback, user_callback, this]() {
         DLOG_TRACE << "process request " << ctx->req()
             << " url=" << ctx->original_uri()
             << " in working thread. status=" << StatusToString();
@@ -314,7 +620,7 @@ void Server::Dispatch(EventLoop* listening_loop,
         // to send the result back to framework,
         // that actually comes back to Service::SendReply method.
         assert(loop->IsInLoopThread());
-        user_callback(loop, ctx, response_callback);
+        user_callback(loop, ctx, counted_response_callback);
     };
 
     loop->RunInLoop(f);
@@ -328,10 +634,30 @@ EventLoop* Server::GetNextLoop(EventLoop* default_loop, const ContextPtr& ctx) {
 
     if (IsRoundRobin()) {
         return tpool_->GetNextLoop();
+    } else if (policy_ == kLeastConnections) {
+        return tpool_->GetLeastConnectionsLoop();
+    } else if (policy_ == kLeastPendingTasks) {
+        return tpool_->GetLeastPendingTasksLoop();
+    }
+
+    if (ctx->conn()) {
+        // The request comes from NativeService
+        return GetNextLoop(ctx->conn());
     }
 
 #if LIBEVENT_VERSION_NUMBER >= 0x02010500
+    if (policy_ == kIncomingCPU) {
+        struct bufferevent* bev = evhttp_connection_get_bufferevent(ctx->req()->evcon);
+        evpp_socket_t fd = bev ? bufferevent_getfd(bev) : INVALID_SOCKET;
+        return tpool_->GetLoopForCPU(fd != INVALID_SOCKET ? sock::GetIncomingCPU(fd) : -1);
+    }
+
     const sockaddr*  sa = evhttp_connection_get_addr(ctx->req()->evcon);
+    if (policy_ == kCustom) {
+        EventLoop* loop = dispatcher_(tpool_.get(), sa ? sock::sockaddr_in_cast(sa) : nullptr);
+        return loop ? loop : tpool_->GetNextLoop();
+    }
+
     if (sa) {
         const sockaddr_in* r = sock::sockaddr_in_cast(sa);
         LOG_INFO << "http remote address " << sock::ToIPPort(r);
@@ -341,16 +667,57 @@ EventLoop* Server::GetNextLoop(EventLoop* default_loop, const ContextPtr& ctx) {
         return tpool_->GetNextLoopWithHash(hash);
     }
 #else
+    if (policy_ == kCustom) {
+        EventLoop* loop = dispatcher_(tpool_.get(), nullptr);
+        return loop ? loop : tpool_->GetNextLoop();
+    }
+
     uint64_t hash = std::hash<std::string>()(ctx->remote_ip());
     return tpool_->GetNextLoopWithHash(hash);
 #endif
 }
 
+EventLoop* Server::GetNextLoop(const TCPConnPtr& conn) {
+    if (policy_ == kIncomingCPU) {
+        return tpool_->GetLoopForCPU(sock::GetIncomingCPU(conn->fd()));
+    }
+
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    bool parsed = sock::ParseFromIPPort(conn->remote_addr().c_str(), ss);
+    const struct sockaddr_in* raddr = parsed ? sock::sockaddr_in_cast(&ss) : nullptr;
+    if (policy_ == kCustom) {
+        EventLoop* loop = dispatcher_(tpool_.get(), raddr);
+        return loop ? loop : tpool_->GetNextLoop();
+    }
+
+    if (raddr) {
+        return tpool_->GetNextLoopWithHash(raddr->sin_addr.s_addr);
+    }
+    return tpool_->GetNextLoopWithHash(std::hash<std::string>()(conn->remote_addr()));
+}
+
 Service* Server::service(int index) const {
     if (index < int(listen_threads_.size())) {
         return listen_threads_[index].hservice.get();
     }
 
+    if (index < int(worker_services_.size())) {
+        return worker_services_[index].hservice.get();
+    }
+
+    return nullptr;
+}
+
+NativeService* Server::native_service(int index) const {
+    if (index < int(listen_threads_.size())) {
+        return listen_threads_[index].nservice.get();
+    }
+
+    if (index < int(worker_services_.size())) {
+        return worker_services_[index].nservice.get();
+    }
+
     return nullptr;
 }
 }
@@ -12,9 +12,11 @@ class EventLoop;
 class EventLoopThreadPool;
 class PipeEventWatcher;
 class EventLoopThread;
+class WorkStealingPool;
 
 namespace http {
 class Service;
+class NativeService;
 
 // This is a standalone running HTTP server. It will start a new thread
 // for every listening port and we give this thread a name 'listening main thread'.
@@ -33,6 +35,11 @@ class Service;
 //      6. At last call Server::Stop() to stop the whole server
 class EVPP_EXPORT Server : public ThreadDispatchPolicy, public ServerStatus {
 public:
+    enum Engine {
+        kEvhttp = 0, // The requests are handled by libevent's evhttp, see Service
+        kNative = 1, // The requests are handled by NativeService built on TCPServer
+    };
+
     Server(uint32_t thread_num = 0);
 
     ~Server();
@@ -58,6 +65,30 @@ public:
 			const char* certificate_chain_file = "",
 			const char* private_key_file = "");
 #endif
+    // @brief Select the HTTP engine. The default one is kEvhttp.
+    //  It must be called before Init().
+    void SetEngine(Engine e) {
+        assert(status_.load() == kNull);
+        engine_ = e;
+    }
+
+    Engine engine() const {
+        return engine_;
+    }
+
+    // @brief Serve the requests in the working threads. Every working thread
+    //  owns a service (see SetEngine) listening at the ports with SO_REUSEPORT,
+    //  so a request is parsed, handled and replied in one thread, without the
+    //  round trips between the listening thread and the working thread.
+    //  No listening thread is started. The kernel spreads the connections
+    //  across the threads, so the ThreadDispatchPolicy is ignored.
+    //  It must be called before Init(). It takes effect only if thread_num > 0
+    //  and SO_REUSEPORT is supported, otherwise the server works as usual.
+    void SetMultiAcceptor(bool on) {
+        assert(status_.load() == kNull);
+        multi_acceptor_ = on;
+    }
+
     bool Init(int listen_port);
     bool Init(const std::vector<int>& listen_ports);
     bool Init(const std::string& listen_ports/*like "80,8080,443"*/);
@@ -79,6 +110,46 @@ public:
                          HTTPRequestCallback callback);
 
     void RegisterDefaultHandler(HTTPRequestCallback callback);
+
+    // @brief Register a handler of the path pattern, e.g. /users/:id/items/*rest.
+    //  The captured parameters are got by Context::FindParam. See Router.
+    //  A request is matched by the exact URIs of RegisterHandler and the
+    //  patterns together, and the static segments are preferred.
+    // @param method - The request method, e.g. GET. An empty one matches any method.
+    // @return false if the pattern is malformed
+    bool RegisterRoute(const std::string& method,
+                       const std::string& pattern,
+                       HTTPRequestCallback callback);
+
+    // @brief Register a handler streaming the request body and the response,
+    //  so the memory of a request is bounded whatever the size of the payload.
+    //  The handler is invoked as soon as the head of a request is received,
+    //  in the thread of the connection, i.e. the listening thread, or the
+    //  working thread if SetMultiAcceptor is on. It must not block. It calls
+    //  Context::SetBodyCallback to receive the body piece by piece, and
+    //  responds by the ResponseWriter in any thread.
+    //  The native engine reads the body as it comes, while evhttp passes it
+    //  after the whole body is read, see Service::RegisterStreamHandler.
+    //  The patterns are the same as RegisterRoute.
+    // @return false if the pattern is malformed
+    bool RegisterStreamHandler(const std::string& method,
+                               const std::string& pattern,
+                               HTTPStreamCallback callback);
+
+    // @brief Register a CPU-bound handler. It runs in the compute pool instead
+    //  of the worker loop, so a slow request does not block the other requests
+    //  of the loop. The EventLoop passed to the handler is the worker loop which
+    //  dispatched the request, and the response is sent back through it.
+    //  SetComputePool must be called before Start(), otherwise Start() fails.
+    void RegisterComputeHandler(const std::string& uri,
+                                HTTPRequestCallback callback);
+
+    // @brief Set the pool to run the handlers registered by RegisterComputeHandler.
+    //  The pool is started and stopped by the caller, so it can be shared by several servers.
+    void SetComputePool(const std::shared_ptr<WorkStealingPool>& pool) {
+        assert(!IsRunning());
+        compute_pool_ = pool;
+    }
 public:
 
     std::shared_ptr<EventLoopThreadPool> pool() const {
@@ -86,7 +157,12 @@ public:
     }
 
     // Get the service object hold by this http server.
+    // It is nullptr if the engine is kNative.
     Service* service(int index = 0) const;
+
+    // Get the native service object hold by this http server.
+    // It is nullptr if the engine is kEvhttp.
+    NativeService* native_service(int index = 0) const;
 private:
     void Dispatch(EventLoop* listening_loop,
                   const ContextPtr& ctx,
@@ -94,6 +170,22 @@ private:
                   const HTTPRequestCallback& user_callback);
 
     EventLoop* GetNextLoop(EventLoop* default_loop, const ContextPtr& ctx);
+
+    // The same as above for the requests of NativeService, which come from conn
+    EventLoop* GetNextLoop(const TCPConnPtr& conn);
+
+    // Create the evhttp service of the port in loop with its SSL options
+    std::shared_ptr<Service> NewService(EventLoop* loop, int port);
+
+    // The working threads serve the requests by themselves, see SetMultiAcceptor
+    bool StartWorkerServices();
+    void StopWorkerServices();
+
+    // Run user_callback in compute_pool_ for a request dispatched to loop
+    void RunInComputePool(EventLoop* loop,
+                          const ContextPtr& ctx,
+                          const HTTPSendResponseCallback& response_callback,
+                          const HTTPRequestCallback& user_callback);
 private:
     struct ListenThread {
         // The listening main thread
@@ -101,15 +193,49 @@ private:
 
         // Every listening main thread runs a HTTP Service to listen, receive, dispatch, send response the HTTP request.
         std::shared_ptr<Service> hservice;
+
+        // Or a native HTTP service if the engine is kNative
+        std::shared_ptr<NativeService> nservice;
     };
 
+    Engine engine_ = kEvhttp;
+
     std::vector<ListenThread> listen_threads_;
 
+    // The services owned by the working threads, see SetMultiAcceptor
+    struct WorkerService {
+        EventLoop* loop;
+        std::shared_ptr<Service> hservice;
+        std::shared_ptr<NativeService> nservice;
+    };
+
+    bool multi_acceptor_ = false;
+    std::vector<int> worker_ports_;
+    std::vector<WorkerService> worker_services_;
+
     // The worker thread pool used to process HTTP request
     std::shared_ptr<EventLoopThreadPool> tpool_;
 
+    // The pool to run the CPU-bound handlers
+    std::shared_ptr<WorkStealingPool> compute_pool_;
+    bool has_compute_handlers_ = false;
+
     HTTPRequestCallbackMap callbacks_;
     HTTPRequestCallback default_callback_;
+
+    struct Route {
+        std::string method;
+        std::string pattern;
+        HTTPRequestCallback callback;
+    };
+    std::vector<Route> routes_;
+
+    struct StreamRoute {
+        std::string method;
+        std::string pattern;
+        HTTPStreamCallback callback;
+    };
+    std::vector<StreamRoute> stream_routes_;
 #if defined(EVPP_HTTP_SERVER_SUPPORTS_SSL)
 		typedef struct {
 			bool enable_ssl_;
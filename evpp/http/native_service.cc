@@ -0,0 +1,658 @@
+#include "native_service.h"
+#include "request_parser.h"
+
+#include "evpp/event_loop.h"
+#include "evpp/tcp_server.h"
+#include "evpp/tcp_conn.h"
+#include "evpp/buffer.h"
+
+#include <deque>
+#include <time.h>
+
+namespace evpp {
+namespace http {
+
+namespace {
+// The same as the default timeout of evhttp
+const Duration kIdleTimeout(50.0);
+
+const char* ReasonPhrase(int code) {
+    switch (code) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "XX";
+    }
+}
+
+// Return the Date header of now. It is formatted only once a second in a thread.
+const char* DateHeader() {
+    static thread_local time_t last = 0;
+    static thread_local char header[64];
+    time_t now = time(nullptr);
+    if (now != last) {
+        struct tm t;
+#ifdef H_OS_WINDOWS
+        gmtime_s(&t, &now);
+#else
+        gmtime_r(&now, &t);
+#endif
+        strftime(header, sizeof(header), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &t);
+        last = now;
+    }
+    return header;
+}
+
+bool EqualsIgnoreCase(const std::string& s, const char* lower) {
+    size_t i = 0;
+    for (; i < s.size() && lower[i]; ++i) {
+        if (::tolower(static_cast<unsigned char>(s[i])) != lower[i]) {
+            return false;
+        }
+    }
+    return i == s.size() && lower[i] == '\0';
+}
+
+// The chunk size line of the chunked transfer coding
+void AppendChunkSize(std::string* r, size_t n) {
+    static const char kHex[] = "0123456789abcdef";
+    char buf[32];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = kHex[n & 0xf];
+        n >>= 4;
+    } while (n > 0);
+    r->append(p, buf + sizeof(buf) - p);
+    r->append("\r\n");
+}
+}
+
+struct NativeService::Session {
+    struct Reply {
+        bool ready = false;
+        bool close = false; // Close the connection after this reply
+        std::string data;
+
+        // The reply is streamed by it, and it is ready when the writer finishes
+        std::shared_ptr<StreamWriter> stream;
+    };
+
+    RequestParser parser;
+    Buffer* input = nullptr; // The input buffer of the connection
+
+    // The replies of the requests being handled in order.
+    // replies.front() is the reply of the request send_seq.
+    std::deque<Reply> replies;
+    uint64_t next_seq = 0;
+    uint64_t send_seq = 0;
+
+    bool parsing = false;
+    bool closing = false; // No more requests are parsed
+    bool close_after_write = false; // The last reply has been sent
+    bool continue_sent = false;
+    bool reading_paused = false;
+
+    // The streamed request whose body is being read, see ReadStreamBody
+    ContextPtr stream_ctx;
+};
+
+struct NativeService::ReplyInfo {
+    uint64_t seq;
+    int minor_version;
+    bool keep_alive;
+    bool head; // The body is not sent for a HEAD request
+};
+
+// The pieces are appended to the reply of the request, so they are sent after
+// the replies of the requests before it. An HTTP/1.0 client does not know the
+// chunked transfer coding, so the body is sent as it is and the connection is
+// closed at the end.
+class NativeService::StreamWriter : public ResponseWriter {
+public:
+    StreamWriter(NativeService* service, const ContextPtr& ctx, const ReplyInfo& info)
+        : ResponseWriter(ctx->conn()->loop(), ctx), service_(service), info_(info) {
+    }
+
+    uint64_t seq() const {
+        return info_.seq;
+    }
+
+    // These are called by NativeService in the loop
+    void Buffered(size_t n) {
+        OnBuffered(n);
+    }
+    void Closed() {
+        OnClosed();
+    }
+
+protected:
+    virtual void DoWriteHeaders(int code) {
+        std::string head;
+        NativeService::AppendHead(&head, context().get(), code, info_, nullptr);
+        service_->WriteStream(this, head, false);
+    }
+
+    virtual void DoWriteChunk(std::string& data) {
+        if (info_.head) {
+            return;
+        }
+        if (info_.minor_version == 0) {
+            service_->WriteStream(this, data, false);
+            return;
+        }
+
+        // One piece for the chunk, so it is sent with one write
+        std::string chunk;
+        chunk.reserve(data.size() + 24);
+        AppendChunkSize(&chunk, data.size());
+        chunk.append(data);
+        chunk.append("\r\n");
+        service_->WriteStream(this, chunk, false);
+    }
+
+    virtual void DoFinish() {
+        std::string last;
+        if (!info_.head && info_.minor_version != 0) {
+            last = "0\r\n\r\n";
+        }
+        service_->WriteStream(this, last, true);
+    }
+
+private:
+    NativeService* service_;
+    ReplyInfo info_;
+};
+
+NativeService::NativeService(EventLoop* l)
+    : listen_loop_(l)
+    , max_header_size_(RequestParser::kDefaultMaxHeaderSize)
+    , max_body_size_(RequestParser::kDefaultMaxBodySize)
+    , idle_timeout_(kIdleTimeout) {
+}
+
+NativeService::~NativeService() {
+    assert(!tcp_server_ || tcp_server_->IsStopped());
+}
+
+bool NativeService::Listen(int listen_port) {
+    port_ = listen_port;
+    tcp_server_.reset(new TCPServer(listen_loop_, "0.0.0.0:" + std::to_string(listen_port), "NativeHTTPService", 0));
+    // A connection waiting for the replies of its requests is busy
+    tcp_server_->SetIdleTimeout(idle_timeout_, [](const TCPConnPtr& conn) {
+        SessionPtr s = GetSession(conn);
+        return s && !s->replies.empty();
+    });
+    tcp_server_->SetConnectionCallback(std::bind(&NativeService::OnConnection, this, std::placeholders::_1));
+    tcp_server_->SetMessageCallback(std::bind(&NativeService::OnMessage, this, std::placeholders::_1, std::placeholders::_2));
+    return tcp_server_->Init() && tcp_server_->Start();
+}
+
+void NativeService::Stop(const DoneCallback& done) {
+    DLOG_TRACE << "http service is stopping";
+    assert(listen_loop_->IsInLoopThread());
+    // The routes are kept, see Service::Stop
+    default_callback_ = HTTPRequestCallback();
+    if (tcp_server_ && tcp_server_->IsRunning()) {
+        tcp_server_->Stop(done);
+    } else if (done) {
+        done();
+    }
+}
+
+void NativeService::Pause() {
+    DLOG_TRACE << "http service pause";
+    tcp_server_->Pause();
+}
+
+void NativeService::Continue() {
+    DLOG_TRACE << "http service continue";
+    tcp_server_->Continue();
+}
+
+void NativeService::RegisterHandler(const std::string& uri, HTTPRequestCallback callback) {
+    router_.AddExact(uri, callback);
+}
+
+bool NativeService::RegisterRoute(const std::string& method, const std::string& pattern, HTTPRequestCallback callback) {
+    return router_.Add(method, pattern, callback);
+}
+
+bool NativeService::RegisterStreamHandler(const std::string& method, const std::string& pattern, HTTPStreamCallback callback) {
+    return router_.AddStream(method, pattern, callback);
+}
+
+void NativeService::RegisterDefaultHandler(HTTPRequestCallback callback) {
+    default_callback_ = callback;
+}
+
+NativeService::SessionPtr NativeService::GetSession(const TCPConnPtr& conn) {
+    return conn->context().Get<SessionPtr>();
+}
+
+void NativeService::OnConnection(const TCPConnPtr& conn) {
+    if (conn->IsConnected()) {
+        SessionPtr s(new Session);
+        s->parser.set_max_header_size(max_header_size_);
+        s->parser.set_max_body_size(max_body_size_);
+        s->parser.set_stop_at_head(router_.has_stream_routes());
+        conn->set_context(Any(s));
+        conn->SetTCPNoDelay(true);
+        conn->SetWriteCompleteCallback(std::bind(&NativeService::OnWriteComplete, this, std::placeholders::_1));
+    } else {
+        SessionPtr s = GetSession(conn);
+        conn->set_context(Any());
+        if (!s) {
+            return;
+        }
+
+        // Release the handlers of the streamed requests, and tell the writers
+        if (s->stream_ctx) {
+            s->stream_ctx->body_callback_ = HTTPBodyCallback();
+            s->stream_ctx.reset();
+        }
+        for (auto& r : s->replies) {
+            if (r.stream) {
+                r.stream->Closed();
+            }
+        }
+    }
+}
+
+void NativeService::OnMessage(const TCPConnPtr& conn, Buffer* buf) {
+    SessionPtr s = GetSession(conn);
+    assert(s);
+    s->input = buf;
+    ParseRequests(conn, s);
+}
+
+void NativeService::OnWriteComplete(const TCPConnPtr& conn) {
+    SessionPtr s = GetSession(conn);
+    if (!s) {
+        return;
+    }
+
+    if (s->close_after_write && conn->output_buffered_length() == 0) {
+        conn->Close();
+        return;
+    }
+
+    // The backpressure of the streamed reply being sent
+    if (!s->replies.empty() && s->replies.front().stream) {
+        s->replies.front().stream->Buffered(conn->output_buffered_length());
+    }
+}
+
+void NativeService::ParseRequests(const TCPConnPtr& conn, const SessionPtr& s) {
+    // A handler may reply at once, which must not parse the requests again
+    if (s->parsing || !s->input) {
+        return;
+    }
+
+    s->parsing = true;
+    for (;;) {
+        // The body of a streamed request is read even if no more requests are parsed
+        if (s->stream_ctx) {
+            if (!ReadStreamBody(conn, s)) {
+                break;
+            }
+            continue;
+        }
+
+        if (s->closing || s->replies.size() >= kMaxPipelinedRequests) {
+            break;
+        }
+
+        RequestParser& parser = s->parser;
+        RequestParser::Result r = parser.Parse(s->input);
+        if (r == RequestParser::kNeedMore) {
+            // The interim response must not be mixed with the replies of the requests before
+            if (parser.head_complete() && parser.expect_continue() && !s->continue_sent && s->replies.empty()) {
+                s->continue_sent = true;
+                conn->Send("HTTP/1.1 100 Continue\r\n\r\n");
+            }
+            break;
+        }
+
+        if (r == RequestParser::kError) {
+            LOG_WARN << "bad request from " << conn->remote_addr() << " code=" << parser.error_code();
+            ReplyInfo info = { s->next_seq++, 1, false, false };
+            Session::Reply reply;
+            reply.ready = true;
+            reply.close = true;
+            reply.data = BuildResponse(nullptr, parser.error_code(), info, std::string());
+            s->replies.push_back(reply);
+            s->closing = true;
+            break;
+        }
+
+        if (r == RequestParser::kHeadComplete) {
+            // Otherwise the body is parsed as usual
+            HandleStreamRequest(conn, s);
+            continue;
+        }
+
+        ReplyInfo info = { s->next_seq++, parser.minor_version(), parser.keep_alive(), parser.method() == "HEAD" };
+        ContextPtr ctx(new Context(conn, parser));
+        s->input->Retrieve(parser.size());
+        parser.Reset();
+        s->continue_sent = false;
+        s->replies.push_back(Session::Reply());
+        if (!info.keep_alive) {
+            s->closing = true;
+        }
+        HandleRequest(ctx, info);
+    }
+    s->parsing = false;
+
+    // Stop reading when there are too many requests to reply, or no more requests are needed
+    bool pause = !s->stream_ctx && (s->closing || s->replies.size() >= kMaxPipelinedRequests);
+    if (pause != s->reading_paused) {
+        s->reading_paused = pause;
+        if (pause) {
+            conn->PauseReading();
+        } else {
+            conn->ResumeReading();
+        }
+    }
+
+    FlushReplies(conn, s);
+}
+
+void NativeService::HandleRequest(const ContextPtr& ctx, const ReplyInfo& info) {
+    // In the listening thread, as Service::HandleRequest
+    assert(listen_loop_->IsInLoopThread());
+    DLOG_TRACE << "handle request url=" << ctx->original_uri();
+
+    auto f = std::bind(&NativeService::SendReply, this, ctx, info, std::placeholders::_1);
+    if (!router_.empty()) {
+        const HTTPRequestCallback* cb = router_.Match(ctx->method(), ctx->uri(), ctx->mutable_params());
+        if (cb) {
+            (*cb)(listen_loop_, ctx, f);
+            return;
+        }
+    }
+
+    if (default_callback_) {
+        default_callback_(listen_loop_, ctx, f);
+    } else {
+        std::string response = BuildResponse(ctx.get(), 400, info, std::string());
+        OnReply(ctx->conn(), info.seq, !info.keep_alive, response);
+    }
+}
+
+bool NativeService::HandleStreamRequest(const TCPConnPtr& conn, const SessionPtr& s) {
+    RequestParser& parser = s->parser;
+
+    // The parameters are captured from the URI of the context, see below
+    const Slice& uri = parser.uri();
+    const char* q = static_cast<const char*>(memchr(uri.data(), '?', uri.size()));
+    Slice path(uri.data(), q ? q - uri.data() : uri.size());
+    if (!router_.MatchStream(parser.method(), path, nullptr)) {
+        return false;
+    }
+
+    ReplyInfo info = { s->next_seq++, parser.minor_version(), parser.keep_alive(), parser.method() == "HEAD" };
+    if (info.minor_version == 0) {
+        // The end of the body is told by closing the connection
+        info.keep_alive = false;
+    }
+
+    ContextPtr ctx(new Context(conn, parser));
+    const HTTPStreamCallback* cb = router_.MatchStream(ctx->method(), ctx->uri(), ctx->mutable_params());
+    assert(cb);
+    DLOG_TRACE << "handle streamed request url=" << ctx->original_uri();
+
+    // The interim response must not be mixed with the replies of the requests before
+    if (parser.expect_continue() && s->replies.empty()) {
+        s->continue_sent = true;
+        conn->Send("HTTP/1.1 100 Continue\r\n\r\n");
+    }
+
+    std::shared_ptr<StreamWriter> w = std::make_shared<StreamWriter>(this, ctx, info);
+    Session::Reply reply;
+    reply.close = !info.keep_alive;
+    reply.stream = w;
+    s->replies.push_back(reply);
+    if (!info.keep_alive) {
+        s->closing = true;
+    }
+    s->stream_ctx = ctx;
+    (*cb)(listen_loop_, ctx, w);
+    return true;
+}
+
+bool NativeService::ReadStreamBody(const TCPConnPtr& conn, const SessionPtr& s) {
+    RequestParser& parser = s->parser;
+    for (;;) {
+        if (!conn->IsConnected()) {
+            // It is closed by the handler
+            return false;
+        }
+
+        Slice piece;
+        RequestParser::Result r = parser.ReadBody(s->input, &piece);
+        if (r == RequestParser::kError) {
+            // The response may have been started, so the connection is closed without a response
+            LOG_WARN << "bad request body from " << conn->remote_addr() << " code=" << parser.error_code();
+            s->stream_ctx->body_callback_ = HTTPBodyCallback();
+            s->stream_ctx.reset();
+            s->closing = true;
+            conn->Close();
+            return false;
+        }
+
+        bool last = r == RequestParser::kComplete;
+        if (!piece.empty() || last) {
+            // Keep it, since the callback may be released by itself
+            ContextPtr ctx = s->stream_ctx;
+            if (ctx->body_callback_) {
+                ctx->body_callback_(piece, last);
+            }
+        }
+
+        if (last) {
+            s->input->Retrieve(parser.size());
+            parser.Reset();
+            s->continue_sent = false;
+            if (s->stream_ctx) {
+                s->stream_ctx->body_callback_ = HTTPBodyCallback();
+                s->stream_ctx.reset();
+            }
+            return true;
+        }
+
+        if (piece.empty()) {
+            return false;
+        }
+    }
+}
+
+void NativeService::WriteStream(StreamWriter* w, std::string& data, bool finish) {
+    const TCPConnPtr& conn = w->context()->conn();
+    assert(conn->loop()->IsInLoopThread());
+    SessionPtr s = GetSession(conn);
+    if (!s || !conn->IsConnected()) {
+        DLOG_TRACE << "The connection has been closed, drop the streamed reply of request " << w->seq();
+        return;
+    }
+
+    uint64_t seq = w->seq();
+    assert(seq >= s->send_seq && seq - s->send_seq < s->replies.size());
+    Session::Reply& reply = s->replies[static_cast<size_t>(seq - s->send_seq)];
+    if (reply.data.empty()) {
+        reply.data.swap(data);
+    } else {
+        reply.data.append(data);
+    }
+    reply.ready = finish;
+    FlushReplies(conn, s);
+
+    if (finish) {
+        // Go on with the pipelined requests which are not parsed because of the limit
+        if (s->reading_paused && !s->closing) {
+            ParseRequests(conn, s);
+        }
+        return;
+    }
+
+    // The reply is sent after the replies before it, so they hold it back too
+    w->Buffered(reply.data.size() + conn->output_buffered_length());
+}
+
+void NativeService::SendReply(const ContextPtr& ctx, const ReplyInfo& info, const std::string& response_data) {
+    // In the worker thread
+    DLOG_TRACE << "send reply in working thread";
+
+    // Build the response package in the worker thread.
+    // No body means 404 Not Found, as Service does.
+    int code = response_data.empty() ? 404 : ctx->response_http_code();
+    std::string r = BuildResponse(ctx.get(), code, info, response_data);
+
+    // The handler runs in the thread of the connection, see Server::SetMultiAcceptor
+    const TCPConnPtr& c = ctx->conn();
+    if (c->loop()->IsInLoopThread()) {
+        OnReply(c, info.seq, !info.keep_alive, r);
+        return;
+    }
+
+    std::shared_ptr<std::string> response = std::make_shared<std::string>(std::move(r));
+    TCPConnPtr conn = c;
+    uint64_t seq = info.seq;
+    bool close = !info.keep_alive;
+    conn->loop()->RunInLoop([this, conn, seq, close, response]() {
+        OnReply(conn, seq, close, *response);
+    });
+}
+
+void NativeService::OnReply(const TCPConnPtr& conn, uint64_t seq, bool close, std::string& response) {
+    assert(conn->loop()->IsInLoopThread());
+    SessionPtr s = GetSession(conn);
+    if (!s || !conn->IsConnected()) {
+        DLOG_TRACE << "The connection has been closed, drop the reply of request " << seq;
+        return;
+    }
+
+    assert(seq >= s->send_seq && seq - s->send_seq < s->replies.size());
+    Session::Reply& reply = s->replies[static_cast<size_t>(seq - s->send_seq)];
+    reply.ready = true;
+    reply.close = close;
+    reply.data.swap(response);
+    FlushReplies(conn, s);
+
+    // Go on with the pipelined requests which are not parsed because of the limit
+    if (s->reading_paused && !s->closing) {
+        ParseRequests(conn, s);
+    }
+}
+
+void NativeService::FlushReplies(const TCPConnPtr& conn, const SessionPtr& s) {
+    while (!s->replies.empty()) {
+        Session::Reply& reply = s->replies.front();
+        if (!reply.ready && !reply.stream) {
+            break;
+        }
+
+        // The pieces of a streamed reply are sent as they come
+        if (!reply.data.empty()) {
+            conn->Send(std::move(reply.data));
+            reply.data.clear();
+        }
+        if (!reply.ready) {
+            break;
+        }
+
+        bool close = reply.close;
+        s->replies.pop_front();
+        ++s->send_seq;
+        if (close) {
+            s->close_after_write = true;
+            break;
+        }
+    }
+
+    // Otherwise it is closed in OnWriteComplete
+    if (s->close_after_write && conn->output_buffered_length() == 0) {
+        conn->Close();
+    }
+}
+
+std::string NativeService::BuildResponse(const Context* ctx, int code, const ReplyInfo& info, const std::string& body) {
+    std::string r;
+    AppendHead(&r, ctx, code, info, &body);
+    if (!info.head) {
+        r.append(body);
+    }
+    return r;
+}
+
+void NativeService::AppendHead(std::string* r, const Context* ctx, int code, const ReplyInfo& info, const std::string* body) {
+    static const std::vector<std::pair<std::string, std::string>> empty;
+    const std::vector<std::pair<std::string, std::string>>& headers = ctx ? ctx->response_headers_ : empty;
+
+    size_t size = 160 + (body ? body->size() : 0);
+    for (auto& h : headers) {
+        size += h.first.size() + h.second.size() + 4;
+    }
+
+    r->reserve(size);
+    r->append(info.minor_version == 0 ? "HTTP/1.0 " : "HTTP/1.1 ");
+    r->append(std::to_string(code));
+    r->push_back(' ');
+    r->append(ReasonPhrase(code));
+    r->append("\r\n");
+
+    bool has_date = false;
+    bool has_content_type = false;
+    for (auto& h : headers) {
+        r->append(h.first);
+        r->append(": ");
+        r->append(h.second);
+        r->append("\r\n");
+        has_date = has_date || EqualsIgnoreCase(h.first, "date");
+        has_content_type = has_content_type || EqualsIgnoreCase(h.first, "content-type");
+    }
+
+    // The same default headers as evhttp
+    if (!has_date) {
+        r->append(DateHeader());
+    }
+    if (!has_content_type && (!body || !body->empty())) {
+        r->append("Content-Type: text/html; charset=ISO-8859-1\r\n");
+    }
+    if (body) {
+        r->append("Content-Length: ");
+        r->append(std::to_string(body->size()));
+        r->append("\r\n");
+    } else if (info.minor_version != 0) {
+        r->append("Transfer-Encoding: chunked\r\n");
+    }
+    if (!info.keep_alive) {
+        r->append("Connection: close\r\n");
+    } else if (info.minor_version == 0) {
+        r->append("Connection: keep-alive\r\n");
+    }
+    r->append("\r\n");
+}
+}
+}
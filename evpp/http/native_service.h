@@ -0,0 +1,127 @@
+#pragma once
+
+#include "evpp/inner_pre.h"
+#include "evpp/duration.h"
+#include "context.h"
+#include "router.h"
+
+namespace evpp {
+class EventLoop;
+class TCPServer;
+class Buffer;
+
+namespace http {
+
+// NativeService is an HTTP/1.1 server engine built on TCPServer, which works
+// as Service without libevent's evhttp. It runs in one EventLoop as Service.
+//
+// The requests are parsed by RequestParser from the input buffer of the
+// connection without copying the headers into the lists of evhttp, and the
+// response is built into one string which is moved into the output queue of
+// the connection.
+//
+// The connections are kept alive as HTTP/1.1 requires. The pipelined requests
+// of a connection are handled concurrently, and the responses are sent in
+// the order of the requests. A connection stops reading if it has
+// kMaxPipelinedRequests requests to respond.
+//
+// The body of a request registered by RegisterStreamHandler is not buffered.
+// The handler is invoked when the head is received, and the body is passed to
+// the callback of the Context piece by piece as it is read. The response is
+// sent with the chunked transfer coding by ResponseWriter.
+//
+// The connections idle for 50 seconds, as evhttp does by default, are closed,
+// unless they have requests being handled. See SetIdleTimeout.
+class EVPP_EXPORT NativeService {
+public:
+    typedef std::function<void()> DoneCallback;
+
+    enum { kMaxPipelinedRequests = 16, };
+
+    NativeService(EventLoop* loop);
+    ~NativeService();
+
+    // @brief Listen at the port. It is called before loop runs, as Service::Listen
+    bool Listen(int port);
+
+    // @brief Close all the connections and stop listening. It must be called
+    //  in the thread of loop, and done is invoked in the same thread when
+    //  the connections are closed.
+    void Stop(const DoneCallback& done = DoneCallback());
+    void Pause();
+    void Continue();
+
+    // @Note The URI must not hold any parameters
+    // @param uri - The URI of the request without any parameters
+    void RegisterHandler(const std::string& uri, HTTPRequestCallback callback);
+
+    void RegisterDefaultHandler(HTTPRequestCallback callback);
+
+    // @brief Register a handler of the path pattern, see Router and Service::RegisterRoute
+    bool RegisterRoute(const std::string& method, const std::string& pattern, HTTPRequestCallback callback);
+
+    // @brief Register a stream handler of the path pattern, see Server::RegisterStreamHandler.
+    //  It must be called before the connections come, as the other handlers.
+    bool RegisterStreamHandler(const std::string& method, const std::string& pattern, HTTPStreamCallback callback);
+
+    // @brief Set the limits of the requests, see RequestParser.
+    //  It must be called before Listen().
+    void SetMaxRequestSize(size_t max_header_size, size_t max_body_size) {
+        max_header_size_ = max_header_size;
+        max_body_size_ = max_body_size;
+    }
+
+    // @brief Set the timeout of the idle connections, see TCPServer::SetIdleTimeout.
+    //  A connection is never idle while it has requests to respond, however
+    //  slow the handlers are. It must be called before Listen().
+    void SetIdleTimeout(Duration timeout) {
+        idle_timeout_ = timeout;
+    }
+
+    EventLoop* loop() const {
+        return listen_loop_;
+    }
+
+    int port() const {
+        return port_;
+    }
+
+private:
+    struct Session;
+    struct ReplyInfo;
+    class StreamWriter;
+    typedef std::shared_ptr<Session> SessionPtr;
+
+    void OnConnection(const TCPConnPtr& conn);
+    void OnMessage(const TCPConnPtr& conn, Buffer* buf);
+    void OnWriteComplete(const TCPConnPtr& conn);
+    void ParseRequests(const TCPConnPtr& conn, const SessionPtr& s);
+    void HandleRequest(const ContextPtr& ctx, const ReplyInfo& info);
+    bool HandleStreamRequest(const TCPConnPtr& conn, const SessionPtr& s);
+    bool ReadStreamBody(const TCPConnPtr& conn, const SessionPtr& s);
+    void WriteStream(StreamWriter* w, std::string& data, bool finish);
+    void SendReply(const ContextPtr& ctx, const ReplyInfo& info, const std::string& response_data);
+    void OnReply(const TCPConnPtr& conn, uint64_t seq, bool close, std::string& response);
+    void FlushReplies(const TCPConnPtr& conn, const SessionPtr& s);
+
+    static SessionPtr GetSession(const TCPConnPtr& conn);
+
+    // Build the response of the status code, with the headers added to ctx if it is not nullptr
+    static std::string BuildResponse(const Context* ctx, int code, const ReplyInfo& info, const std::string& body);
+
+    // Append the status line and the headers. The body is sent with the
+    // chunked transfer coding if body is nullptr, see StreamWriter.
+    static void AppendHead(std::string* r, const Context* ctx, int code, const ReplyInfo& info, const std::string* body);
+
+private:
+    int port_ = 0;
+    EventLoop* listen_loop_;
+    std::unique_ptr<TCPServer> tcp_server_;
+    Router router_;
+    HTTPRequestCallback default_callback_;
+    size_t max_header_size_;
+    size_t max_body_size_;
+    Duration idle_timeout_;
+};
+}
+}
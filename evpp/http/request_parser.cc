@@ -0,0 +1,494 @@
+#include "evpp/inner_pre.h"
+
+#include "request_parser.h"
+#include "evpp/buffer.h"
+
+#include <limits>
+
+namespace evpp {
+namespace http {
+
+const size_t RequestParser::kDefaultMaxHeaderSize = 64 * 1024;
+const size_t RequestParser::kDefaultMaxBodySize = 64 * 1024 * 1024;
+
+namespace {
+// The max length of a chunk size line, with the chunk extensions
+const size_t kMaxChunkSizeLine = 1024;
+
+inline bool IsTokenChar(char c) {
+    // tchar of RFC 7230
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return strchr("!#$%&'*+-.^_`|~", c) != nullptr && c != '\0';
+}
+
+inline char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// s must be in lower case
+inline bool EqualsIgnoreCase(const char* d, size_t n, const char* s, size_t len) {
+    if (n != len) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (ToLower(d[i]) != s[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define H_EQUALS_IGNORE_CASE(d, n, literal) EqualsIgnoreCase(d, n, literal, sizeof(literal) - 1)
+
+inline bool IsWhiteSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Call f for every element of a comma separated list, e.g. "keep-alive, Upgrade"
+template<typename F>
+void ForEachToken(const char* d, size_t n, F f) {
+    size_t i = 0;
+    while (i < n) {
+        while (i < n && (IsWhiteSpace(d[i]) || d[i] == ',')) {
+            ++i;
+        }
+        size_t start = i;
+        while (i < n && d[i] != ',') {
+            ++i;
+        }
+        size_t end = i;
+        while (end > start && IsWhiteSpace(d[end - 1])) {
+            --end;
+        }
+        if (end > start) {
+            f(d + start, end - start);
+        }
+    }
+}
+
+// Return false if it is not a valid chunk size or it is too big
+bool ParseChunkSize(const char* d, size_t n, size_t* size) {
+    size_t v = 0;
+    size_t i = 0;
+    for (; i < n; ++i) {
+        char c = d[i];
+        int x = 0;
+        if (c >= '0' && c <= '9') {
+            x = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            x = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            x = c - 'A' + 10;
+        } else {
+            break;
+        }
+        if (v > (std::numeric_limits<size_t>::max() >> 4)) {
+            return false;
+        }
+        v = (v << 4) | static_cast<size_t>(x);
+    }
+
+    if (i == 0) {
+        return false;
+    }
+
+    // The chunk extensions are ignored
+    for (; i < n; ++i) {
+        if (!IsWhiteSpace(d[i])) {
+            break;
+        }
+    }
+    if (i < n && d[i] != ';') {
+        return false;
+    }
+    *size = v;
+    return true;
+}
+}
+
+RequestParser::RequestParser()
+    : max_header_size_(kDefaultMaxHeaderSize)
+    , max_body_size_(kDefaultMaxBodySize)
+    , stop_at_head_(false) {
+    Reset();
+}
+
+void RequestParser::Reset() {
+    state_ = kRequestLine;
+    pos_ = 0;
+    error_code_ = 0;
+    method_range_ = Range{ 0, 0 };
+    uri_range_ = Range{ 0, 0 };
+    header_ranges_.clear();
+    minor_version_ = 1;
+    connection_close_ = false;
+    connection_keep_alive_ = false;
+    expect_continue_ = false;
+    chunked_ = false;
+    has_content_length_ = false;
+    content_length_ = 0;
+    body_offset_ = 0;
+    body_length_ = 0;
+    chunk_left_ = 0;
+    trailer_size_ = 0;
+    streaming_ = false;
+    method_ = Slice();
+    uri_ = Slice();
+    headers_.clear();
+    body_ = Slice();
+}
+
+RequestParser::Result RequestParser::Fail(int code) {
+    DLOG_TRACE << "bad request, code=" << code << " state=" << state_ << " pos=" << pos_;
+    state_ = kBroken;
+    error_code_ = code;
+    return kError;
+}
+
+RequestParser::Result RequestParser::Parse(Buffer* buf) {
+    assert(!streaming_);
+    return Parse(buf, nullptr);
+}
+
+RequestParser::Result RequestParser::ReadBody(Buffer* buf, Slice* piece) {
+    assert(head_complete());
+
+    // The head and the pieces returned before are not needed any more
+    buf->Retrieve(pos_);
+    pos_ = 0;
+    streaming_ = true;
+    *piece = Slice();
+    return Parse(buf, piece);
+}
+
+RequestParser::Result RequestParser::Parse(Buffer* buf, Slice* piece) {
+    // The chunked body is moved forward over the chunk size lines,
+    // or returned piece by piece if piece is not nullptr
+    char* d = const_cast<char*>(buf->data());
+    size_t n = buf->length();
+
+    for (;;) {
+        switch (state_) {
+        case kRequestLine:
+        case kHeaderLine: {
+            const char* eol = static_cast<const char*>(memchr(d + pos_, '\n', n - pos_));
+            if (!eol) {
+                if (n > max_header_size_) {
+                    return Fail(state_ == kRequestLine ? 414 : 431);
+                }
+                return kNeedMore;
+            }
+
+            size_t next = static_cast<size_t>(eol - d) + 1;
+            if (next > max_header_size_) {
+                return Fail(state_ == kRequestLine ? 414 : 431);
+            }
+
+            size_t len = next - 1 - pos_;
+            if (len > 0 && d[pos_ + len - 1] == '\r') {
+                --len;
+            }
+
+            if (state_ == kRequestLine) {
+                // The empty lines before the request line are ignored, see RFC 7230 3.5
+                if (len > 0) {
+                    if (!ParseRequestLine(d + pos_, len)) {
+                        return kError;
+                    }
+                    state_ = kHeaderLine;
+                }
+                pos_ = next;
+            } else if (len > 0) {
+                if (!ParseHeaderLine(d + pos_, len)) {
+                    return kError;
+                }
+                pos_ = next;
+            } else {
+                pos_ = next;
+                if (!OnHeadComplete()) {
+                    return kError;
+                }
+                if (stop_at_head_) {
+                    MakeSlices(d);
+                    return kHeadComplete;
+                }
+            }
+            break;
+        }
+        case kBody:
+            if (piece) {
+                size_t len = std::min(content_length_ - body_length_, n - pos_);
+                *piece = Slice(d + pos_, len);
+                body_length_ += len;
+                pos_ += len;
+                if (body_length_ < content_length_) {
+                    return kNeedMore;
+                }
+                state_ = kDone;
+                break;
+            }
+            if (content_length_ > max_body_size_) {
+                return Fail(413);
+            }
+            if (n - pos_ < content_length_) {
+                return kNeedMore;
+            }
+            body_offset_ = pos_;
+            body_length_ = content_length_;
+            pos_ += content_length_;
+            state_ = kDone;
+            break;
+        case kChunkSize: {
+            const char* eol = static_cast<const char*>(memchr(d + pos_, '\n', n - pos_));
+            if (!eol) {
+                if (n - pos_ > kMaxChunkSizeLine) {
+                    return Fail(400);
+                }
+                return kNeedMore;
+            }
+
+            size_t next = static_cast<size_t>(eol - d) + 1;
+            size_t len = next - 1 - pos_;
+            if (len > 0 && d[pos_ + len - 1] == '\r') {
+                --len;
+            }
+
+            size_t size = 0;
+            if (!ParseChunkSize(d + pos_, len, &size)) {
+                return Fail(400);
+            }
+            if (!piece && size > max_body_size_ - body_length_) {
+                return Fail(413);
+            }
+
+            pos_ = next;
+            chunk_left_ = size;
+            state_ = size > 0 ? kChunkData : kTrailer;
+            break;
+        }
+        case kChunkData: {
+            // Move the data as it comes, so the chunk does not need to be
+            // totally received before it is decoded.
+            size_t len = std::min(chunk_left_, n - pos_);
+            if (piece) {
+                *piece = Slice(d + pos_, len);
+                body_length_ += len;
+                pos_ += len;
+                chunk_left_ -= len;
+                if (chunk_left_ == 0) {
+                    state_ = kChunkDataEnd;
+                }
+                if (len > 0 || chunk_left_ > 0) {
+                    return kNeedMore;
+                }
+                break;
+            }
+            if (len > 0) {
+                memmove(d + body_offset_ + body_length_, d + pos_, len);
+                body_length_ += len;
+                pos_ += len;
+                chunk_left_ -= len;
+            }
+            if (chunk_left_ > 0) {
+                return kNeedMore;
+            }
+            state_ = kChunkDataEnd;
+            break;
+        }
+        case kChunkDataEnd:
+            if (pos_ == n) {
+                return kNeedMore;
+            }
+            if (d[pos_] == '\r') {
+                if (n - pos_ < 2) {
+                    return kNeedMore;
+                }
+                ++pos_;
+            }
+            if (d[pos_] != '\n') {
+                return Fail(400);
+            }
+            ++pos_;
+            state_ = kChunkSize;
+            break;
+        case kTrailer: {
+            // The trailer fields are ignored
+            const char* eol = static_cast<const char*>(memchr(d + pos_, '\n', n - pos_));
+            if (!eol) {
+                if (trailer_size_ + n - pos_ > max_header_size_) {
+                    return Fail(431);
+                }
+                return kNeedMore;
+            }
+
+            size_t next = static_cast<size_t>(eol - d) + 1;
+            size_t len = next - 1 - pos_;
+            if (len > 0 && d[pos_ + len - 1] == '\r') {
+                --len;
+            }
+            trailer_size_ += next - pos_;
+            if (trailer_size_ > max_header_size_) {
+                return Fail(431);
+            }
+            pos_ = next;
+            if (len == 0) {
+                state_ = kDone;
+            }
+            break;
+        }
+        case kDone:
+            if (!piece) {
+                MakeSlices(d);
+            }
+            return kComplete;
+        case kBroken:
+            return kError;
+        }
+    }
+}
+
+bool RequestParser::ParseRequestLine(const char* line, size_t len) {
+    // method SP request-target SP HTTP-version
+    size_t i = 0;
+    while (i < len && IsTokenChar(line[i])) {
+        ++i;
+    }
+    if (i == 0 || i == len || line[i] != ' ') {
+        Fail(400);
+        return false;
+    }
+    method_range_ = Range{ pos_, i };
+
+    size_t uri_start = ++i;
+    while (i < len && line[i] != ' ') {
+        if (static_cast<unsigned char>(line[i]) <= 0x20 || line[i] == 0x7f) {
+            Fail(400);
+            return false;
+        }
+        ++i;
+    }
+    if (i == uri_start || i == len) {
+        Fail(400);
+        return false;
+    }
+    uri_range_ = Range{ pos_ + uri_start, i - uri_start };
+
+    const char* version = line + i + 1;
+    size_t version_len = len - i - 1;
+    if (version_len == 8 && memcmp(version, "HTTP/1.", 7) == 0 && (version[7] == '0' || version[7] == '1')) {
+        minor_version_ = version[7] - '0';
+        return true;
+    }
+
+    Fail(version_len > 5 && memcmp(version, "HTTP/", 5) == 0 ? 505 : 400);
+    return false;
+}
+
+bool RequestParser::ParseHeaderLine(const char* line, size_t len) {
+    // field-name ":" OWS field-value OWS
+    // The obsolete line folding is rejected, see RFC 7230 3.2.4
+    size_t i = 0;
+    while (i < len && IsTokenChar(line[i])) {
+        ++i;
+    }
+    if (i == 0 || i == len || line[i] != ':') {
+        Fail(400);
+        return false;
+    }
+
+    const char* name = line;
+    size_t name_len = i;
+    size_t start = i + 1;
+    while (start < len && IsWhiteSpace(line[start])) {
+        ++start;
+    }
+    size_t end = len;
+    while (end > start && IsWhiteSpace(line[end - 1])) {
+        --end;
+    }
+    const char* value = line + start;
+    size_t value_len = end - start;
+    header_ranges_.push_back(std::make_pair(Range{ pos_, name_len }, Range{ pos_ + start, value_len }));
+
+    if (H_EQUALS_IGNORE_CASE(name, name_len, "content-length")) {
+        size_t v = 0;
+        if (value_len == 0) {
+            Fail(400);
+            return false;
+        }
+        for (size_t k = 0; k < value_len; ++k) {
+            if (value[k] < '0' || value[k] > '9' || v > (std::numeric_limits<size_t>::max() - 9) / 10) {
+                Fail(400);
+                return false;
+            }
+            v = v * 10 + static_cast<size_t>(value[k] - '0');
+        }
+        if (has_content_length_ && v != content_length_) {
+            Fail(400);
+            return false;
+        }
+        has_content_length_ = true;
+        content_length_ = v;
+    } else if (H_EQUALS_IGNORE_CASE(name, name_len, "transfer-encoding")) {
+        // Only "chunked" is supported and it must be the last coding
+        bool chunked = false;
+        ForEachToken(value, value_len, [&chunked](const char* t, size_t n) {
+            chunked = H_EQUALS_IGNORE_CASE(t, n, "chunked");
+        });
+        if (!chunked) {
+            Fail(501);
+            return false;
+        }
+        chunked_ = true;
+    } else if (H_EQUALS_IGNORE_CASE(name, name_len, "connection")) {
+        ForEachToken(value, value_len, [this](const char* t, size_t n) {
+            if (H_EQUALS_IGNORE_CASE(t, n, "close")) {
+                connection_close_ = true;
+            } else if (H_EQUALS_IGNORE_CASE(t, n, "keep-alive")) {
+                connection_keep_alive_ = true;
+            }
+        });
+    } else if (H_EQUALS_IGNORE_CASE(name, name_len, "expect")) {
+        expect_continue_ = H_EQUALS_IGNORE_CASE(value, value_len, "100-continue");
+    }
+
+    return true;
+}
+
+bool RequestParser::OnHeadComplete() {
+    if (chunked_ && has_content_length_) {
+        // It may be a request smuggling, see RFC 7230 3.3.3
+        Fail(400);
+        return false;
+    }
+
+    if (chunked_) {
+        body_offset_ = pos_;
+        state_ = kChunkSize;
+    } else if (content_length_ > 0) {
+        // The size is checked when the body is parsed, since a streamed body is not limited
+        state_ = kBody;
+    } else {
+        body_offset_ = pos_;
+        state_ = kDone;
+    }
+    return true;
+}
+
+void RequestParser::MakeSlices(const char* data) {
+    method_ = Slice(data + method_range_.offset, method_range_.length);
+    uri_ = Slice(data + uri_range_.offset, uri_range_.length);
+    headers_.resize(header_ranges_.size());
+    for (size_t i = 0; i < header_ranges_.size(); ++i) {
+        const std::pair<Range, Range>& r = header_ranges_[i];
+        headers_[i].name = Slice(data + r.first.offset, r.first.length);
+        headers_[i].value = Slice(data + r.second.offset, r.second.length);
+    }
+    body_ = Slice(data + body_offset_, body_length_);
+}
+
+#undef H_EQUALS_IGNORE_CASE
+}
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+
+#include "evpp/inner_pre.h"
+#include "evpp/slice.h"
+
+namespace evpp {
+class Buffer;
+
+namespace http {
+
+// RequestParser parses the HTTP/1.0 and HTTP/1.1 requests from the input
+// Buffer of a connection incrementally. It remembers where it stopped, so
+// every byte is scanned only once even if a request comes in many reads.
+//
+// Nothing is copied. The fields of the parsed request are Slices pointing
+// into the Buffer, which are valid until the Buffer is modified. A chunked
+// body is decoded in place, so it is a contiguous Slice too.
+//
+// Usage :
+//
+//    RequestParser::Result r = parser.Parse(buf);
+//    if (r == RequestParser::kComplete) {
+//        // Use parser.method(), parser.uri(), parser.headers(), parser.body() ...
+//        buf->Retrieve(parser.size());
+//        parser.Reset();
+//    }
+//
+// A large body may be read piece by piece instead, so it is never held in
+// the buffer as a whole. Parse returns kHeadComplete when the head is parsed
+// if set_stop_at_head(true) is called, and then :
+//
+//    Slice piece;
+//    RequestParser::Result r = parser.ReadBody(buf, &piece);
+//    // Use the piece, then call ReadBody again if r == kNeedMore && !piece.empty()
+//    if (r == RequestParser::kComplete) {
+//        buf->Retrieve(parser.size());
+//        parser.Reset();
+//    }
+//
+class EVPP_EXPORT RequestParser {
+public:
+    enum Result {
+        kNeedMore = 0, // The request is not complete, call Parse again when more data comes
+        kComplete = 1,
+        kError = 2, // The request is malformed, respond with error_code() and close the connection
+        kHeadComplete = 3, // The head is parsed, see set_stop_at_head
+    };
+
+    struct Header {
+        Slice name;
+        Slice value;
+    };
+
+    static const size_t kDefaultMaxHeaderSize; // = 64KB
+    static const size_t kDefaultMaxBodySize; // = 64MB
+
+    RequestParser();
+
+    // @brief Parse the request at the beginning of buf. It must be called with
+    //  the same buf until it returns kComplete or kError.
+    //  The chunked body is decoded in place, so the data of buf is modified.
+    Result Parse(Buffer* buf);
+
+    // @brief Read the next piece of the body after Parse returned kHeadComplete.
+    //  The bytes parsed before, including the head, are retrieved from buf,
+    //  so the fields of the head are invalid after it is called.
+    //  The body is not limited by the max body size.
+    // @param[OUT] piece - The piece of the decoded body, which is valid until buf is modified
+    // @return kComplete if piece is the last one, or kNeedMore : if piece is
+    //  empty, call it again when more data comes, otherwise call it again at once.
+    //  Or kError for a malformed chunked body.
+    Result ReadBody(Buffer* buf, Slice* piece);
+
+    // @brief Prepare for the next request, after the bytes of this request
+    //  are retrieved from the buffer. The memory of the headers is kept.
+    void Reset();
+
+    // The max size of the request line and the headers. 431 is responded if it is exceeded.
+    void set_max_header_size(size_t n) {
+        max_header_size_ = n;
+    }
+
+    // The max size of the body. 413 is responded if it is exceeded.
+    void set_max_body_size(size_t n) {
+        max_body_size_ = n;
+    }
+
+    // Return kHeadComplete from Parse once the head of a request is parsed, so
+    // the caller can decide to read the body by Parse or by ReadBody.
+    // The head fields are valid then. It is kept by Reset.
+    void set_stop_at_head(bool on) {
+        stop_at_head_ = on;
+    }
+
+public:
+    // These are valid once the request line and the headers are parsed
+    bool head_complete() const {
+        return state_ > kHeaderLine;
+    }
+    int minor_version() const {
+        return minor_version_;
+    }
+    bool keep_alive() const {
+        return minor_version_ == 1 ? !connection_close_ : connection_keep_alive_ && !connection_close_;
+    }
+    bool expect_continue() const {
+        return expect_continue_;
+    }
+
+    // These are valid after Parse returns kComplete or kHeadComplete
+    const Slice& method() const {
+        return method_;
+    }
+
+    // The original request target, e.g. /status.html?code=utf8
+    const Slice& uri() const {
+        return uri_;
+    }
+
+    const std::vector<Header>& headers() const {
+        return headers_;
+    }
+
+    const Slice& body() const {
+        return body_;
+    }
+
+    // The count of the bytes of this request in the buffer
+    size_t size() const {
+        return pos_;
+    }
+
+    // The HTTP status code to respond when Parse returns kError
+    int error_code() const {
+        return error_code_;
+    }
+
+private:
+    enum State {
+        kRequestLine,
+        kHeaderLine,
+        kBody,
+        kChunkSize,
+        kChunkData,
+        kChunkDataEnd,
+        kTrailer,
+        kDone,
+        kBroken,
+    };
+
+    // A field is kept as the offset in the buffer until the request is
+    // complete, since the buffer may be reallocated by the following reads.
+    struct Range {
+        size_t offset;
+        size_t length;
+    };
+
+    Result Parse(Buffer* buf, Slice* piece);
+    Result Fail(int code);
+    bool ParseRequestLine(const char* line, size_t len);
+    bool ParseHeaderLine(const char* line, size_t len);
+    bool OnHeadComplete();
+    void MakeSlices(const char* data);
+
+private:
+    State state_;
+    size_t pos_; // The offset of the next byte to parse
+    size_t max_header_size_;
+    size_t max_body_size_;
+    bool stop_at_head_;
+    int error_code_;
+
+    Range method_range_;
+    Range uri_range_;
+    std::vector<std::pair<Range, Range>> header_ranges_;
+    int minor_version_;
+    bool connection_close_;
+    bool connection_keep_alive_;
+    bool expect_continue_;
+    bool chunked_;
+    bool has_content_length_;
+    size_t content_length_;
+
+    // The decoded body is [body_offset_, body_offset_ + body_length_)
+    size_t body_offset_;
+    size_t body_length_;
+    size_t chunk_left_;
+    size_t trailer_size_;
+    bool streaming_; // The body is being read by ReadBody
+
+    Slice method_;
+    Slice uri_;
+    std::vector<Header> headers_;
+    Slice body_;
+};
+}
+}
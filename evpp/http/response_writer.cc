@@ -0,0 +1,136 @@
+#include "response_writer.h"
+
+#include "evpp/event_loop.h"
+
+namespace evpp {
+namespace http {
+
+const size_t ResponseWriter::kDefaultHighWaterMark = 1024 * 1024;
+
+ResponseWriter::ResponseWriter(EventLoop* l, const ContextPtr& ctx)
+    : loop_(l), ctx_(ctx), high_water_mark_(kDefaultHighWaterMark) {
+}
+
+ResponseWriter::~ResponseWriter() {
+}
+
+void ResponseWriter::WriteHeaders(int code) {
+    auto self = shared_from_this();
+    RunInOrder([self, code]() {
+        self->WriteHeadersInLoop(code);
+    });
+}
+
+bool ResponseWriter::WriteChunk(const Slice& data) {
+    return WriteChunk(data.ToString());
+}
+
+bool ResponseWriter::WriteChunk(std::string&& data) {
+    if (closed_.load()) {
+        return true;
+    }
+
+    if (!data.empty()) {
+        queued_.fetch_add(data.size());
+        if (loop_->IsInLoopThread() && pending_.load() == 0) {
+            WriteChunkInLoop(data);
+        } else {
+            auto self = shared_from_this();
+            std::shared_ptr<std::string> d = std::make_shared<std::string>(std::move(data));
+            RunInOrder([self, d]() {
+                self->WriteChunkInLoop(*d);
+            });
+        }
+    }
+
+    if (buffered_bytes() < high_water_mark_) {
+        return true;
+    }
+
+    blocked_.store(true);
+
+    // The bytes may have been sent before blocked_ is set, see OnBuffered
+    if (buffered_bytes() < high_water_mark_ && blocked_.exchange(false)) {
+        return true;
+    }
+    return closed_.load();
+}
+
+void ResponseWriter::Finish() {
+    auto self = shared_from_this();
+    RunInOrder([self]() {
+        if (self->finished_) {
+            return;
+        }
+        if (!self->closed_.load()) {
+            self->WriteHeadersInLoop(200);
+            self->DoFinish();
+        }
+        self->finished_ = true;
+
+        // It usually holds this writer
+        self->writable_fn_ = WritableCallback();
+    });
+}
+
+void ResponseWriter::RunInOrder(const std::function<void()>& f) {
+    // The calls queued by another thread must run before the ones in loop_
+    if (loop_->IsInLoopThread() && pending_.load() == 0) {
+        f();
+        return;
+    }
+
+    pending_.fetch_add(1);
+    auto self = shared_from_this();
+    loop_->QueueInLoop([self, f]() {
+        f();
+        self->pending_.fetch_sub(1);
+    });
+}
+
+void ResponseWriter::WriteHeadersInLoop(int code) {
+    assert(loop_->IsInLoopThread());
+    if (headers_written_ || finished_ || closed_.load()) {
+        return;
+    }
+    headers_written_ = true;
+    DoWriteHeaders(code);
+}
+
+void ResponseWriter::WriteChunkInLoop(std::string& data) {
+    assert(loop_->IsInLoopThread());
+    size_t n = data.size();
+    if (!finished_ && !closed_.load()) {
+        WriteHeadersInLoop(200);
+        DoWriteChunk(data);
+    }
+    queued_.fetch_sub(n);
+}
+
+void ResponseWriter::OnBuffered(size_t n) {
+    assert(loop_->IsInLoopThread());
+    buffered_.store(n);
+    if (buffered_bytes() < high_water_mark_ && blocked_.exchange(false) && writable_fn_) {
+        writable_fn_();
+    }
+}
+
+void ResponseWriter::OnClosed() {
+    assert(loop_->IsInLoopThread());
+    if (closed_.exchange(true)) {
+        return;
+    }
+
+    DLOG_TRACE << "the connection is closed before the response of " << ctx_->original_uri() << " is finished";
+    buffered_.store(0);
+    blocked_.store(false);
+
+    // Wake up the writer waiting for the writable callback, then release it
+    WritableCallback f;
+    f.swap(writable_fn_);
+    if (f && !finished_) {
+        f();
+    }
+}
+}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "evpp/inner_pre.h"
+#include "evpp/slice.h"
+#include "context.h"
+
+#include <atomic>
+
+namespace evpp {
+class EventLoop;
+
+namespace http {
+
+// ResponseWriter streams the response of a request registered by
+// Server::RegisterStreamHandler piece by piece, with the chunked transfer
+// coding, so a large response does not need to be built in memory at once.
+//
+// The methods may be called in any thread, but in one thread at a time,
+// since the pieces are sent in the order of the calls. They are forwarded to
+// the thread of the connection.
+//
+// The backpressure : WriteChunk returns false when the bytes written but not
+// sent yet reach the high water mark. The writer should stop writing, and
+// the writable callback is invoked when all the bytes are sent.
+//
+// The typical usage is :
+//
+//      void OnDownload(EventLoop* loop, const ContextPtr& ctx, const ResponseWriterPtr& w) {
+//          w->SetWritableCallback([w]() { Produce(w); });
+//          w->WriteHeaders(200);
+//          Produce(w);
+//      }
+//
+//      void Produce(const ResponseWriterPtr& w) {
+//          while (!w->closed() && HasMore()) {
+//              if (!w->WriteChunk(NextPiece())) {
+//                  return; // Go on in the writable callback
+//              }
+//          }
+//          w->Finish();
+//      }
+class EVPP_EXPORT ResponseWriter : public std::enable_shared_from_this<ResponseWriter> {
+public:
+    typedef std::function<void()> WritableCallback;
+
+    static const size_t kDefaultHighWaterMark; // = 1MB
+
+    virtual ~ResponseWriter();
+
+    // @brief Send the status line and the headers added by Context::AddResponseHeader.
+    //  It is called with 200 by the first WriteChunk or Finish if it is not called.
+    void WriteHeaders(int code = 200);
+
+    // @brief Send a piece of the body. An empty piece is ignored.
+    // @return false if the caller should wait for the writable callback before
+    //  writing more. It is true if the connection is closed, see closed().
+    bool WriteChunk(const Slice& data);
+    bool WriteChunk(std::string&& data);
+
+    // @brief Send the end of the body. The writer must not be used any more.
+    void Finish();
+
+    // @brief Set the callback invoked in the thread of the connection when
+    //  the bytes are all sent after WriteChunk returned false, or when the
+    //  connection is closed. It must be called before the first WriteChunk.
+    void SetWritableCallback(const WritableCallback& cb) {
+        writable_fn_ = cb;
+    }
+
+    // It must be called before the first WriteChunk
+    void SetHighWaterMark(size_t mark) {
+        high_water_mark_ = mark;
+    }
+
+    // The count of the bytes written but not sent yet
+    size_t buffered_bytes() const {
+        return queued_.load() + buffered_.load();
+    }
+
+    // The connection has been closed, so the pieces written are dropped
+    bool closed() const {
+        return closed_.load();
+    }
+
+    const ContextPtr& context() const {
+        return ctx_;
+    }
+
+    // The loop of the connection
+    EventLoop* loop() const {
+        return loop_;
+    }
+
+protected:
+    ResponseWriter(EventLoop* loop, const ContextPtr& ctx);
+
+    // These are called in loop_ in the order of the calls of the writer
+    virtual void DoWriteHeaders(int code) = 0;
+    virtual void DoWriteChunk(std::string& data) = 0;
+    virtual void DoFinish() = 0;
+
+    // @brief The engine tells how many bytes of this response are waiting to
+    //  be sent. 0 means they are all sent. It is called in loop_.
+    void OnBuffered(size_t n);
+
+    // @brief The connection is closed. It is called in loop_.
+    void OnClosed();
+
+private:
+    // Run f in loop_, after the calls queued before
+    void RunInOrder(const std::function<void()>& f);
+    void WriteChunkInLoop(std::string& data);
+    void WriteHeadersInLoop(int code);
+
+private:
+    EventLoop* loop_;
+    ContextPtr ctx_;
+    WritableCallback writable_fn_;
+    size_t high_water_mark_;
+
+    // Only accessed in loop_
+    bool headers_written_ = false;
+    bool finished_ = false;
+
+    std::atomic<size_t> queued_ = { 0 }; // The bytes of WriteChunk not handed to the engine yet
+    std::atomic<size_t> buffered_ = { 0 }; // The bytes of the engine not sent yet
+    std::atomic<bool> blocked_ = { false }; // WriteChunk has returned false
+    std::atomic<bool> closed_ = { false };
+    std::atomic<int> pending_ = { 0 }; // The calls queued to loop_ but not run yet
+};
+
+typedef std::shared_ptr<ResponseWriter> ResponseWriterPtr;
+
+// The handler of a streamed request, see Server::RegisterStreamHandler.
+// It is invoked when the request line and the headers are received, and
+// the body comes to the callback set by Context::SetBodyCallback.
+typedef std::function <
+void(EventLoop* loop,
+     const ContextPtr& ctx,
+     const ResponseWriterPtr& writer) > HTTPStreamCallback;
+}
+}
@@ -0,0 +1,260 @@
+#include "router.h"
+
+namespace evpp {
+namespace http {
+
+struct Router::Route {
+    std::string method; // Empty for any method
+    bool stream = false; // It is a route of stream_callback
+    HTTPRequestCallback callback;
+    HTTPStreamCallback stream_callback;
+    std::vector<std::string> param_names; // In the order of the parameters in the pattern
+};
+
+struct Router::Node {
+    // The static bytes matched by this node. It is empty for the root,
+    // the parameter and the catch-all nodes.
+    std::string prefix;
+
+    // The static children. indices[i] is the first byte of children[i]->prefix.
+    std::string indices;
+    std::vector<std::unique_ptr<Node>> children;
+
+    std::unique_ptr<Node> param;
+    std::unique_ptr<Node> catch_all;
+
+    // The routes ending at this node, one for each method
+    std::vector<Route> routes;
+};
+
+Router::Router() : root_(new Node) {}
+
+Router::~Router() {}
+
+void Router::Clear() {
+    root_.reset(new Node);
+    route_count_ = 0;
+    stream_route_count_ = 0;
+}
+
+Router::Node* Router::AddPattern(const std::string& pattern, std::vector<std::string>* names) {
+    if (pattern.empty() || pattern[0] != '/') {
+        LOG_ERROR << "The route pattern must start with '/' : " << pattern;
+        return nullptr;
+    }
+
+    Node* n = root_.get();
+    size_t i = 0;
+    while (i < pattern.size()) {
+        // The static part before the next parameter
+        size_t j = i;
+        while (j < pattern.size() && pattern[j] != ':' && pattern[j] != '*') {
+            ++j;
+        }
+        if (j > i) {
+            n = AddStatic(n, Slice(pattern.data() + i, j - i));
+        }
+        if (j == pattern.size()) {
+            break;
+        }
+
+        // A parameter occupies a whole segment
+        if (pattern[j - 1] != '/') {
+            LOG_ERROR << "A parameter must be a whole segment in the route pattern : " << pattern;
+            return nullptr;
+        }
+        size_t end = pattern.find('/', j);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        std::string name = pattern.substr(j + 1, end - j - 1);
+        if (name.empty() || name.find_first_of(":*") != std::string::npos) {
+            LOG_ERROR << "Bad parameter name in the route pattern : " << pattern;
+            return nullptr;
+        }
+        if (names->size() == RouteParams::kMaxParams) {
+            LOG_ERROR << "Too many parameters in the route pattern : " << pattern;
+            return nullptr;
+        }
+        names->push_back(name);
+
+        std::unique_ptr<Node>& child = pattern[j] == ':' ? n->param : n->catch_all;
+        if (!child) {
+            child.reset(new Node);
+        }
+        n = child.get();
+        if (pattern[j] == '*' && end != pattern.size()) {
+            LOG_ERROR << "The catch-all parameter must be the last one in the route pattern : " << pattern;
+            return nullptr;
+        }
+        i = end;
+    }
+
+    return n;
+}
+
+bool Router::Add(const std::string& method, const std::string& pattern, const HTTPRequestCallback& callback) {
+    Route r;
+    Node* n = AddPattern(pattern, &r.param_names);
+    if (!n) {
+        return false;
+    }
+    r.method = method;
+    r.callback = callback;
+    AddRoute(n, std::move(r));
+    return true;
+}
+
+bool Router::AddStream(const std::string& method, const std::string& pattern, const HTTPStreamCallback& callback) {
+    Route r;
+    Node* n = AddPattern(pattern, &r.param_names);
+    if (!n) {
+        return false;
+    }
+    r.method = method;
+    r.stream = true;
+    r.stream_callback = callback;
+    AddRoute(n, std::move(r));
+    return true;
+}
+
+void Router::AddExact(const std::string& path, const HTTPRequestCallback& callback) {
+    Route r;
+    r.callback = callback;
+    AddRoute(AddStatic(root_.get(), Slice(path)), std::move(r));
+}
+
+void Router::AddRoute(Node* n, Route&& route) {
+    for (auto& r : n->routes) {
+        if (r.method == route.method && r.stream == route.stream) {
+            // Replace it, as HTTPRequestCallbackMap does
+            r = std::move(route);
+            return;
+        }
+    }
+
+    if (route.stream) {
+        ++stream_route_count_;
+    }
+    n->routes.push_back(std::move(route));
+    ++route_count_;
+}
+
+Router::Node* Router::AddStatic(Node* n, Slice s) {
+    while (!s.empty()) {
+        size_t idx = n->indices.find(s[0]);
+        if (idx == std::string::npos) {
+            std::unique_ptr<Node> child(new Node);
+            child->prefix = s.ToString();
+            n->indices.push_back(s[0]);
+            n->children.push_back(std::move(child));
+            return n->children.back().get();
+        }
+
+        // The length of the common prefix
+        Node* child = n->children[idx].get();
+        size_t common = 0;
+        while (common < child->prefix.size() && common < s.size() && child->prefix[common] == s[common]) {
+            ++common;
+        }
+
+        if (common < child->prefix.size()) {
+            // Split the child into the common part and the rest
+            std::unique_ptr<Node> mid(new Node);
+            mid->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            mid->indices.push_back(child->prefix[0]);
+            mid->children.push_back(std::move(n->children[idx]));
+            n->children[idx] = std::move(mid);
+            child = n->children[idx].get();
+        }
+
+        n = child;
+        s.remove_prefix(common);
+    }
+    return n;
+}
+
+const HTTPRequestCallback* Router::Match(const Slice& method, const Slice& path, RouteParams* params) const {
+    const Route* r = Match(method, path, false, params);
+    return r ? &r->callback : nullptr;
+}
+
+const HTTPStreamCallback* Router::MatchStream(const Slice& method, const Slice& path, RouteParams* params) const {
+    if (stream_route_count_ == 0) {
+        return nullptr;
+    }
+    const Route* r = Match(method, path, true, params);
+    return r ? &r->stream_callback : nullptr;
+}
+
+const Router::Route* Router::Match(const Slice& method, const Slice& path, bool stream, RouteParams* params) const {
+    Slice values[RouteParams::kMaxParams];
+    const Route* r = Match(root_.get(), method, path, stream, values, 0);
+    if (!r) {
+        return nullptr;
+    }
+
+    if (params) {
+        params->names = &r->param_names;
+        for (size_t i = 0; i < r->param_names.size(); ++i) {
+            params->values[i] = values[i];
+        }
+    }
+    return r;
+}
+
+const Router::Route* Router::Match(const Node* n, const Slice& method, Slice path, bool stream, Slice* values, size_t count) const {
+    if (path.empty()) {
+        const Route* r = FindRoute(n, method, stream);
+        if (r) {
+            return r;
+        }
+    } else {
+        size_t idx = n->indices.find(path[0]);
+        if (idx != std::string::npos) {
+            const Node* child = n->children[idx].get();
+            if (path.starts_with(child->prefix)) {
+                const Route* r = Match(child, method, Slice(path.data() + child->prefix.size(), path.size() - child->prefix.size()), stream, values, count);
+                if (r) {
+                    return r;
+                }
+            }
+        }
+
+        if (n->param && count < RouteParams::kMaxParams) {
+            const char* end = static_cast<const char*>(memchr(path.data(), '/', path.size()));
+            size_t len = end ? end - path.data() : path.size();
+            if (len > 0) {
+                values[count] = Slice(path.data(), len);
+                const Route* r = Match(n->param.get(), method, Slice(path.data() + len, path.size() - len), stream, values, count + 1);
+                if (r) {
+                    return r;
+                }
+            }
+        }
+    }
+
+    if (n->catch_all && count < RouteParams::kMaxParams) {
+        values[count] = path;
+        return FindRoute(n->catch_all.get(), method, stream);
+    }
+    return nullptr;
+}
+
+const Router::Route* Router::FindRoute(const Node* n, const Slice& method, bool stream) {
+    const Route* any = nullptr;
+    for (auto& r : n->routes) {
+        if (r.stream != stream) {
+            continue;
+        }
+        if (r.method.empty()) {
+            any = &r;
+        } else if (method == r.method) {
+            return &r;
+        }
+    }
+    return any;
+}
+}
+}
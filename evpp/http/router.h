@@ -0,0 +1,87 @@
+#pragma once
+
+#include "evpp/inner_pre.h"
+#include "evpp/slice.h"
+#include "context.h"
+#include "response_writer.h"
+
+#include <vector>
+
+namespace evpp {
+namespace http {
+
+// Router finds the handler of a request by its method and path in a radix
+// tree, which is built when the routes are added.
+//
+// A pattern is matched segment by segment, and a segment may be :
+//     static         /users/list
+//     a parameter    /users/:id           matches one segment which is not empty
+//     a catch-all    /files/*path         matches the rest of the path, must be the last one
+//
+// For example, /users/:id/items/*rest matches /users/42/items/a/b with
+// id=42 and rest=a/b. The static segments are preferred to the parameters,
+// and the parameters are preferred to the catch-all ones.
+//
+// Match does not allocate any memory. The captured parameters are Slices
+// into the path, and their names are owned by the Router. So the Router must
+// not be modified while the requests are being handled.
+class EVPP_EXPORT Router {
+public:
+    Router();
+    ~Router();
+
+    // @brief Add a route.
+    // @param method - The request method, e.g. GET. An empty one matches any method.
+    // @param pattern - The path pattern, e.g. /users/:id
+    // @return false if the pattern is malformed
+    bool Add(const std::string& method, const std::string& pattern, const HTTPRequestCallback& callback);
+
+    // @brief Add a route of the exact path of any method. ':' and '*' in the path are not special.
+    void AddExact(const std::string& path, const HTTPRequestCallback& callback);
+
+    // @brief Add a route of the stream handler, see Server::RegisterStreamHandler.
+    //  The stream routes are matched by MatchStream only.
+    bool AddStream(const std::string& method, const std::string& pattern, const HTTPStreamCallback& callback);
+
+    // @brief Find the handler of the request.
+    // @param[IN] method - The request method
+    // @param[IN] path - The path of the request without any parameters
+    // @param[OUT] params - The captured parameters. It may be nullptr.
+    // @return the handler, or nullptr if there is no matched route
+    const HTTPRequestCallback* Match(const Slice& method, const Slice& path, RouteParams* params) const;
+
+    // @brief The same as Match, but finds the stream handler of the request
+    const HTTPStreamCallback* MatchStream(const Slice& method, const Slice& path, RouteParams* params) const;
+
+    void Clear();
+
+    bool empty() const {
+        return route_count_ == 0;
+    }
+
+    bool has_stream_routes() const {
+        return stream_route_count_ > 0;
+    }
+
+    size_t size() const {
+        return route_count_;
+    }
+
+private:
+    struct Node;
+    struct Route;
+
+    Node* AddPattern(const std::string& pattern, std::vector<std::string>* names);
+    Node* AddStatic(Node* n, Slice s);
+    void AddRoute(Node* n, Route&& route);
+    const Route* Match(const Slice& method, const Slice& path, bool stream, RouteParams* params) const;
+    const Route* Match(const Node* n, const Slice& method, Slice path, bool stream, Slice* values, size_t count) const;
+    static const Route* FindRoute(const Node* n, const Slice& method, bool stream);
+
+private:
+    std::unique_ptr<Node> root_;
+    size_t route_count_ = 0;
+    size_t stream_route_count_ = 0;
+};
+}
+}
@@ -3,6 +3,7 @@
 #include "evpp/libevent.h"
 #include "evpp/event_watcher.h"
 #include "evpp/event_loop.h"
+#include "evpp/sockets.h"
 
 #if defined(EVPP_HTTP_SERVER_SUPPORTS_SSL)
 #include <openssl/err.h>
@@ -144,7 +145,7 @@ namespace evpp {
         }
 #endif
 
-        bool Service::Listen(int listen_port) {
+        bool Service::Listen(int listen_port, bool reuse_port) {
             assert(evhttp_);
             assert(listen_loop_->IsInLoopThread());
             port_ = listen_port;
@@ -156,11 +157,36 @@ namespace evpp {
 #endif
 
 #if LIBEVENT_VERSION_NUMBER >= 0x02001500
-            evhttp_bound_socket_ = evhttp_bind_socket_with_handle(evhttp_, "0.0.0.0", listen_port);
-            if (!evhttp_bound_socket_) {
-                return false;
+            if (reuse_port) {
+                // evhttp_bind_socket does not set SO_REUSEPORT, so we bind the socket by ourselves
+                evpp_socket_t fd = sock::CreateNonblockingSocket();
+                if (fd == INVALID_SOCKET) {
+                    return false;
+                }
+
+                struct sockaddr_storage addr = sock::ParseFromIPPort(("0.0.0.0:" + std::to_string(listen_port)).data());
+                if (::bind(fd, sock::sockaddr_cast(&addr), static_cast<socklen_t>(sizeof(struct sockaddr_in))) != 0 ||
+                    ::listen(fd, SOMAXCONN) != 0) {
+                    EVUTIL_CLOSESOCKET(fd);
+                    return false;
+                }
+
+                // The listener owns fd and closes it when it is freed
+                evhttp_bound_socket_ = evhttp_accept_socket_with_handle(evhttp_, fd);
+                if (!evhttp_bound_socket_) {
+                    EVUTIL_CLOSESOCKET(fd);
+                    return false;
+                }
+            } else {
+                evhttp_bound_socket_ = evhttp_bind_socket_with_handle(evhttp_, "0.0.0.0", listen_port);
+                if (!evhttp_bound_socket_) {
+                    return false;
+                }
             }
 #else
+            if (reuse_port) {
+                LOG_WARN << "SO_REUSEPORT is not supported with this libevent version, listen at " << listen_port << " as usual";
+            }
             if (evhttp_bind_socket(evhttp_, "0.0.0.0", listen_port) != 0) {
                 return false;
             }
@@ -180,7 +206,8 @@ namespace evpp {
                 evhttp_bound_socket_ = nullptr;
             }
 
-            callbacks_.clear();
+            // The routes are kept, since the requests being handled refer to
+            // the names of their parameters owned by router_
             default_callback_ = HTTPRequestCallback();
             DLOG_TRACE << "http service stopped";
         }
@@ -213,7 +240,15 @@ namespace evpp {
         }
 
         void Service::RegisterHandler(const std::string& uri, HTTPRequestCallback callback) {
-            callbacks_[uri] = callback;
+            router_.AddExact(uri, callback);
+        }
+
+        bool Service::RegisterRoute(const std::string& method, const std::string& pattern, HTTPRequestCallback callback) {
+            return router_.Add(method, pattern, callback);
+        }
+
+        bool Service::RegisterStreamHandler(const std::string& method, const std::string& pattern, HTTPStreamCallback callback) {
+            return router_.AddStream(method, pattern, callback);
         }
 
         void Service::RegisterDefaultHandler(HTTPRequestCallback callback) {
@@ -232,24 +267,163 @@ namespace evpp {
             DLOG_TRACE << "handle request " << req << " url=" << req->uri;
 
             ContextPtr ctx(new Context(req));
-            ctx->Init();
+            if (router_.has_stream_routes()) {
+                // The body of a streamed request is not linearized
+                ctx->InitRequestLine();
+                const HTTPStreamCallback* scb = router_.MatchStream(ctx->method(), ctx->uri(), ctx->mutable_params());
+                if (scb) {
+                    HandleStreamRequest(ctx, *scb);
+                    return;
+                }
+                ctx->InitBody();
+            } else {
+                ctx->Init();
+            }
 
-            if (callbacks_.empty()) {
+            if (router_.empty()) {
                 DefaultHandleRequest(ctx);
                 return;
             }
 
-            auto it = callbacks_.find(ctx->uri());
-            if (it != callbacks_.end()) {
+            const HTTPRequestCallback* cb = router_.Match(ctx->method(), ctx->uri(), ctx->mutable_params());
+            if (cb) {
                 // This will forward to HTTPServer::Dispatch method to process this request.
                 auto f = std::bind(&Service::SendReply, this, ctx, std::placeholders::_1);
-                it->second(listen_loop_, ctx, f);
+                (*cb)(listen_loop_, ctx, f);
                 return;
             } else {
                 DefaultHandleRequest(ctx);
             }
         }
 
+        // The chunked transfer coding is done by evhttp. The writer holds itself
+        // until the response is finished or the connection is closed, since
+        // evhttp calls back with the raw pointer.
+        class Service::StreamWriter : public ResponseWriter {
+        public:
+            StreamWriter(Service* service, const ContextPtr& ctx)
+                : ResponseWriter(service->loop(), ctx), service_(service) {
+            }
+
+            void Start() {
+                evcon_ = evhttp_request_get_connection(context()->req());
+                if (evcon_) {
+                    self_ = shared_from_this();
+                    evhttp_connection_set_closecb(evcon_, &StreamWriter::CloseCallback, this);
+                }
+            }
+
+        protected:
+            virtual void DoWriteHeaders(int code) {
+                if (!IsWritable()) {
+                    return;
+                }
+
+                assert(code <= kMaxHTTPCode);
+                assert(code >= 100);
+                evhttp_send_reply_start(context()->req(), code, g_http_code_string[code]);
+            }
+
+            virtual void DoWriteChunk(std::string& data) {
+                if (!IsWritable()) {
+                    return;
+                }
+
+                struct evbuffer* buf = evbuffer_new();
+                evbuffer_add(buf, data.data(), data.size());
+#if LIBEVENT_VERSION_NUMBER >= 0x02010500
+                evhttp_send_reply_chunk_with_cb(context()->req(), buf, &StreamWriter::WriteCallback, this);
+                OnBuffered(evbuffer_get_length(bufferevent_get_output(evhttp_connection_get_bufferevent(evcon_))));
+#else
+                evhttp_send_reply_chunk(context()->req(), buf);
+#endif
+                evbuffer_free(buf);
+            }
+
+            virtual void DoFinish() {
+                if (!IsWritable()) {
+                    return;
+                }
+
+                // The request may be freed by evhttp_send_reply_end
+                std::shared_ptr<ResponseWriter> self;
+                self.swap(self_);
+                evhttp_connection_set_closecb(evcon_, nullptr, nullptr);
+                evhttp_send_reply_end(context()->req());
+            }
+
+        private:
+            bool IsWritable() {
+                if (evcon_ && service_->evhttp_) {
+                    return true;
+                }
+
+                // The connection is closed before the handler starts to write
+                if (!evcon_ && service_->evhttp_) {
+                    evhttp_send_reply_end(context()->req());
+                }
+                OnClosed();
+                return false;
+            }
+
+            static void CloseCallback(struct evhttp_connection* evcon, void* arg) {
+                StreamWriter* w = static_cast<StreamWriter*>(arg);
+                std::shared_ptr<ResponseWriter> self;
+                self.swap(w->self_);
+                w->evcon_ = nullptr;
+
+                // The request is detached from a failed connection and left
+                // to us, otherwise it is freed with the connection by evhttp_free
+                struct evhttp_request* req = w->context()->req();
+                if (!evhttp_request_get_connection(req)) {
+                    evhttp_send_reply_end(req);
+                }
+                w->OnClosed();
+            }
+
+            static void WriteCallback(struct evhttp_connection* evcon, void* arg) {
+                static_cast<StreamWriter*>(arg)->OnBuffered(0);
+            }
+
+        private:
+            Service* service_;
+            struct evhttp_connection* evcon_ = nullptr;
+            std::shared_ptr<ResponseWriter> self_;
+        };
+
+        void Service::HandleStreamRequest(const ContextPtr& ctx, const HTTPStreamCallback& cb) {
+            DLOG_TRACE << "handle streamed request url=" << ctx->original_uri();
+            std::shared_ptr<StreamWriter> w = std::make_shared<StreamWriter>(this, ctx);
+            w->Start();
+            cb(listen_loop_, ctx, w);
+
+            // evhttp has read the whole body. It is passed piece by piece
+            // without being linearized, and released at once.
+            HTTPBodyCallback body_cb;
+            body_cb.swap(ctx->body_callback_);
+            if (!body_cb) {
+                return;
+            }
+
+            struct evbuffer* evbuf = evhttp_request_get_input_buffer(ctx->req());
+#if LIBEVENT_VERSION_NUMBER >= 0x02001500
+            int n = evbuffer_peek(evbuf, -1, nullptr, nullptr, 0);
+            std::vector<struct evbuffer_iovec> v(n > 0 ? n : 0);
+            if (n > 0) {
+                evbuffer_peek(evbuf, -1, nullptr, &v[0], n);
+            }
+            for (int i = 0; i < n; ++i) {
+                body_cb(Slice(static_cast<const char*>(v[i].iov_base), v[i].iov_len), i + 1 == n);
+            }
+            if (n <= 0) {
+                body_cb(Slice(), true);
+            }
+            evbuffer_drain(evbuf, evbuffer_get_length(evbuf));
+#else
+            body_cb(Slice((char*)evbuf->buffer, evbuf->off), true);
+#endif
+        }
+
         void Service::DefaultHandleRequest(const ContextPtr& ctx) {
             DLOG_TRACE << "url=" << ctx->original_uri();
             if (default_callback_) {
@@ -2,6 +2,7 @@
 
 #include "evpp/inner_pre.h"
 #include "context.h"
+#include "router.h"
 
 struct evhttp;
 struct evhttp_bound_socket;
@@ -26,7 +27,10 @@ public:
 #endif
     ~Service();
 
-    bool Listen(int port);
+    // @brief Listen at the port. If reuse_port is true, the listening socket
+    //  is bound with SO_REUSEPORT, so several services in different threads
+    //  can listen at the same port and the kernel spreads the connections.
+    bool Listen(int port, bool reuse_port = false);
     void Stop();
     void Pause();
     void Continue();
@@ -37,6 +41,17 @@ public:
 
     void RegisterDefaultHandler(HTTPRequestCallback callback);
 
+    // @brief Register a handler of the path pattern, see Router.
+    // @param method - The request method, e.g. GET. An empty one matches any method.
+    // @param pattern - The path pattern, e.g. /users/:id/items/*rest
+    bool RegisterRoute(const std::string& method, const std::string& pattern, HTTPRequestCallback callback);
+
+    // @brief Register a stream handler of the path pattern, see Server::RegisterStreamHandler.
+    //  evhttp reads the whole body before the handler is invoked, so the body
+    //  is passed to the body callback at once, piece by piece of the buffer
+    //  without copying. The response is streamed by evhttp with the chunked transfer coding.
+    bool RegisterStreamHandler(const std::string& method, const std::string& pattern, HTTPStreamCallback callback);
+
     EventLoop* loop() const {
         return listen_loop_;
     }
@@ -67,8 +82,11 @@ public:
 	bool initSSL(bool force_enable = false);
 #endif					
 private:
+    class StreamWriter;
+
     static void GenericCallback(struct evhttp_request* req, void* arg);
     void HandleRequest(struct evhttp_request* req);
+    void HandleStreamRequest(const ContextPtr& ctx, const HTTPStreamCallback& cb);
     void DefaultHandleRequest(const ContextPtr& ctx);
     void SendReply(const ContextPtr& ctx, const std::string& response);
 private:
@@ -76,7 +94,7 @@ private:
     struct evhttp* evhttp_;
     struct evhttp_bound_socket* evhttp_bound_socket_;
     EventLoop* listen_loop_;
-    HTTPRequestCallbackMap callbacks_;
+    Router router_;
     HTTPRequestCallback default_callback_;
 
 	// HTTPS 支持
@@ -10,6 +10,10 @@
 #include <signal.h>
 #endif
 
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
 #include <map>
 #include <thread>
 #include <mutex>
@@ -85,4 +89,17 @@ int GetActiveEventCount() {
 #endif
 }
 
+void SetCurrentThreadName(const std::string& name) {
+#ifdef __linux__
+    // The name of a Linux thread is at most 15 characters
+    std::string n = name.substr(0, 15);
+    int rc = pthread_setname_np(pthread_self(), n.c_str());
+    if (rc != 0) {
+        LOG_WARN << "pthread_setname_np failed, name=" << n << " errno=" << rc << " " << strerror(rc);
+    }
+#else
+    (void)name;
+#endif
+}
+
 }
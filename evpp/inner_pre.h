@@ -20,4 +20,8 @@ namespace evpp {
     int EventAdd(struct event* ev, const struct timeval* timeout);
     int EventDel(struct event*);
     EVPP_EXPORT int GetActiveEventCount();
+
+    // Set the name of the calling thread, which is shown by top -H or gdb.
+    // It only works on Linux, and the name is truncated to 15 characters.
+    EVPP_EXPORT void SetCurrentThreadName(const std::string& name);
 }
@@ -6,12 +6,12 @@
 namespace evpp {
 
 InvokeTimer::InvokeTimer(EventLoop* evloop, Duration timeout, const Functor& f, bool periodic)
-    : loop_(evloop), timeout_(timeout), functor_(f), periodic_(periodic) {
+    : loop_(evloop), timeout_(timeout), functor_(f), periodic_(periodic), backend_(evloop->timer_backend()) {
     DLOG_TRACE << "loop=" << loop_;
 }
 
 InvokeTimer::InvokeTimer(EventLoop* evloop, Duration timeout, Functor&& f, bool periodic)
-    : loop_(evloop), timeout_(timeout), functor_(std::move(f)), periodic_(periodic) {
+    : loop_(evloop), timeout_(timeout), functor_(std::move(f)), periodic_(periodic), backend_(evloop->timer_backend()) {
     DLOG_TRACE << "loop=" << loop_;
 }
 
@@ -33,6 +33,14 @@ InvokeTimer::~InvokeTimer() {
 
 void InvokeTimer::Start() {
     DLOG_TRACE << "loop=" << loop_ << " refcount=" << self_.use_count();
+    if (backend_ == kTimingWheel) {
+        // self_ keeps this timer alive until it expires or is canceled
+        loop_->RunInLoop([this]() {
+            loop_->timing_wheel()->Add(this, timeout_);
+        });
+        return;
+    }
+
     auto f = [this]() {
         timer_.reset(new TimerEventWatcher(loop_, [time_weak = std::weak_ptr<InvokeTimer>(shared_from_this())]() {
             auto time_ptr = time_weak.lock();
@@ -58,7 +66,16 @@ void InvokeTimer::Cancel() {
     DLOG_TRACE;
     auto f = [time_weak = std::weak_ptr<InvokeTimer>(shared_from_this())]() {
         auto time_ptr = time_weak.lock();
-        if (time_ptr && time_ptr->timer_) {
+        if (!time_ptr) {
+            return;
+        }
+
+        if (time_ptr->backend_ == kTimingWheel) {
+            if (time_ptr->IsScheduled() || time_ptr->running_) {
+                time_ptr->loop_->timing_wheel()->Remove(time_ptr.get());
+                time_ptr->OnCanceled();
+            }
+        } else if (time_ptr->timer_) {
             time_ptr->timer_->Cancel();
         }
     };
@@ -77,6 +94,21 @@ void InvokeTimer::OnTimerTriggered() {
     }
 }
 
+void InvokeTimer::OnTimeout() {
+    DLOG_TRACE << "loop=" << loop_ << " use_count=" << self_.use_count();
+    // self_ may be reset by the functor or by Cancel, so hold myself here
+    InvokeTimerPtr guard = shared_from_this();
+    running_ = true;
+    functor_();
+    running_ = false;
+
+    if (periodic_) {
+        loop_->timing_wheel()->Add(this, timeout_);
+    } else {
+        self_.reset();
+    }
+}
+
 void InvokeTimer::OnCanceled() {
     DLOG_TRACE << "loop=" << loop_ << " use_count=" << self_.use_count();
     periodic_ = false;
@@ -2,6 +2,7 @@
 
 #include "evpp/inner_pre.h"
 #include "evpp/duration.h"
+#include "evpp/timing_wheel.h"
 
 namespace evpp {
 class EventLoop;
@@ -10,10 +11,16 @@ class InvokeTimer;
 
 typedef std::shared_ptr<InvokeTimer> InvokeTimerPtr;
 
-class EVPP_EXPORT InvokeTimer : public std::enable_shared_from_this<InvokeTimer> {
+class EVPP_EXPORT InvokeTimer : public std::enable_shared_from_this<InvokeTimer>, private TimingWheel::Timer {
 public:
     typedef std::function<void()> Functor;
 
+    // The ways to schedule a timer
+    enum Backend {
+        kLibevent = 0, // A libevent timer for each InvokeTimer, O(log n) to add and cancel
+        kTimingWheel = 1, // An entry of EventLoop::timing_wheel(), O(1) to add and cancel
+    };
+
     // @brief Create a timer. When the timer is timeout, the functor f will
     //  be invoked automatically.
     // @param evloop - The EventLoop runs this timer
@@ -43,12 +50,24 @@ public:
     void set_cancel_callback(const Functor& fn) {
         cancel_callback_ = fn;
     }
+
+    // @brief Choose the way to schedule this timer. The default is
+    //  EventLoop::timer_backend(). It must be called before Start.
+    void set_backend(Backend b) {
+        backend_ = b;
+    }
+    Backend backend() const {
+        return backend_;
+    }
 private:
     InvokeTimer(EventLoop* evloop, Duration timeout, const Functor& f, bool periodic);
     InvokeTimer(EventLoop* evloop, Duration timeout, Functor&& f, bool periodic);
     void OnTimerTriggered();
     void OnCanceled();
 
+    // Called by the timing wheel
+    virtual void OnTimeout();
+
 private:
     EventLoop* loop_;
     Duration timeout_;
@@ -56,6 +75,8 @@ private:
     Functor cancel_callback_;
     std::unique_ptr<TimerEventWatcher> timer_;
     bool periodic_;
+    Backend backend_;
+    bool running_ = false; // Whether functor_ is being invoked by the timing wheel
     std::shared_ptr<InvokeTimer> self_; // Hold myself
 };
 
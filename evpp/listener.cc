@@ -7,16 +7,33 @@
 #include "evpp/sockets.h"
 
 namespace evpp {
+namespace {
+int OpenSpareFd() {
+#ifdef H_OS_WINDOWS
+    return -1;
+#else
+    return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+}
+}
+
 Listener::Listener(EventLoop* l, const std::string& addr)
-    : loop_(l), addr_(addr) {
+    : loop_(l), addr_(addr), stats_(std::make_shared<AcceptStats>()) {
     DLOG_TRACE << "addr=" << addr;
 }
 
 Listener::~Listener() {
-    DLOG_TRACE << "fd=" << chan_->fd();
+    DLOG_TRACE << "fd=" << fd_;
     chan_.reset();
     EVUTIL_CLOSESOCKET(fd_);
     fd_ = INVALID_SOCKET;
+
+#ifndef H_OS_WINDOWS
+    if (spare_fd_ >= 0) {
+        ::close(spare_fd_);
+        spare_fd_ = -1;
+    }
+#endif
 }
 
 void Listener::Listen(int backlog) {
@@ -41,6 +58,8 @@ void Listener::Listen(int backlog) {
         int serrno = errno;
         LOG_FATAL << "Listen failed " << strerror(serrno);
     }
+
+    spare_fd_ = OpenSpareFd();
 }
 
 void Listener::Accept() {
@@ -54,39 +73,68 @@ void Listener::Accept() {
 void Listener::HandleAccept() {
     DLOG_TRACE << "A new connection is comming in";
     assert(loop_->IsInLoopThread());
-    struct sockaddr_storage ss;
-    socklen_t addrlen = sizeof(ss);
-    int nfd = -1;
-    if ((nfd = ::accept(fd_, sock::sockaddr_cast(&ss), &addrlen)) == -1) {
-        int serrno = errno;
-        if (serrno != EAGAIN && serrno != EINTR) {
+    stats_->wakeup_count.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < max_accepts_per_wakeup_; ++i) {
+        struct sockaddr_storage ss;
+        evpp_socket_t nfd = sock::Accept(fd_, &ss);
+        if (nfd < 0) {
+            int serrno = errno;
+            if (EVUTIL_ERR_ACCEPT_RETRIABLE(serrno)) {
+                // The backlog is drained
+                return;
+            }
+
+            stats_->error_count.fetch_add(1, std::memory_order_relaxed);
+#ifndef H_OS_WINDOWS
+            if ((serrno == EMFILE || serrno == ENFILE) && spare_fd_ >= 0) {
+                LOG_ERROR << "accept failed, we run out of file descriptors. Close the new connection at once. listen fd=" << fd_;
+                ShedConnection();
+                continue;
+            }
+#endif
             LOG_WARN << __FUNCTION__ << " bad accept " << strerror(serrno);
+            return;
         }
-        return;
-    }
 
-    if (evutil_make_socket_nonblocking(nfd) < 0) {
-        LOG_ERROR << "set fd=" << nfd << " nonblocking failed.";
-        EVUTIL_CLOSESOCKET(nfd);
-        return;
-    }
+#ifndef __linux__
+        // SO_KEEPALIVE is inherited from the listening socket on Linux
+        sock::SetKeepAlive(nfd, true);
+#endif
 
-    sock::SetKeepAlive(nfd, true);
+        std::string raddr = sock::ToIPPort(&ss);
+        if (raddr.empty()) {
+            LOG_ERROR << "sock::ToIPPort(&ss) failed.";
+            EVUTIL_CLOSESOCKET(nfd);
+            continue;
+        }
 
-    std::string raddr = sock::ToIPPort(&ss);
-    if (raddr.empty()) {
-        LOG_ERROR << "sock::ToIPPort(&ss) failed.";
-        EVUTIL_CLOSESOCKET(nfd);
-        return;
-    }
+        DLOG_TRACE << "accepted a connection from " << raddr
+            << ", listen fd=" << fd_
+            << ", client fd=" << nfd;
 
-    DLOG_TRACE << "accepted a connection from " << raddr
-        << ", listen fd=" << fd_
-        << ", client fd=" << nfd;
+        stats_->accepted_count.fetch_add(1, std::memory_order_relaxed);
+        if (new_conn_fn_) {
+            new_conn_fn_(nfd, raddr, sock::sockaddr_in_cast(&ss));
+        }
+    }
+}
 
-    if (new_conn_fn_) {
-        new_conn_fn_(nfd, raddr, sock::sockaddr_in_cast(&ss));
+void Listener::ShedConnection() {
+#ifndef H_OS_WINDOWS
+    ::close(spare_fd_);
+    spare_fd_ = -1;
+    evpp_socket_t nfd = ::accept(fd_, nullptr, nullptr);
+    if (nfd >= 0) {
+        ::close(nfd);
+        stats_->shed_count.fetch_add(1, std::memory_order_relaxed);
     }
+    spare_fd_ = OpenSpareFd();
+#endif
+}
+
+void Listener::SetIncomingCPU(int cpu) {
+    assert(fd_ >= 0);
+    sock::SetIncomingCPU(fd_, cpu);
 }
 
 void Listener::Stop() {
@@ -94,4 +142,18 @@ void Listener::Stop() {
     chan_->DisableAllEvent();
     chan_->Close();
 }
+
+void Listener::Pause() {
+    assert(loop_->IsInLoopThread());
+    if (chan_->IsReadable()) {
+        chan_->DisableReadEvent();
+    }
+}
+
+void Listener::Continue() {
+    assert(loop_->IsInLoopThread());
+    if (!chan_->IsReadable()) {
+        chan_->EnableReadEvent();
+    }
+}
 }
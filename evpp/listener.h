@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "evpp/inner_pre.h"
 #include "evpp/timestamp.h"
 
@@ -7,6 +9,15 @@ namespace evpp {
 class EventLoop;
 class FdChannel;
 
+// The statistics of the accepted connections. They can be read in any thread,
+// the accept rate is the increment of accepted_count in a period.
+struct AcceptStats {
+    std::atomic<uint64_t> wakeup_count = { 0 }; // The count of the readable events of the listening sockets
+    std::atomic<uint64_t> accepted_count = { 0 };
+    std::atomic<uint64_t> shed_count = { 0 }; // The connections closed at once because we run out of fds
+    std::atomic<uint64_t> error_count = { 0 }; // The failed accept calls except EAGAIN
+};
+
 class EVPP_EXPORT Listener {
 public:
     typedef std::function <
@@ -25,19 +36,61 @@ public:
 
     void Stop();
 
+    // @brief Stop accepting new connections for a while. The connections
+    //  are queued in the backlog of the listening socket.
+    //  It must be called in the thread of loop after Accept().
+    void Pause();
+
+    // @brief Accept new connections again after Pause().
+    void Continue();
+
     void SetNewConnectionCallback(NewConnectionCallback cb) {
         new_conn_fn_ = cb;
     }
 
+    // @brief Set the max count of connections accepted in one readable event.
+    //  A bigger batch drains a reconnect storm with less wakeups, while one
+    //  accept is fairer to the connections served by the same EventLoop.
+    //  The default is 1.
+    void SetMaxAcceptsPerWakeup(int n) {
+        assert(n > 0);
+        max_accepts_per_wakeup_ = n;
+    }
+
+    // Share the statistics with other listeners. It must be called before Accept().
+    void SetAcceptStats(const std::shared_ptr<AcceptStats>& s) {
+        stats_ = s;
+    }
+
+    const std::shared_ptr<AcceptStats>& stats() const {
+        return stats_;
+    }
+
+    EventLoop* loop() const {
+        return loop_;
+    }
+
+    // @brief See sock::SetIncomingCPU. It must be called after Listen().
+    void SetIncomingCPU(int cpu);
+
 private:
     void HandleAccept();
 
+    // Accept and close one pending connection with the reserved fd,
+    // so it does not stay in the backlog and wake us up again and again.
+    void ShedConnection();
+
 private:
     evpp_socket_t fd_ = -1;// The listening socket fd
     EventLoop* loop_;
     std::string addr_;
     std::unique_ptr<FdChannel> chan_;
     NewConnectionCallback new_conn_fn_;
+    int max_accepts_per_wakeup_ = 1;
+    std::shared_ptr<AcceptStats> stats_;
+
+    // A fd reserved to be released when we run out of fds
+    int spare_fd_ = -1;
 };
 }
 
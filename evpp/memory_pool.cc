@@ -0,0 +1,70 @@
+#include "evpp/inner_pre.h"
+
+#include "evpp/memory_pool.h"
+
+namespace evpp {
+
+const size_t MemoryPool::kDefaultMaxCachedCount = 1024;
+
+MemoryPool::MemoryPool(size_t max_cached_count)
+    : block_size_(0)
+    , max_cached_count_(max_cached_count)
+    , local_free_(nullptr)
+    , remote_free_(nullptr)
+    , cached_count_(0)
+    , hit_count_(0)
+    , miss_count_(0) {}
+
+MemoryPool::~MemoryPool() {
+    FreeList(local_free_);
+    FreeList(remote_free_.exchange(nullptr));
+}
+
+void MemoryPool::FreeList(FreeBlock* b) {
+    while (b) {
+        FreeBlock* next = b->next;
+        ::operator delete(b);
+        b = next;
+    }
+}
+
+void* MemoryPool::Allocate(size_t n) {
+    if (block_size_ == 0) {
+        block_size_ = std::max(n, sizeof(FreeBlock));
+    }
+
+    if (n <= block_size_) {
+        if (!local_free_) {
+            // Take all the blocks deallocated by the other threads
+            local_free_ = remote_free_.exchange(nullptr, std::memory_order_acquire);
+        }
+
+        if (local_free_) {
+            FreeBlock* b = local_free_;
+            local_free_ = b->next;
+            cached_count_.fetch_sub(1, std::memory_order_relaxed);
+            hit_count_.store(hit_count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return b;
+        }
+    }
+
+    miss_count_.store(miss_count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return ::operator new(std::max(n, block_size_));
+}
+
+void MemoryPool::Deallocate(void* p, size_t n) {
+    assert(p);
+    if (n > block_size_ || cached_count_.load(std::memory_order_relaxed) >= max_cached_count_) {
+        ::operator delete(p);
+        return;
+    }
+
+    cached_count_.fetch_add(1, std::memory_order_relaxed);
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = remote_free_.load(std::memory_order_relaxed);
+    while (!remote_free_.compare_exchange_weak(b->next, b,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+    }
+}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+
+#include "evpp/inner_pre.h"
+
+namespace evpp {
+
+// MemoryPool caches the memory blocks of one size, which is the size of
+// the first allocation. It serves the objects created over and over again
+// in an EventLoop, such as TCPConn and FdChannel.
+//
+// The blocks must be allocated in one thread, the owner thread of the pool,
+// but they can be deallocated in any thread : an object is usually created in
+// its IO thread and destructed in the thread which drops the last reference.
+// The deallocated blocks are pushed into a lock-free list, which is taken
+// by the owner thread as a whole when its own free list is empty.
+class EVPP_EXPORT MemoryPool {
+public:
+    static const size_t kDefaultMaxCachedCount; // = 1024
+
+    explicit MemoryPool(size_t max_cached_count = kDefaultMaxCachedCount);
+    ~MemoryPool();
+
+    // Allocate returns a block of n bytes. It must be called in the owner thread.
+    // The blocks bigger than the block size are allocated from the system.
+    void* Allocate(size_t n);
+
+    // Deallocate gives back a block returned by Allocate(n).
+    // It can be called in any thread.
+    void Deallocate(void* p, size_t n);
+
+    // The block size, or 0 if nothing has been allocated
+    size_t block_size() const {
+        return block_size_;
+    }
+
+    // The count of blocks cached in the free lists
+    size_t cached_count() const {
+        return cached_count_.load(std::memory_order_relaxed);
+    }
+
+    // The count of allocations served by the free lists
+    uint64_t hit_count() const {
+        return hit_count_.load(std::memory_order_relaxed);
+    }
+
+    // The count of allocations served by the system
+    uint64_t miss_count() const {
+        return miss_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static void FreeList(FreeBlock* b);
+
+private:
+    size_t block_size_;
+    size_t max_cached_count_;
+
+    // The free list only accessed in the owner thread
+    FreeBlock* local_free_;
+
+    // The blocks deallocated in any thread
+    std::atomic<FreeBlock*> remote_free_;
+
+    std::atomic<size_t> cached_count_;
+    std::atomic<uint64_t> hit_count_;
+    std::atomic<uint64_t> miss_count_;
+};
+
+// PoolAllocator is a std allocator on a MemoryPool, it is used with
+// std::allocate_shared to create the objects and their reference counts in
+// one pooled block. It holds a reference of the pool, so the pool is
+// alive until all the objects allocated from it are destructed.
+template<typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    explicit PoolAllocator(const std::shared_ptr<MemoryPool>& pool) : pool_(pool) {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& rhs) : pool_(rhs.pool()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(pool_->Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        pool_->Deallocate(p, n * sizeof(T));
+    }
+
+    const std::shared_ptr<MemoryPool>& pool() const {
+        return pool_;
+    }
+
+    template<typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+private:
+    std::shared_ptr<MemoryPool> pool_;
+};
+
+template<typename T, typename U>
+inline bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return lhs.pool() == rhs.pool();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return lhs.pool() != rhs.pool();
+}
+}
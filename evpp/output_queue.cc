@@ -0,0 +1,243 @@
+#include "evpp/inner_pre.h"
+
+#include <limits.h>
+
+#include "evpp/output_queue.h"
+#include "evpp/buffer_pool.h"
+#include "evpp/sockets.h"
+
+namespace evpp {
+
+const size_t OutputQueue::kMaxCopySize = 512;
+
+#if defined(IOV_MAX) && IOV_MAX < 1024
+const int OutputQueue::kMaxIOVecCount = IOV_MAX;
+#else
+const int OutputQueue::kMaxIOVecCount = 1024;
+#endif
+
+OutputQueue::OutputQueue(BufferPool* pool) : pool_(pool), length_(0), file_length_(0) {}
+
+OutputQueue::~OutputQueue() {
+    Reset();
+}
+
+void OutputQueue::Append(const void* d, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    TailBuffer()->Append(d, len);
+    length_ += len;
+}
+
+void OutputQueue::Append(std::string&& s, size_t offset) {
+    assert(offset <= s.size());
+    size_t len = s.size() - offset;
+    if (len <= kMaxCopySize) {
+        Append(s.data() + offset, len);
+        return;
+    }
+
+    // Move the string object to the heap. The characters are not copied.
+    std::shared_ptr<std::string> p = std::make_shared<std::string>(std::move(s));
+    Chunk c;
+    c.data = Slice(p->data() + offset, len);
+    c.holder = std::move(p);
+    chunks_.push_back(std::move(c));
+    length_ += len;
+}
+
+void OutputQueue::Append(const StringPtr& s, size_t offset) {
+    assert(s);
+    assert(offset <= s->size());
+    size_t len = s->size() - offset;
+    if (len <= kMaxCopySize) {
+        Append(s->data() + offset, len);
+        return;
+    }
+
+    Chunk c;
+    c.data = Slice(s->data() + offset, len);
+    c.holder = s;
+    chunks_.push_back(std::move(c));
+    length_ += len;
+}
+
+void OutputQueue::Append(Buffer&& buf) {
+    size_t len = buf.length();
+    if (len <= kMaxCopySize) {
+        Append(buf.data(), len);
+        buf.Reset();
+        return;
+    }
+
+    // The moved Buffer becomes the new tail, so the following small
+    // pieces of data can still be coalesced into it.
+    Chunk c;
+    c.buffer.reset(new Buffer(std::move(buf)));
+    chunks_.push_back(std::move(c));
+    length_ += len;
+}
+
+void OutputQueue::AppendFile(int fd, int64_t offset, size_t len, const FileDoneCallback& cb) {
+    assert(fd >= 0);
+    if (len == 0) {
+        if (cb) {
+            cb(true);
+        }
+        return;
+    }
+
+    Chunk c;
+    c.file_fd = fd;
+    c.file_offset = offset;
+    c.file_length = len;
+    c.file_done = cb;
+    chunks_.push_back(std::move(c));
+    length_ += len;
+    file_length_ += len;
+}
+
+void OutputQueue::Reserve(size_t len) {
+    if (!chunks_.empty() && chunks_.back().buffer) {
+        chunks_.back().buffer->EnsureWritableBytes(len);
+        return;
+    }
+
+    if (!spare_) {
+        spare_.reset(NewBuffer());
+    }
+    spare_->EnsureWritableBytes(len);
+}
+
+size_t OutputQueue::memory_usage() const {
+    size_t n = spare_ ? spare_->capacity() : 0;
+    for (auto it = chunks_.begin(); it != chunks_.end(); ++it) {
+        if (it->buffer) {
+            n += it->buffer->capacity();
+        } else if (!it->IsFile()) {
+            n += it->data.size();
+        }
+    }
+    return n;
+}
+
+ssize_t OutputQueue::WriteToFD(evpp_socket_t fd, int* saved_errno) {
+    if (!chunks_.empty() && chunks_.front().IsFile()) {
+        return SendFileToFD(fd, saved_errno);
+    }
+
+    // Gather the memory chunks before the first file region
+    struct iovec vec[kMaxIOVecCount];
+    int iovcnt = 0;
+    for (auto it = chunks_.begin(); it != chunks_.end() && !it->IsFile() && iovcnt < kMaxIOVecCount; ++it) {
+        vec[iovcnt].iov_base = const_cast<char*>(it->ptr());
+        vec[iovcnt].iov_len = it->size();
+        ++iovcnt;
+    }
+
+    if (iovcnt == 0) {
+        return 0;
+    }
+
+    const ssize_t n = sock::WriteV(fd, vec, iovcnt);
+    if (n < 0) {
+        *saved_errno = errno;
+    } else {
+        Skip(static_cast<size_t>(n));
+    }
+
+    return n;
+}
+
+ssize_t OutputQueue::SendFileToFD(evpp_socket_t fd, int* saved_errno) {
+    const Chunk& c = chunks_.front();
+    const ssize_t n = sock::SendFile(fd, c.file_fd, c.file_offset, c.file_length);
+    if (n < 0) {
+        *saved_errno = errno;
+    } else if (n == 0) {
+        // The file is shorter than the region, the rest can never be sent
+        LOG_ERROR << "sendfile reached the end of file fd=" << c.file_fd << " offset=" << c.file_offset << " remaining length=" << c.file_length;
+        *saved_errno = EIO;
+        return -1;
+    } else {
+        Skip(static_cast<size_t>(n));
+    }
+
+    return n;
+}
+
+void OutputQueue::Skip(size_t len) {
+    len = std::min(len, length_);
+    length_ -= len;
+    while (len > 0) {
+        assert(!chunks_.empty());
+        Chunk& c = chunks_.front();
+        size_t n = c.size();
+        if (len < n) {
+            if (c.IsFile()) {
+                c.file_offset += len;
+                c.file_length -= len;
+                file_length_ -= len;
+            } else if (c.buffer) {
+                c.buffer->Skip(len);
+            } else {
+                c.data.remove_prefix(len);
+            }
+            return;
+        }
+
+        len -= n;
+        PopFront(true);
+    }
+}
+
+void OutputQueue::Reset() {
+    while (!chunks_.empty()) {
+        PopFront(false);
+    }
+    length_ = 0;
+    file_length_ = 0;
+}
+
+Buffer* OutputQueue::TailBuffer() {
+    if (chunks_.empty() || !chunks_.back().buffer) {
+        Chunk c;
+        if (spare_) {
+            c.buffer = std::move(spare_);
+        } else {
+            c.buffer.reset(NewBuffer());
+        }
+        chunks_.push_back(std::move(c));
+    }
+
+    return chunks_.back().buffer.get();
+}
+
+Buffer* OutputQueue::NewBuffer() {
+    // The storage of a pooled Buffer is allocated when it is written at the first time
+    return pool_ ? new Buffer(*pool_) : new Buffer;
+}
+
+void OutputQueue::PopFront(bool completed) {
+    Chunk& c = chunks_.front();
+    if (c.buffer && !spare_) {
+        c.buffer->Reset();
+        spare_ = std::move(c.buffer);
+    }
+
+    FileDoneCallback cb;
+    if (c.IsFile()) {
+        file_length_ -= c.file_length;
+        cb.swap(c.file_done);
+    }
+
+    chunks_.pop_front();
+
+    // Invoke the callback at last, the queue is in a consistent state now
+    if (cb) {
+        cb(completed);
+    }
+}
+}
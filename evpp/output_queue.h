@@ -0,0 +1,163 @@
+#pragma once
+
+#include <deque>
+
+#include "evpp/inner_pre.h"
+#include "evpp/buffer.h"
+#include "evpp/slice.h"
+
+namespace evpp {
+
+class BufferPool;
+
+// OutputQueue holds the data which is waiting to be written to a socket.
+//
+// Instead of one contiguous Buffer, it is a list of chunks:
+//      1. Small pieces of data are copied and coalesced into a Buffer owned by the queue
+//      2. A big std::string is moved into the queue
+//      3. A shared immutable block is only referenced
+//      4. A region of a file which is sent by sendfile(2) when it reaches the front
+// So the payload is never copied again after it was handed to the queue,
+// and the memory chunks can be flushed by one writev call.
+//
+// It is not thread safe. It must be accessed in the IO thread of its owner.
+class EVPP_EXPORT OutputQueue {
+public:
+    typedef std::shared_ptr<const std::string> StringPtr;
+
+    // The callback of a file region. It is invoked when the region leaves
+    // the queue, completed is false if it is dropped before totally sent.
+    // It must not modify the queue.
+    typedef std::function<void(bool completed)> FileDoneCallback;
+
+    // The data which is not longer than kMaxCopySize is copied into the tail Buffer
+    static const size_t kMaxCopySize;
+
+    // The max count of chunks flushed by one WriteToFD call
+    static const int kMaxIOVecCount;
+
+    // The Buffers owned by this queue allocate their storage from pool if it is not nullptr
+    explicit OutputQueue(BufferPool* pool = nullptr);
+    ~OutputQueue();
+
+    // Append copies the data into the tail Buffer of this queue
+    void Append(const void* /*restrict*/ d, size_t len);
+
+    void Append(const Slice& s) {
+        Append(s.data(), s.size());
+    }
+
+    // Append takes the ownership of s without copying it.
+    // The first offset bytes of s are dropped.
+    void Append(std::string&& s, size_t offset = 0);
+
+    // Append holds a reference of s without copying it.
+    // The first offset bytes of s are dropped.
+    void Append(const StringPtr& s, size_t offset = 0);
+
+    // Append takes the underlying storage of buf without copying it.
+    // buf is left empty.
+    void Append(Buffer&& buf);
+
+    // AppendFile appends the region [offset, offset + len) of the file fd.
+    // The queue does not own fd, the caller must keep it open until cb is invoked.
+    void AppendFile(int fd, int64_t offset, size_t len, const FileDoneCallback& cb);
+
+    // Reserve makes sure the next len bytes copied into this queue
+    // will not cause the tail Buffer to grow.
+    void Reserve(size_t len);
+
+    // WriteToFD writes as much data as possible to fd with one writev call,
+    // or one sendfile call if a file region is at the front of the queue,
+    // and return result of the call, errno is saved into saved_errno.
+    // The written data is removed from the queue.
+    ssize_t WriteToFD(evpp_socket_t fd, int* saved_errno);
+
+    // Skip drops the first len bytes from the queue
+    void Skip(size_t len);
+
+    // Reset drops all the data in the queue.
+    // The callbacks of the dropped file regions are invoked with completed=false.
+    void Reset();
+
+    // Shrink releases the storage of the drained Buffer kept for reuse
+    void Shrink() {
+        spare_.reset();
+    }
+
+    // length returns the count of bytes in the queue, including the file regions
+    size_t length() const {
+        return length_;
+    }
+
+    // buffered_length returns the count of bytes held in memory
+    size_t buffered_length() const {
+        return length_ - file_length_;
+    }
+
+    size_t size() const {
+        return length_;
+    }
+
+    bool empty() const {
+        return length_ == 0;
+    }
+
+    size_t chunk_count() const {
+        return chunks_.size();
+    }
+
+    // memory_usage returns the count of bytes held by this queue, which is
+    // the capacity of the Buffers plus the size of the referenced blocks
+    size_t memory_usage() const;
+
+private:
+    struct Chunk {
+        // The Buffer owned by this queue. It can still be appended
+        // when it is the last chunk of the queue.
+        std::unique_ptr<Buffer> buffer;
+
+        // Or the read-only memory referenced by data which is kept alive by holder
+        std::shared_ptr<const void> holder;
+        Slice data;
+
+        // Or the region of a file
+        int file_fd = -1;
+        int64_t file_offset = 0;
+        size_t file_length = 0;
+        FileDoneCallback file_done;
+
+        bool IsFile() const {
+            return file_fd >= 0;
+        }
+
+        const char* ptr() const {
+            return buffer ? buffer->data() : data.data();
+        }
+
+        size_t size() const {
+            if (IsFile()) {
+                return file_length;
+            }
+            return buffer ? buffer->length() : data.size();
+        }
+    };
+
+    Buffer* TailBuffer();
+    Buffer* NewBuffer();
+    void PopFront(bool completed);
+    ssize_t SendFileToFD(evpp_socket_t fd, int* saved_errno);
+
+private:
+    BufferPool* pool_;
+    std::deque<Chunk> chunks_;
+
+    // A drained Buffer kept to reuse its storage
+    std::unique_ptr<Buffer> spare_;
+
+    size_t length_;
+
+    // The count of bytes of the file regions in the queue
+    size_t file_length_;
+};
+}
@@ -0,0 +1,89 @@
+#include "evpp/inner_pre.h"
+
+#include "evpp/read_size_predictor.h"
+
+#include <vector>
+
+namespace evpp {
+
+const size_t ReadSizePredictor::kDefaultMinimum = 64;
+const size_t ReadSizePredictor::kDefaultInitial = 1024;
+const size_t ReadSizePredictor::kDefaultMaximum = 65536;
+
+namespace {
+const size_t kIndexIncrement = 4;
+const size_t kIndexDecrement = 1;
+
+// 16, 32, 48, ..., 496, 512, 1024, 2048, ..., 1G
+class SizeTable {
+public:
+    SizeTable() {
+        for (size_t i = 16; i < 512; i += 16) {
+            sizes_.push_back(i);
+        }
+
+        for (size_t i = 512; i > 0 && i <= (size_t(1) << 30); i <<= 1) {
+            sizes_.push_back(i);
+        }
+    }
+
+    size_t size() const {
+        return sizes_.size();
+    }
+
+    size_t operator[](size_t index) const {
+        return sizes_[index];
+    }
+
+    // Return the index of the smallest size which is not less than n
+    size_t IndexOf(size_t n) const {
+        size_t low = 0;
+        size_t high = sizes_.size() - 1;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (sizes_[mid] < n) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+private:
+    std::vector<size_t> sizes_;
+};
+
+const SizeTable& GetSizeTable() {
+    static const SizeTable table;
+    return table;
+}
+}
+
+ReadSizePredictor::ReadSizePredictor(size_t initial, size_t minimum, size_t maximum)
+    : decrease_now_(false) {
+    assert(minimum > 0 && minimum <= initial && initial <= maximum);
+    const SizeTable& table = GetSizeTable();
+    min_index_ = table.IndexOf(minimum);
+    max_index_ = table.IndexOf(maximum);
+    index_ = table.IndexOf(initial);
+    next_ = table[index_];
+}
+
+void ReadSizePredictor::Record(size_t actual) {
+    const SizeTable& table = GetSizeTable();
+    if (actual <= table[index_ > kIndexDecrement ? index_ - kIndexDecrement : 0]) {
+        if (decrease_now_) {
+            index_ = std::max(index_ > kIndexDecrement ? index_ - kIndexDecrement : 0, min_index_);
+            next_ = table[index_];
+            decrease_now_ = false;
+        } else {
+            decrease_now_ = true;
+        }
+    } else if (actual >= next_) {
+        index_ = std::min(index_ + kIndexIncrement, max_index_);
+        next_ = table[index_];
+        decrease_now_ = false;
+    }
+}
+}
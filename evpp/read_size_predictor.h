@@ -0,0 +1,40 @@
+#pragma once
+
+#include "evpp/inner_pre.h"
+
+namespace evpp {
+
+// ReadSizePredictor guesses how many bytes the next read of a connection
+// will get, so that we can make enough room in the input buffer before reading.
+//
+// It works like the AdaptiveRecvByteBufAllocator of netty :
+// the guess grows quickly when a read fills it up, and shrinks slowly
+// after two consecutive reads which are much smaller than it.
+//
+// It is not thread safe.
+class EVPP_EXPORT ReadSizePredictor {
+public:
+    static const size_t kDefaultMinimum;  // = 64
+    static const size_t kDefaultInitial;  // = 1024
+    static const size_t kDefaultMaximum;  // = 65536
+
+    explicit ReadSizePredictor(size_t initial = kDefaultInitial,
+                               size_t minimum = kDefaultMinimum,
+                               size_t maximum = kDefaultMaximum);
+
+    // The count of bytes expected by the next read
+    size_t next() const {
+        return next_;
+    }
+
+    // Record the count of bytes actually read
+    void Record(size_t actual);
+
+private:
+    size_t min_index_;
+    size_t max_index_;
+    size_t index_;
+    size_t next_;
+    bool decrease_now_;
+};
+}
@@ -86,6 +86,12 @@ public:
     //   >  0 if "*this" >  "b"
     int compare(const Slice& b) const;
 
+    // Return true if "x" is a prefix of "*this"
+    bool starts_with(const Slice& x) const {
+        return ((size_ >= x.size_) &&
+                (memcmp(data_, x.data_, x.size_) == 0));
+    }
+
 private:
     const char* data_;
     size_t size_;
@@ -4,6 +4,10 @@
 #include "evpp/sockets.h"
 #include "evpp/duration.h"
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
 namespace evpp {
 
 static const std::string empty_string;
@@ -303,6 +307,103 @@ void SetReusePort(evpp_socket_t fd) {
 #endif
 }
 
+void SetBusyPoll(evpp_socket_t fd, const Duration& timeout) {
+#ifdef SO_BUSY_POLL
+    int optval = static_cast<int>(timeout.Microseconds());
+    int rc = ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                          reinterpret_cast<const char*>(&optval), static_cast<socklen_t>(sizeof optval));
+    if (rc != 0) {
+        int serrno = errno;
+        LOG_WARN << "setsockopt(SO_BUSY_POLL) failed, errno=" << serrno << " " << strerror(serrno);
+    }
+#endif
+}
+
+int GetIncomingCPU(evpp_socket_t fd) {
+#ifdef SO_INCOMING_CPU
+    int cpu = -1;
+    socklen_t len = static_cast<socklen_t>(sizeof cpu);
+    if (::getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, reinterpret_cast<char*>(&cpu), &len) == 0) {
+        return cpu;
+    }
+#endif
+    return -1;
+}
+
+void SetIncomingCPU(evpp_socket_t fd, int cpu) {
+#ifdef SO_INCOMING_CPU
+    int rc = ::setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU,
+                          reinterpret_cast<const char*>(&cpu), static_cast<socklen_t>(sizeof cpu));
+    if (rc != 0) {
+        int serrno = errno;
+        LOG_WARN << "setsockopt(SO_INCOMING_CPU) failed, errno=" << serrno << " " << strerror(serrno);
+    }
+#endif
+}
+
+
+ssize_t WriteV(evpp_socket_t fd, const struct iovec* iov, int iovcnt) {
+#ifdef H_OS_WINDOWS
+    DWORD sent = 0;
+    if (::WSASend(fd, const_cast<struct iovec*>(iov), iovcnt, &sent, 0, nullptr, nullptr) == 0) {
+        return sent;
+    }
+
+    return -1;
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+    return ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+#endif
+}
+
+evpp_socket_t Accept(evpp_socket_t listen_fd, struct sockaddr_storage* ss) {
+    socklen_t addrlen = static_cast<socklen_t>(sizeof(*ss));
+#if defined(__linux__)
+    return ::accept4(listen_fd, sockaddr_cast(ss), &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    evpp_socket_t fd = ::accept(listen_fd, sockaddr_cast(ss), &addrlen);
+    if (fd < 0) {
+        return fd;
+    }
+
+    if (evutil_make_socket_nonblocking(fd) < 0) {
+        int serrno = errno;
+        LOG_ERROR << "set fd=" << fd << " nonblocking failed.";
+        EVUTIL_CLOSESOCKET(fd);
+        errno = serrno;
+        return INVALID_SOCKET;
+    }
+
+    evutil_make_socket_closeonexec(fd);
+    return fd;
+#endif
+}
+
+ssize_t SendFile(evpp_socket_t sockfd, int fd, int64_t offset, size_t count) {
+#if defined(__linux__)
+    off_t off = static_cast<off_t>(offset);
+    return ::sendfile(sockfd, fd, &off, count);
+#else
+    char buf[64 * 1024];
+    count = std::min(count, sizeof(buf));
+#ifdef H_OS_WINDOWS
+    if (::_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    int n = ::_read(fd, buf, static_cast<unsigned int>(count));
+#else
+    ssize_t n = ::pread(fd, buf, count, static_cast<off_t>(offset));
+#endif
+    if (n <= 0) {
+        return n;
+    }
+
+    return ::send(sockfd, buf, n, MSG_NOSIGNAL);
+#endif
+}
 
 void SetTCPNoDelay(evpp_socket_t fd, bool on) {
     int optval = on ? 1 : 0;
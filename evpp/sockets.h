@@ -19,6 +19,18 @@ EVPP_EXPORT void SetKeepAlive(evpp_socket_t fd, bool on);
 EVPP_EXPORT void SetReuseAddr(evpp_socket_t fd);
 EVPP_EXPORT void SetReusePort(evpp_socket_t fd);
 EVPP_EXPORT void SetTCPNoDelay(evpp_socket_t fd, bool on);
+
+// @brief Set SO_BUSY_POLL, the time to busy poll the device queue when the
+//  socket is read and there is no data. It does nothing if it is not supported.
+EVPP_EXPORT void SetBusyPoll(evpp_socket_t fd, const Duration& timeout);
+
+// @brief Return the CPU which handled the packets received by the socket
+//  (SO_INCOMING_CPU), or -1 if it is unknown or not supported.
+EVPP_EXPORT int GetIncomingCPU(evpp_socket_t fd);
+
+// @brief Set SO_INCOMING_CPU of a listening socket in a SO_REUSEPORT group,
+//  so the kernel prefers it for the connections received by cpu.
+EVPP_EXPORT void SetIncomingCPU(evpp_socket_t fd, int cpu);
 EVPP_EXPORT void SetTimeout(evpp_socket_t fd, uint32_t timeout_ms);
 EVPP_EXPORT void SetTimeout(evpp_socket_t fd, const Duration& timeout);
 EVPP_EXPORT std::string ToIPPort(const struct sockaddr_storage* ss);
@@ -26,6 +38,25 @@ EVPP_EXPORT std::string ToIPPort(const struct sockaddr* ss);
 EVPP_EXPORT std::string ToIPPort(const struct sockaddr_in* ss);
 EVPP_EXPORT std::string ToIP(const struct sockaddr* ss);
 
+// @brief Accept a connection on the listening socket listen_fd.
+//  The new socket is nonblocking and close-on-exec. It is done by one
+//  accept4(2) call on Linux.
+// @param[out] ss - The remote address
+// @return evpp_socket_t - The new socket, or a negative value on error with errno set.
+EVPP_EXPORT evpp_socket_t Accept(evpp_socket_t listen_fd, struct sockaddr_storage* ss);
+
+// @brief Gather write the iovcnt buffers described by iov to the socket fd
+//  with one system call. Unlike ::writev, it never raises SIGPIPE.
+// @return ssize_t - The count of bytes written, or -1 on error with errno set.
+EVPP_EXPORT ssize_t WriteV(evpp_socket_t fd, const struct iovec* iov, int iovcnt);
+
+// @brief Send at most count bytes of the file fd starting from offset to
+//  the socket sockfd. It uses sendfile(2) on Linux so that the data is not
+//  copied to the user space, and falls back to read and send on other platforms.
+// @return ssize_t - The count of bytes sent, 0 if offset is at the end of
+//  the file, or -1 on error with errno set.
+EVPP_EXPORT ssize_t SendFile(evpp_socket_t sockfd, int fd, int64_t offset, size_t count);
+
 
 // @brief Parse a literal network address and return an internet protocol family address
 // @param[in] address - A network address of the form "host:port" or "[host]:port"
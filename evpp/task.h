@@ -0,0 +1,181 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "evpp/inner_pre.h"
+
+namespace evpp {
+
+// Task is a move-only callable object of the signature void(). It is the
+// type of the functors queued into an EventLoop by RunInLoop and QueueInLoop.
+//
+// A callable object of kInlineSize bytes or less is stored inside the Task
+// itself, so posting a lambda or a std::bind which captures a few
+// shared_ptrs and strings does not allocate any memory, while std::function
+// only keeps 16 bytes inline. The bigger ones are allocated from the heap.
+//
+// The callable object is moved when the Task is moved, so it is stored
+// inline only if it can be moved without throwing. Note that a lambda which
+// captures a const std::string by copy, e.g. a const reference parameter, has
+// a const member and is copied instead of moved, so it is allocated from the heap.
+//
+// Unlike std::function, a Task can also hold a move-only callable object.
+//
+// Usage :
+//
+//    TCPConnPtr conn = ...;
+//    std::string message = ...;
+//    Task t([conn, message]() { conn->Send(message); });
+//    t();
+//
+class Task {
+public:
+    enum { kInlineSize = 112, }; // sizeof(Task) == 128 on 64-bit platforms
+
+    Task() : ops_(nullptr) {}
+
+    template<typename F,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) : ops_(nullptr) {
+        typedef typename std::decay<F>::type Fn;
+        Manager<Fn, FitsInline<Fn>::value>::Init(&storage_, std::forward<F>(f));
+        ops_ = &Manager<Fn, FitsInline<Fn>::value>::ops;
+    }
+
+    Task(Task&& rhs) noexcept : ops_(rhs.ops_) {
+        if (ops_) {
+            ops_->move(&rhs.storage_, &storage_);
+            rhs.ops_ = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& rhs) noexcept {
+        if (this != &rhs) {
+            Reset();
+            if (rhs.ops_) {
+                rhs.ops_->move(&rhs.storage_, &storage_);
+                ops_ = rhs.ops_;
+                rhs.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~Task() {
+        Reset();
+    }
+
+    void operator()() {
+        assert(ops_);
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const {
+        return ops_ != nullptr;
+    }
+
+    // Destroy the callable object and the objects captured by it
+    void Reset() {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    // Return true if the callable object is stored inside this Task
+    bool IsInline() const {
+        return ops_ && ops_->is_inline;
+    }
+
+private:
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    typedef std::aligned_storage<kInlineSize>::type Storage;
+
+    struct Ops {
+        void (*invoke)(Storage* s);
+        void (*move)(Storage* from, Storage* to); // Move the object and destroy the moved-from one
+        void (*destroy)(Storage* s);
+        bool is_inline;
+    };
+
+    template<typename Fn>
+    struct FitsInline {
+        enum {
+            value = sizeof(Fn) <= sizeof(Storage)
+                    && std::alignment_of<Storage>::value % std::alignment_of<Fn>::value == 0
+                    && std::is_nothrow_move_constructible<Fn>::value
+        };
+    };
+
+    template<typename Fn, bool Inline>
+    struct Manager;
+
+    template<typename Fn>
+    struct Manager<Fn, true> {
+        template<typename F>
+        static void Init(Storage* s, F&& f) {
+            new (s) Fn(std::forward<F>(f));
+        }
+        static Fn* Get(Storage* s) {
+            return reinterpret_cast<Fn*>(s);
+        }
+        static void Invoke(Storage* s) {
+            (*Get(s))();
+        }
+        static void Move(Storage* from, Storage* to) {
+            new (to) Fn(std::move(*Get(from)));
+            Get(from)->~Fn();
+        }
+        static void Destroy(Storage* s) {
+            Get(s)->~Fn();
+        }
+        static const Ops ops;
+    };
+
+    // The storage holds a pointer to the object allocated from the heap
+    template<typename Fn>
+    struct Manager<Fn, false> {
+        template<typename F>
+        static void Init(Storage* s, F&& f) {
+            *Get(s) = new Fn(std::forward<F>(f));
+        }
+        static Fn** Get(Storage* s) {
+            return reinterpret_cast<Fn**>(s);
+        }
+        static void Invoke(Storage* s) {
+            (**Get(s))();
+        }
+        static void Move(Storage* from, Storage* to) {
+            *Get(to) = *Get(from);
+        }
+        static void Destroy(Storage* s) {
+            delete *Get(s);
+        }
+        static const Ops ops;
+    };
+
+private:
+    Storage storage_;
+    const Ops* ops_;
+};
+
+template<typename Fn>
+const Task::Ops Task::Manager<Fn, true>::ops = {
+    &Task::Manager<Fn, true>::Invoke,
+    &Task::Manager<Fn, true>::Move,
+    &Task::Manager<Fn, true>::Destroy,
+    true
+};
+
+template<typename Fn>
+const Task::Ops Task::Manager<Fn, false>::ops = {
+    &Task::Manager<Fn, false>::Invoke,
+    &Task::Manager<Fn, false>::Move,
+    &Task::Manager<Fn, false>::Destroy,
+    false
+};
+}
@@ -18,6 +18,10 @@ typedef std::function<void(const TCPConnPtr&)> CloseCallback;
 typedef std::function<void(const TCPConnPtr&)> WriteCompleteCallback;
 typedef std::function<void(const TCPConnPtr&, size_t)> HighWaterMarkCallback;
 
+// When a file region passed to TCPConn::SendFile has been totally sent or
+// dropped because of the connection broken down, this callback will be called
+typedef std::function<void(const TCPConnPtr&, bool /*completed*/)> SendFileCallback;
+
 typedef std::function<void(const TCPConnPtr&, Buffer*)> MessageCallback;
 
 namespace internal {
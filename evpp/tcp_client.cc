@@ -71,8 +71,9 @@ void TCPClient::DisconnectInLoop() {
         assert(!conn_->IsDisconnected() && !conn_->IsDisconnecting());
         conn_->Close();
     } else {
-        // When connector_ is connecting to the remote server ...
-        assert(connector_ && !connector_->IsConnected());
+        // When connector_ is connecting to the remote server,
+        // or the connection has been closed by the remote server ...
+        assert(connector_);
     }
 
     if (connector_->IsConnected() || connector_->IsDisconnected()) {
@@ -111,7 +112,7 @@ void TCPClient::OnConnection(evpp_socket_t sockfd, const std::string& laddr) {
 
     DLOG_TRACE << "Successfully connected to " << remote_addr_;
     assert(loop_->IsInLoopThread());
-    TCPConnPtr c = TCPConnPtr(new TCPConn(loop_, name_, sockfd, laddr, remote_addr_, id++));
+    TCPConnPtr c = TCPConn::Create(loop_, name_, sockfd, laddr, remote_addr_, id++);
     c->set_type(TCPConn::kOutgoing);
     c->SetMessageCallback(msg_fn_);
     c->SetConnectionCallback(conn_fn_);
@@ -21,10 +21,16 @@ TCPConn::TCPConn(EventLoop* l,
     , name_(n)
     , local_addr_(laddr)
     , remote_addr_(raddr)
+    , input_buffer_(*l->buffer_pool())
+    , output_buffer_(l->buffer_pool())
     , type_(kIncoming)
     , status_(kDisconnected) {
     if (sockfd >= 0) {
-        chan_.reset(new FdChannel(l, sockfd, false, false));
+        if (l->IsInLoopThread()) {
+            chan_ = std::allocate_shared<FdChannel>(PoolAllocator<FdChannel>(l->fd_channel_pool()), l, sockfd, false, false);
+        } else {
+            chan_.reset(new FdChannel(l, sockfd, false, false));
+        }
         chan_->SetReadCallback(std::bind(&TCPConn::HandleRead, this));
         chan_->SetWriteCallback(std::bind(&TCPConn::HandleWrite, this));
     }
@@ -50,6 +56,19 @@ TCPConn::~TCPConn() {
     assert(!delay_close_timer_.get());
 }
 
+TCPConnPtr TCPConn::Create(EventLoop* loop,
+                           const std::string& name,
+                           evpp_socket_t sockfd,
+                           const std::string& laddr,
+                           const std::string& raddr,
+                           uint64_t id) {
+    if (loop->IsInLoopThread()) {
+        return std::allocate_shared<TCPConn>(PoolAllocator<TCPConn>(loop->tcp_conn_pool()), loop, name, sockfd, laddr, raddr, id);
+    }
+
+    return TCPConnPtr(new TCPConn(loop, name, sockfd, laddr, raddr, id));
+}
+
 void TCPConn::Close() {
     DLOG_TRACE << "fd=" << fd_ << " status=" << StatusToString() << " addr=" << AddrToString();
     status_ = kDisconnecting;
@@ -75,6 +94,33 @@ void TCPConn::Send(const std::string& d) {
     }
 }
 
+void TCPConn::Send(std::string&& d) {
+    if (status_ != kConnected) {
+        return;
+    }
+
+    if (loop_->IsInLoopThread()) {
+        SendInLoop(std::move(d));
+    } else {
+        loop_->RunInLoop(std::bind(&TCPConn::SendStringInLoop, shared_from_this(), std::move(d)));
+    }
+}
+
+void TCPConn::Send(const std::shared_ptr<const std::string>& d) {
+    if (status_ != kConnected) {
+        return;
+    }
+
+    if (loop_->IsInLoopThread()) {
+        SendInLoop(d);
+    } else {
+        auto c = shared_from_this();
+        loop_->RunInLoop([c, d]() {
+            c->SendInLoop(d);
+        });
+    }
+}
+
 void TCPConn::Send(const Slice& message) {
     if (status_ != kConnected) {
         return;
@@ -104,7 +150,46 @@ void TCPConn::Send(Buffer* buf) {
         SendInLoop(buf->data(), buf->length());
         buf->Reset();
     } else {
-        loop_->RunInLoop(std::bind(&TCPConn::SendStringInLoop, shared_from_this(), buf->NextAllString()));
+        Send(std::move(*buf));
+    }
+}
+
+void TCPConn::Send(Buffer&& buf) {
+    if (status_ != kConnected) {
+        return;
+    }
+
+    if (loop_->IsInLoopThread()) {
+        SendInLoop(std::move(buf));
+    } else {
+        if (buf.pool()) {
+            // The storage belongs to the pool of another thread, copy the data
+            Send(buf.ToSlice());
+            buf.Reset();
+            return;
+        }
+
+        // The storage of buf is moved into the functor, no data is copied
+        auto c = shared_from_this();
+        std::shared_ptr<Buffer> b = std::make_shared<Buffer>(std::move(buf));
+        loop_->RunInLoop([c, b]() {
+            c->SendInLoop(std::move(*b));
+        });
+    }
+}
+
+void TCPConn::SendFile(int fd, int64_t offset, size_t length, const SendFileCallback& done_cb) {
+    if (status_ != kConnected) {
+        if (done_cb) {
+            loop_->RunInLoop(std::bind(done_cb, shared_from_this(), false));
+        }
+        return;
+    }
+
+    if (loop_->IsInLoopThread()) {
+        SendFileInLoop(fd, offset, length, done_cb);
+    } else {
+        loop_->RunInLoop(std::bind(&TCPConn::SendFileInLoop, shared_from_this(), fd, offset, length, done_cb));
     }
 }
 
@@ -112,72 +197,180 @@ void TCPConn::SendInLoop(const Slice& message) {
     SendInLoop(message.data(), message.size());
 }
 
-void TCPConn::SendStringInLoop(const std::string& message) {
-    SendInLoop(message.data(), message.size());
+void TCPConn::SendStringInLoop(std::string& message) {
+    SendInLoop(std::move(message));
 }
 
 void TCPConn::SendInLoop(const void* data, size_t len) {
-    assert(loop_->IsInLoopThread());
+    size_t nwritten = 0;
+    if (!TryWriteDirectly(static_cast<const char*>(data), len, &nwritten)) {
+        return;
+    }
 
-    if (status_ == kDisconnected) {
-        LOG_WARN << "disconnected, give up writing";
+    if (nwritten < len) {
+        size_t old_len = output_buffer_.buffered_length();
+        output_buffer_.Append(static_cast<const char*>(data) + nwritten, len - nwritten);
+        OnOutputQueued(old_len);
+    }
+}
+
+void TCPConn::SendInLoop(std::string&& message) {
+    size_t nwritten = 0;
+    if (!TryWriteDirectly(message.data(), message.size(), &nwritten)) {
         return;
     }
 
-    ssize_t nwritten = 0;
-    size_t remaining = len;
-    bool write_error = false;
+    if (nwritten < message.size()) {
+        size_t old_len = output_buffer_.buffered_length();
+        output_buffer_.Append(std::move(message), nwritten);
+        OnOutputQueued(old_len);
+    }
+}
 
-    // if no data in output queue, writing directly
-    if (!chan_->IsWritable() && output_buffer_.length() == 0) {
-        nwritten = ::send(chan_->fd(), static_cast<const char*>(data), len, MSG_NOSIGNAL);
-        if (nwritten >= 0) {
-            remaining = len - nwritten;
-            if (remaining == 0 && write_complete_fn_) {
-                loop_->QueueInLoop(std::bind(write_complete_fn_, shared_from_this()));
-            }
-        } else {
-            int serrno = errno;
-            nwritten = 0;
-            if (!EVUTIL_ERR_RW_RETRIABLE(serrno)) {
-                LOG_ERROR << "SendInLoop write failed errno=" << serrno << " " << strerror(serrno);
-                if (serrno == EPIPE || serrno == ECONNRESET) {
-                    write_error = true;
-                }
-            }
-        }
+void TCPConn::SendInLoop(const std::shared_ptr<const std::string>& message) {
+    size_t nwritten = 0;
+    if (!TryWriteDirectly(message->data(), message->size(), &nwritten)) {
+        return;
     }
 
-    if (write_error) {
-        HandleError();
+    if (nwritten < message->size()) {
+        size_t old_len = output_buffer_.buffered_length();
+        output_buffer_.Append(message, nwritten);
+        OnOutputQueued(old_len);
+    }
+}
+
+void TCPConn::SendInLoop(Buffer&& buf) {
+    size_t nwritten = 0;
+    if (!TryWriteDirectly(buf.data(), buf.length(), &nwritten)) {
         return;
     }
 
-    assert(!write_error);
-    assert(remaining <= len);
+    if (nwritten < buf.length()) {
+        size_t old_len = output_buffer_.buffered_length();
+        buf.Skip(nwritten);
+        output_buffer_.Append(std::move(buf));
+        OnOutputQueued(old_len);
+    } else {
+        buf.Reset();
+    }
+}
 
-    if (remaining > 0) {
-        size_t old_len = output_buffer_.length();
-        if (old_len + remaining >= high_water_mark_
-                && old_len < high_water_mark_
-                && high_water_mark_fn_) {
-            loop_->QueueInLoop(std::bind(high_water_mark_fn_, shared_from_this(), old_len + remaining));
+void TCPConn::SendFileInLoop(int fd, int64_t offset, size_t length, const SendFileCallback& done_cb) {
+    assert(loop_->IsInLoopThread());
+    if (status_ == kDisconnected) {
+        LOG_WARN << "disconnected, give up sending file fd=" << fd;
+        if (done_cb) {
+            done_cb(shared_from_this(), false);
         }
+        return;
+    }
+
+    OutputQueue::FileDoneCallback cb;
+    if (done_cb) {
+        // The output queue is always drained in HandleWrite or HandleClose
+        // before this TCPConn is destructed, so it is safe to capture this.
+        cb = [this, done_cb](bool completed) {
+            loop_->QueueInLoop(std::bind(done_cb, shared_from_this(), completed));
+        };
+    }
+
+    output_buffer_.AppendFile(fd, offset, length, cb);
+    if (!output_buffer_.empty() && !chan_->IsWritable()) {
+        chan_->EnableWriteEvent();
+    }
+}
+
+bool TCPConn::TryWriteDirectly(const char* data, size_t len, size_t* nwritten) {
+    assert(loop_->IsInLoopThread());
+    *nwritten = 0;
+
+    if (status_ == kDisconnected) {
+        LOG_WARN << "disconnected, give up writing";
+        return false;
+    }
 
-        output_buffer_.Append(static_cast<const char*>(data) + nwritten, remaining);
+    // if there is data in output queue, we must append after it
+    if (chan_->IsWritable() || !output_buffer_.empty()) {
+        return true;
+    }
+
+    ssize_t n = ::send(chan_->fd(), data, len, MSG_NOSIGNAL);
+    if (n >= 0) {
+        *nwritten = static_cast<size_t>(n);
+        if (n > 0) {
+            last_active_time_ = loop_->Now();
+        }
+        if (*nwritten == len && write_complete_fn_) {
+            loop_->QueueInLoop(std::bind(write_complete_fn_, shared_from_this()));
+        }
+        return true;
+    }
 
-        if (!chan_->IsWritable()) {
-            chan_->EnableWriteEvent();
+    int serrno = errno;
+    if (!EVUTIL_ERR_RW_RETRIABLE(serrno)) {
+        LOG_ERROR << "SendInLoop write failed errno=" << serrno << " " << strerror(serrno);
+        if (serrno == EPIPE || serrno == ECONNRESET) {
+            HandleError();
+            return false;
         }
     }
+
+    return true;
+}
+
+void TCPConn::OnOutputQueued(size_t old_len) {
+    size_t new_len = output_buffer_.buffered_length();
+    if (new_len >= high_water_mark_
+            && old_len < high_water_mark_
+            && high_water_mark_fn_) {
+        loop_->QueueInLoop(std::bind(high_water_mark_fn_, shared_from_this(), new_len));
+    }
+
+    if (new_len >= high_water_mark_) {
+        SetBackpressure(true);
+    }
+
+    if (!chan_->IsWritable()) {
+        chan_->EnableWriteEvent();
+    }
 }
 
 void TCPConn::HandleRead() {
     assert(loop_->IsInLoopThread());
     int serrno = 0;
-    ssize_t n = input_buffer_.ReadFromFD(chan_->fd(), &serrno);
-    if (n > 0) {
+    ssize_t n = 0;
+    size_t total = 0;
+    char* scratch = loop_->read_scratch();
+    for (int i = 0; i < max_reads_per_wakeup_; ++i) {
+        // Make room for the bytes we expect, so that they are read into the
+        // input buffer directly. Only the overflow goes to the scratch memory.
+        input_buffer_.EnsureWritableBytes(read_size_.next());
+        const size_t writable = input_buffer_.WritableBytes();
+        n = input_buffer_.ReadFromFD(chan_->fd(), scratch, EventLoop::kReadScratchSize, &serrno);
+        if (n <= 0) {
+            break;
+        }
+
+        read_size_.Record(static_cast<size_t>(n));
+        total += static_cast<size_t>(n);
+        if (static_cast<size_t>(n) < writable ||
+                (input_high_water_mark_ > 0 && input_buffer_.length() >= input_high_water_mark_)) {
+            // The socket is drained or we have read enough
+            break;
+        }
+    }
+
+    if (total > 0) {
+        last_active_time_ = loop_->Now();
+
+        // If we get EOF or an error after reading some data, it will be
+        // got again in the next readable event.
         msg_fn_(shared_from_this(), &input_buffer_);
+        CheckInputWaterMark();
+        if (release_idle_buffers_ && input_buffer_.length() == 0) {
+            input_buffer_.Shrink(0);
+        }
     } else if (n == 0) {
         if (type() == kOutgoing) {
             // This is an outgoing connection, we own it and it's done. so close it
@@ -187,6 +380,7 @@ void TCPConn::HandleRead() {
         } else {
             // Fix the half-closing problem : https://github.com/chenshuo/muduo/pull/117
 
+            read_paused_ |= kReadPausedByEOF;
             chan_->DisableReadEvent();
             if (close_delay_.IsZero()) {
                 DLOG_TRACE << "channel (fd=" << chan_->fd() << ") DisableReadEvent. delay time " << close_delay_.Seconds() << "s. We close this connection immediately";
@@ -213,20 +407,32 @@ void TCPConn::HandleWrite() {
     assert(loop_->IsInLoopThread());
     assert(!chan_->attached() || chan_->IsWritable());
 
-    ssize_t n = ::send(fd_, output_buffer_.data(), output_buffer_.length(), MSG_NOSIGNAL);
+    if (output_buffer_.empty()) {
+        chan_->DisableWriteEvent();
+        return;
+    }
+
+    // Flush as many chunks as possible with one writev call
+    int serrno = 0;
+    ssize_t n = output_buffer_.WriteToFD(fd_, &serrno);
     if (n > 0) {
-        output_buffer_.Next(n);
+        last_active_time_ = loop_->Now();
+        if (backpressure_ && output_buffer_.buffered_length() <= low_water_mark_) {
+            SetBackpressure(false);
+        }
 
-        if (output_buffer_.length() == 0) {
+        if (output_buffer_.empty()) {
             chan_->DisableWriteEvent();
 
+            if (release_idle_buffers_) {
+                output_buffer_.Shrink();
+            }
+
             if (write_complete_fn_) {
                 loop_->QueueInLoop(std::bind(write_complete_fn_, shared_from_this()));
             }
         }
     } else {
-        int serrno = errno;
-
         if (EVUTIL_ERR_RW_RETRIABLE(serrno)) {
             LOG_WARN << "this=" << this << " TCPConn::HandleWrite errno=" << serrno << " " << strerror(serrno);
         } else {
@@ -259,6 +465,15 @@ void TCPConn::HandleClose() {
     assert(loop_->IsInLoopThread());
     chan_->DisableAllEvent();
     chan_->Close();
+    if (attached_) {
+        attached_ = false;
+        loop_->connection_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // The pending data can never be sent now. Drop it and notify the
+    // SendFile callbacks while this TCPConn is still alive.
+    output_buffer_.Reset();
+    SetBackpressure(false);
 
     TCPConnPtr conn(shared_from_this());
 
@@ -280,6 +495,12 @@ void TCPConn::HandleClose() {
         close_fn_(conn);
     }
     DLOG_TRACE << "addr=" << AddrToString() << " fd=" << fd_ << " status_=" << StatusToString() << " use_count=" << conn.use_count();
+
+    // Give the storage back to the pool of loop_ in the IO thread,
+    // since this TCPConn may be destructed in another thread.
+    input_buffer_.Reset();
+    input_buffer_.Shrink(0);
+    output_buffer_.Shrink();
     status_ = kDisconnected;
 }
 
@@ -292,7 +513,19 @@ void TCPConn::HandleError() {
 void TCPConn::OnAttachedToLoop() {
     assert(loop_->IsInLoopThread());
     status_ = kConnected;
-    chan_->EnableReadEvent();
+    if (!attached_) {
+        attached_ = true;
+        loop_->connection_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Duration busy_poll = loop_->busy_poll_duration();
+    if (busy_poll.Nanoseconds() > 0) {
+        sock::SetBusyPoll(fd_, busy_poll);
+    }
+
+    if (read_paused_ == 0) {
+        chan_->EnableReadEvent();
+    }
 
     if (conn_fn_) {
         conn_fn_(shared_from_this());
@@ -304,6 +537,80 @@ void TCPConn::SetHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t m
     high_water_mark_ = mark;
 }
 
+void TCPConn::PauseReading() {
+    auto c = shared_from_this();
+    loop_->RunInLoop([c]() {
+        c->UpdateReadPaused(kReadPausedByUser, true);
+    });
+}
+
+void TCPConn::ResumeReading() {
+    auto c = shared_from_this();
+    loop_->RunInLoop([c]() {
+        c->UpdateReadPaused(kReadPausedByUser, false);
+        c->CheckInputWaterMark();
+    });
+}
+
+void TCPConn::UpdateReadPaused(int reason, bool paused) {
+    assert(loop_->IsInLoopThread());
+    if (paused) {
+        read_paused_ |= reason;
+    } else {
+        read_paused_ &= ~reason;
+    }
+
+    // OnAttachedToLoop will check read_paused_ when we are connected
+    if (status_ != kConnected) {
+        return;
+    }
+
+    if (read_paused_ != 0 && chan_->IsReadable()) {
+        DLOG_TRACE << "fd=" << fd_ << " pause reading, read_paused_=" << read_paused_;
+        chan_->DisableReadEvent();
+    } else if (read_paused_ == 0 && !chan_->IsReadable()) {
+        DLOG_TRACE << "fd=" << fd_ << " resume reading";
+        chan_->EnableReadEvent();
+    }
+}
+
+void TCPConn::CheckInputWaterMark() {
+    size_t len = input_buffer_.length();
+    if (input_high_water_mark_ > 0 && len >= input_high_water_mark_) {
+        UpdateReadPaused(kReadPausedByInputFull, true);
+    } else if ((read_paused_ & kReadPausedByInputFull) &&
+               (input_high_water_mark_ == 0 || len <= input_low_water_mark_)) {
+        UpdateReadPaused(kReadPausedByInputFull, false);
+    }
+}
+
+void TCPConn::SetBackpressureSource(const TCPConnPtr& source) {
+    assert(loop_->IsInLoopThread());
+    SetBackpressure(false);
+    backpressure_source_ = source;
+    if (output_buffer_.buffered_length() >= high_water_mark_) {
+        SetBackpressure(true);
+    }
+}
+
+void TCPConn::SetBackpressure(bool blocked) {
+    if (backpressure_ == blocked) {
+        return;
+    }
+
+    TCPConnPtr source = backpressure_source_.lock();
+    if (!source) {
+        backpressure_ = false;
+        return;
+    }
+
+    DLOG_TRACE << "fd=" << fd_ << " output buffered=" << output_buffer_.buffered_length() << (blocked ? " pause" : " resume") << " reading on " << source->AddrToString();
+    backpressure_ = blocked;
+    source->loop()->RunInLoop([source, blocked]() {
+        source->UpdateReadPaused(kReadPausedBySink, blocked);
+    });
+}
+
 void TCPConn::SetTCPNoDelay(bool on) {
     sock::SetTCPNoDelay(fd_, on);
 }
@@ -4,10 +4,13 @@
 
 #include "evpp/inner_pre.h"
 #include "evpp/buffer.h"
+#include "evpp/output_queue.h"
+#include "evpp/read_size_predictor.h"
 #include "evpp/tcp_callbacks.h"
 #include "evpp/slice.h"
 #include "evpp/any.h"
 #include "evpp/duration.h"
+#include "evpp/timestamp.h"
 
 namespace evpp {
 
@@ -37,6 +40,15 @@ public:
             uint64_t id);
     ~TCPConn();
 
+    // @brief Create a TCPConn. When it is called in the thread of loop,
+    //  the memory is taken from EventLoop::tcp_conn_pool().
+    static TCPConnPtr Create(EventLoop* loop,
+                             const std::string& name,
+                             evpp_socket_t sockfd,
+                             const std::string& laddr,
+                             const std::string& raddr,
+                             uint64_t id);
+
     void Close();
 
     void Send(const char* s) {
@@ -45,7 +57,37 @@ public:
     void Send(const void* d, size_t dlen);
     void Send(const std::string& d);
     void Send(const Slice& message);
+
+    // Send drains buf. When it is called out of the IO thread,
+    // the underlying storage of buf is moved instead of copied,
+    // unless the storage belongs to a BufferPool.
     void Send(Buffer* buf);
+
+    // Send takes the ownership of d. The data is moved into the output queue
+    // without copying when it can not be written to the socket immediately.
+    void Send(std::string&& d);
+
+    // Send holds a reference of d instead of copying it. The same block
+    // can be shared by many connections, so d must never be modified.
+    void Send(const std::shared_ptr<const std::string>& d);
+
+    // Send takes the underlying storage of buf without copying it.
+    // buf is left empty after this call. When it is called out of the IO
+    // thread and the storage belongs to a BufferPool, the data is copied
+    // since the storage must be given back in the thread of the pool.
+    void Send(Buffer&& buf);
+
+    // @brief Send the region [offset, offset + length) of the file fd.
+    //  The region is queued after the data sent before and is streamed with
+    //  sendfile(2) as the socket drains, so the file is never read into memory.
+    // @param fd - The file descriptor. The caller must keep it open until
+    //  done_cb is invoked.
+    // @param done_cb - It is invoked in the IO thread of this connection when
+    //  the region has been totally sent or dropped. It is invoked with
+    //  completed=false, without queuing the region, if the connection is
+    //  not connected.
+    void SendFile(int fd, int64_t offset, size_t length,
+                  const SendFileCallback& done_cb = SendFileCallback());
 public:
     EventLoop* loop() const {
         return loop_;
@@ -99,6 +141,12 @@ public:
         return status_;
     }
 
+    // The time when the data was read from or written to the socket last time,
+    // by the monotonic clock of EventLoop::Now(). It is accurate only in the IO thread.
+    std::chrono::steady_clock::time_point last_active_time() const {
+        return last_active_time_;
+    }
+
     std::string AddrToString() const {
         if (IsIncommingConn()) {
             return "(" + remote_addr_ + "->" + local_addr_ + "(local))";
@@ -131,6 +179,79 @@ public:
     }
 
     void SetHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t mark);
+
+    // Set the low water mark of the output buffer. The backpressure source
+    // paused by this connection is resumed when the output buffer drains to it.
+    void SetLowWaterMark(size_t mark) {
+        low_water_mark_ = mark;
+    }
+
+    // @brief Set the water marks of the input buffer. After the message
+    //  callback returns, if the input buffer still holds high bytes or more,
+    //  reading is paused until it drops to low bytes or less.
+    //  The check is repeated in ResumeReading, so if the application consumes
+    //  the input buffer out of the message callback, it should call ResumeReading.
+    // @param high - 0 means no limit, which is the default.
+    void SetInputWaterMark(size_t high, size_t low) {
+        assert(low <= high);
+        input_high_water_mark_ = high;
+        input_low_water_mark_ = low;
+    }
+
+    // @brief Set the max count of reads when the socket becomes readable.
+    //  More reads drain a busy socket with less wakeups, while one read
+    //  is fairer to the other connections of the same EventLoop.
+    //  The default is 1.
+    void SetMaxReadsPerWakeup(int n) {
+        assert(n > 0);
+        max_reads_per_wakeup_ = n;
+    }
+
+    // @brief Give the storage of the input buffer back to the buffer pool of
+    //  the EventLoop whenever the message callback drains it, and the storage
+    //  of the output buffer whenever it is totally sent. It saves memory when
+    //  there are lots of idle connections, at the cost of taking the storage
+    //  from the pool again when the next message arrives.
+    //  The storage is always allocated at the first use, and always given
+    //  back when the connection is closed.
+    void SetReleaseIdleBuffers(bool on) {
+        release_idle_buffers_ = on;
+    }
+
+    // @brief Return the count of bytes held by the input and output buffers.
+    //  It must be called in the IO thread. EventLoop::buffer_pool() tells the
+    //  total bytes of all the connections of a loop.
+    size_t memory_usage() const {
+        return input_buffer_.capacity() + output_buffer_.memory_usage();
+    }
+
+    // @brief Return the count of the bytes waiting to be sent, including the
+    //  file regions queued by SendFile. It must be called in the IO thread.
+    size_t output_buffered_length() const {
+        return output_buffer_.buffered_length();
+    }
+
+    // @brief Stop reading from the socket. The data which has been read
+    //  stays in the input buffer. It is thread safe.
+    void PauseReading();
+
+    // @brief Restart reading from the socket after PauseReading.
+    //  It is thread safe.
+    void ResumeReading();
+
+    // Return true if reading is paused because of any reason.
+    // It is accurate only in the IO thread.
+    bool IsReadingPaused() const {
+        return read_paused_ != 0;
+    }
+
+    // @brief Pause reading on source while the output buffer of this
+    //  connection holds high water mark bytes or more, and resume it when the
+    //  output buffer drains to the low water mark. A proxy forwarding from
+    //  source to this connection stays memory-bounded in this way.
+    //  It must be called in the IO thread of this connection.
+    // @param source - It is held by a weak reference. It can be in another EventLoop.
+    void SetBackpressureSource(const TCPConnPtr& source);
 protected:
     friend class TCPClient;
     friend class TCPServer;
@@ -159,7 +280,30 @@ private:
     void HandleError();
     void SendInLoop(const Slice& message);
     void SendInLoop(const void* data, size_t len);
-    void SendStringInLoop(const std::string& message);
+    void SendInLoop(std::string&& message);
+    void SendInLoop(const std::shared_ptr<const std::string>& message);
+    void SendInLoop(Buffer&& buf);
+    void SendFileInLoop(int fd, int64_t offset, size_t length, const SendFileCallback& done_cb);
+
+    // The message is a copy owned by the functor which calls this method
+    // only once, so we can move it into the output queue.
+    void SendStringInLoop(std::string& message);
+
+    // Try to write the data to the socket directly if nothing is queued.
+    // Return false if the connection is broken.
+    bool TryWriteDirectly(const char* data, size_t len, size_t* nwritten);
+    void OnOutputQueued(size_t old_len);
+
+    // The reasons why reading is paused
+    enum {
+        kReadPausedByUser = 0x01,
+        kReadPausedByInputFull = 0x02,
+        kReadPausedBySink = 0x04, // The output of the connection we forward to is full
+        kReadPausedByEOF = 0x08,
+    };
+    void UpdateReadPaused(int reason, bool paused);
+    void CheckInputWaterMark();
+    void SetBackpressure(bool blocked);
 
 private:
     EventLoop* loop_;
@@ -168,15 +312,26 @@ private:
     std::string name_;
     std::string local_addr_; // the local address with form : "ip:port"
     std::string remote_addr_; // the remote address with form : "ip:port"
-    std::unique_ptr<FdChannel> chan_;
+    std::shared_ptr<FdChannel> chan_; // Allocated from EventLoop::fd_channel_pool()
     Buffer input_buffer_;
-    Buffer output_buffer_; // TODO use a list<Slice> ??
+    OutputQueue output_buffer_;
+    ReadSizePredictor read_size_;
+    int max_reads_per_wakeup_ = 1;
+    bool release_idle_buffers_ = false;
 
     enum { kContextCount = 16, };
     Any context_[kContextCount];
     Type type_;
     std::atomic<Status> status_;
     size_t high_water_mark_ = 128 * 1024 * 1024; // Default 128MB
+    size_t low_water_mark_ = 0;
+    size_t input_high_water_mark_ = 0; // 0 means no limit
+    size_t input_low_water_mark_ = 0;
+    int read_paused_ = 0; // The bit set of the reasons why reading is paused
+    std::weak_ptr<TCPConn> backpressure_source_;
+    bool backpressure_ = false; // Whether backpressure_source_ is paused by us
+    std::chrono::steady_clock::time_point last_active_time_ = std::chrono::steady_clock::now();
+    bool attached_ = false; // Whether it is counted in EventLoop::connection_count()
 
     // The delay time to close a incoming connection which has been shutdown by peer normally.
     // Default is 0 second which means we disable this feature by default.
@@ -5,7 +5,116 @@
 #include "evpp/tcp_conn.h"
 #include "evpp/libevent.h"
 
+#include <unordered_map>
+
 namespace evpp {
+
+// IdleReaper closes the idle connections of one working loop. It is only
+// used in the thread of the loop.
+//
+// It is a ring of buckets of connection ids, and the timer moves to the next
+// bucket every tick. A connection is put into the bucket of its deadline
+// when it is created, and it is not touched when it reads or writes. When
+// the timer comes to its bucket, it is closed if it has been idle for
+// timeout, or it is moved to the bucket of its new deadline.
+class TCPServer::IdleReaper : public std::enable_shared_from_this<IdleReaper> {
+public:
+    IdleReaper(EventLoop* loop, Duration timeout, const ConnectionFilter& busy)
+        : loop_(loop)
+        , timeout_(timeout)
+        , busy_fn_(busy)
+        , tick_(std::max<int64_t>(timeout.Nanoseconds() / kIdleBucketCount, Duration::kMillisecond))
+        , buckets_(kIdleBucketCount + 1)
+        , current_(0) {}
+
+    void Start() {
+        assert(loop_->IsInLoopThread());
+        auto self = shared_from_this();
+        timer_ = loop_->RunEvery(tick_, [self]() {
+            self->OnTick();
+        });
+    }
+
+    void Stop() {
+        assert(loop_->IsInLoopThread());
+        if (timer_) {
+            timer_->Cancel();
+            timer_.reset();
+        }
+        conns_.clear();
+    }
+
+    void Add(const TCPConnPtr& conn) {
+        assert(loop_->IsInLoopThread());
+        conns_[conn->id()] = conn;
+        Schedule(conn->id(), kIdleBucketCount);
+    }
+
+    // The id is left in its bucket and dropped when the timer comes to it
+    void Remove(uint64_t id) {
+        assert(loop_->IsInLoopThread());
+        conns_.erase(id);
+    }
+
+private:
+    void Schedule(uint64_t id, size_t ticks) {
+        buckets_[(current_ + ticks) % buckets_.size()].push_back(id);
+    }
+
+    void OnTick() {
+        current_ = (current_ + 1) % buckets_.size();
+        std::vector<uint64_t> ids;
+        ids.swap(buckets_[current_]);
+
+        std::chrono::steady_clock::time_point now = loop_->Now();
+        for (uint64_t id : ids) {
+            auto it = conns_.find(id);
+            if (it == conns_.end()) {
+                continue;
+            }
+
+            const TCPConnPtr& conn = it->second;
+            if (!conn->IsConnected()) {
+                continue;
+            }
+
+            Duration idle(static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - conn->last_active_time()).count()));
+            if (idle >= timeout_ && busy_fn_ && busy_fn_(conn)) {
+                // Check it again after a whole timeout
+                Schedule(id, kIdleBucketCount);
+                continue;
+            }
+
+            if (idle >= timeout_) {
+                DLOG_TRACE << "close idle connection id=" << id << " fd=" << conn->fd() << " idle(ms)=" << idle.Milliseconds();
+                conn->Close();
+                continue;
+            }
+
+            // Round up to make sure it is not checked before its deadline
+            int64_t left = timeout_.Nanoseconds() - idle.Nanoseconds();
+            int64_t ticks = (left + tick_.Nanoseconds() - 1) / tick_.Nanoseconds();
+            Schedule(id, static_cast<size_t>(std::max<int64_t>(1, std::min<int64_t>(ticks, kIdleBucketCount))));
+        }
+
+        // Keep the memory for the next round
+        if (buckets_[current_].empty()) {
+            ids.clear();
+            buckets_[current_].swap(ids);
+        }
+    }
+
+private:
+    EventLoop* loop_;
+    Duration timeout_;
+    ConnectionFilter busy_fn_;
+    Duration tick_;
+    std::vector<std::vector<uint64_t>> buckets_;
+    size_t current_;
+    std::unordered_map<uint64_t, TCPConnPtr> conns_;
+    InvokeTimerPtr timer_;
+};
+
 TCPServer::TCPServer(EventLoop* loop,
                      const std::string& laddr,
                      const std::string& name,
@@ -13,9 +122,12 @@ TCPServer::TCPServer(EventLoop* loop,
     : loop_(loop)
     , listen_addr_(laddr)
     , name_(name)
+    , accept_stats_(std::make_shared<AcceptStats>())
     , conn_fn_(&internal::DefaultConnectionCallback)
     , msg_fn_(&internal::DefaultMessageCallback)
-    , next_conn_id_(0) {
+    , next_conn_id_(0)
+    , pending_conn_count_(0)
+    , loop_conn_count_(0) {
     DLOG_TRACE << "name=" << name << " listening addr " << laddr << " thread_num=" << thread_num;
     tpool_.reset(new EventLoopThreadPool(loop_, thread_num));
 }
@@ -23,7 +135,9 @@ TCPServer::TCPServer(EventLoop* loop,
 TCPServer::~TCPServer() {
     DLOG_TRACE;
     assert(connections_.empty());
+    assert(loop_conn_count_ == 0);
     assert(!listener_);
+    assert(acceptors_.empty());
     if (tpool_) {
         assert(tpool_->IsStopped());
         tpool_.reset();
@@ -33,6 +147,14 @@ TCPServer::~TCPServer() {
 bool TCPServer::Init() {
     DLOG_TRACE;
     assert(status_ == kNull);
+#ifdef SO_REUSEPORT
+    if (multi_acceptor_ && tpool_->thread_num() > 0) {
+        // The listeners are created in Start() when the working threads are running
+        status_.store(kInitialized);
+        return true;
+    }
+#endif
+    multi_acceptor_ = false;
     listener_.reset(new Listener(loop_, listen_addr_));
     listener_->Listen();
     status_.store(kInitialized);
@@ -47,10 +169,20 @@ bool TCPServer::Start() {
     DLOG_TRACE;
     assert(status_ == kInitialized);
     status_.store(kStarting);
-    assert(listener_.get());
+    assert(listener_.get() || multi_acceptor_);
     bool rc = tpool_->Start(true);
     if (rc) {
+        StartIdleReapers();
+    }
+
+    if (rc && multi_acceptor_) {
         assert(tpool_->IsRunning());
+        status_.store(kRunning);
+        StartAcceptors();
+    } else if (rc) {
+        assert(tpool_->IsRunning());
+        listener_->SetMaxAcceptsPerWakeup(max_accepts_per_wakeup_);
+        listener_->SetAcceptStats(accept_stats_);
         listener_->SetNewConnectionCallback(
             std::bind(&TCPServer::HandleNewConn,
                       this,
@@ -71,6 +203,81 @@ bool TCPServer::Start() {
     return rc;
 }
 
+void TCPServer::StartAcceptors() {
+    // The maps are all created before any connection is accepted
+    for (uint32_t i = 0; i < tpool_->thread_num(); ++i) {
+        loop_connections_[tpool_->GetNextLoopWithHash(i)].reset(new ConnectionMap);
+    }
+
+    for (uint32_t i = 0; i < tpool_->thread_num(); ++i) {
+        EventLoop* io_loop = tpool_->GetNextLoopWithHash(i);
+        std::unique_ptr<Listener> l(new Listener(io_loop, listen_addr_));
+        l->Listen();
+        if (tpool_->GetCPU(i) >= 0) {
+            l->SetIncomingCPU(tpool_->GetCPU(i));
+        }
+        l->SetMaxAcceptsPerWakeup(max_accepts_per_wakeup_);
+        l->SetAcceptStats(accept_stats_);
+        l->SetNewConnectionCallback(
+            [this, io_loop](evpp_socket_t sockfd, const std::string& remote_addr, const struct sockaddr_in*) {
+                HandleNewConnInLoop(io_loop, sockfd, remote_addr);
+            });
+        l->Accept();
+        acceptors_.push_back(std::move(l));
+    }
+}
+
+void TCPServer::StartIdleReapers() {
+    if (idle_timeout_.Nanoseconds() <= 0) {
+        return;
+    }
+
+    uint32_t loop_count = std::max<uint32_t>(tpool_->thread_num(), 1);
+    for (uint32_t i = 0; i < loop_count; ++i) {
+        EventLoop* io_loop = tpool_->GetNextLoopWithHash(i);
+        std::shared_ptr<IdleReaper> r = std::make_shared<IdleReaper>(io_loop, idle_timeout_, idle_busy_fn_);
+        idle_reapers_[io_loop] = r;
+        io_loop->RunInLoop([r]() {
+            r->Start();
+        });
+    }
+}
+
+void TCPServer::StopIdleReapers() {
+    for (auto& r : idle_reapers_) {
+        std::shared_ptr<IdleReaper> reaper = r.second;
+        r.first->RunInLoop([reaper]() {
+            reaper->Stop();
+        });
+    }
+}
+
+TCPServer::IdleReaper* TCPServer::GetIdleReaper(EventLoop* io_loop) const {
+    auto it = idle_reapers_.find(io_loop);
+    return it == idle_reapers_.end() ? nullptr : it->second.get();
+}
+
+void TCPServer::StopAcceptors(DoneCallback on_stopped_cb) {
+    DLOG_TRACE << "acceptors_.size()=" << acceptors_.size();
+    assert(loop_->IsInLoopThread());
+
+    // Stop every listener in its own thread, and then go on with StopInLoop.
+    // The connections accepted before are all in loop_connections_ by then.
+    std::shared_ptr<std::atomic<size_t>> remaining = std::make_shared<std::atomic<size_t>>(acceptors_.size());
+    for (auto& a : acceptors_) {
+        Listener* l = a.get();
+        l->loop()->RunInLoop([this, l, remaining, on_stopped_cb]() {
+            l->Stop();
+            if (remaining->fetch_sub(1) == 1) {
+                loop_->RunInLoop([this, on_stopped_cb]() {
+                    acceptors_.clear();
+                    StopInLoop(on_stopped_cb);
+                });
+            }
+        });
+    }
+}
+
 void TCPServer::Stop(DoneCallback on_stopped_cb) {
     DLOG_TRACE << "Entering ...";
     assert(status_ == kRunning);
@@ -79,13 +286,52 @@ void TCPServer::Stop(DoneCallback on_stopped_cb) {
     loop_->RunInLoop(std::bind(&TCPServer::StopInLoop, this, on_stopped_cb));
 }
 
+void TCPServer::Pause() {
+    PauseListeners(true);
+}
+
+void TCPServer::Continue() {
+    PauseListeners(false);
+}
+
+void TCPServer::PauseListeners(bool pause) {
+    DLOG_TRACE << "pause=" << pause;
+    auto f = [pause](Listener* l) {
+        if (pause) {
+            l->Pause();
+        } else {
+            l->Continue();
+        }
+    };
+
+    // The listeners are only modified in the listening loop
+    loop_->RunInLoop([this, f]() {
+        if (listener_) {
+            f(listener_.get());
+        }
+        for (auto& a : acceptors_) {
+            Listener* l = a.get();
+            l->loop()->RunInLoop([l, f]() {
+                f(l);
+            });
+        }
+    });
+}
+
 void TCPServer::StopInLoop(DoneCallback on_stopped_cb) {
     DLOG_TRACE << "Entering ...";
     assert(loop_->IsInLoopThread());
-    listener_->Stop();
-    listener_.reset();
+    if (!acceptors_.empty()) {
+        StopAcceptors(on_stopped_cb);
+        return;
+    }
+
+    if (listener_) {
+        listener_->Stop();
+        listener_.reset();
+    }
 
-    if (connections_.empty()) {
+    if (connections_.empty() && pending_conn_count_ == 0 && loop_conn_count_ == 0) {
         // Stop all the working threads now.
         DLOG_TRACE << "no connections";
         StopThreadPool();
@@ -105,19 +351,87 @@ void TCPServer::StopInLoop(DoneCallback on_stopped_cb) {
             }
         }
 
+        // The connections of the working loops are closed in their own threads
+        for (auto& l : loop_connections_) {
+            ConnectionMap* conns = l.second.get();
+            l.first->RunInLoop([this, conns]() {
+                for (auto& c : *conns) {
+                    if (c.second->IsConnected()) {
+                        DLOG_TRACE << "close connection id=" << c.second->id() << " fd=" << c.second->fd();
+                        c.second->Close();
+                    }
+                }
+            });
+        }
+
         stopped_cb_ = on_stopped_cb;
 
         // The working threads will be stopped after all the connections closed.
+        // The connections being created in the working threads are closed in AddConnection.
     }
 
     DLOG_TRACE << "exited, status=" << StatusToString();
 }
 
+void TCPServer::Broadcast(const std::string& payload,
+                          const ConnectionFilter& filter) {
+    Broadcast(std::make_shared<const std::string>(payload), filter);
+}
+
+void TCPServer::Broadcast(const std::shared_ptr<const std::string>& payload,
+                          const ConnectionFilter& filter) {
+    assert(payload);
+    if (!loop_connections_.empty()) {
+        // Every working loop sends the payload to its own connections
+        for (auto& l : loop_connections_) {
+            ConnectionMap* conns = l.second.get();
+            l.first->RunInLoop([conns, payload, filter]() {
+                for (auto& c : *conns) {
+                    if (c.second->IsConnected() && (!filter || filter(c.second))) {
+                        c.second->Send(payload);
+                    }
+                }
+            });
+        }
+        return;
+    }
+    loop_->RunInLoop(std::bind(&TCPServer::BroadcastInLoop, this, payload, filter));
+}
+
+void TCPServer::BroadcastInLoop(const std::shared_ptr<const std::string>& payload,
+                                const ConnectionFilter& filter) {
+    assert(loop_->IsInLoopThread());
+    typedef std::vector<TCPConnPtr> ConnectionList;
+    std::map<EventLoop*, std::shared_ptr<ConnectionList>> groups;
+    for (auto& c : connections_) {
+        std::shared_ptr<ConnectionList>& g = groups[c.second->loop()];
+        if (!g) {
+            g = std::make_shared<ConnectionList>();
+        }
+        g->push_back(c.second);
+    }
+
+    DLOG_TRACE << "payload size=" << payload->size() << " connections_.size()=" << connections_.size() << " loops=" << groups.size();
+    for (auto& g : groups) {
+        std::shared_ptr<ConnectionList> conns = g.second;
+        g.first->RunInLoop([conns, payload, filter]() {
+            for (auto& c : *conns) {
+                if (c->IsConnected() && (!filter || filter(c))) {
+                    c->Send(payload);
+                }
+            }
+        });
+    }
+}
+
 void TCPServer::StopThreadPool() {
     DLOG_TRACE << "pool=" << tpool_.get();
     assert(loop_->IsInLoopThread());
     assert(IsStopping());
     substatus_.store(kStoppingThreadPool);
+
+    // Queued before the loops stop, so the timers are canceled in their own threads
+    StopIdleReapers();
     tpool_->Stop(true);
     assert(tpool_->IsStopped());
 
@@ -140,50 +454,146 @@ void TCPServer::HandleNewConn(evpp_socket_t sockfd,
     }
 
     assert(IsRunning());
-    EventLoop* io_loop = GetNextLoop(raddr);
+    EventLoop* io_loop = GetNextLoop(sockfd, raddr);
+    uint64_t id = ++next_conn_id_;
+    ++pending_conn_count_;
+
+    // Count the connection at once, so the next connections of an accepting
+    // burst see it, see ThreadDispatchPolicy::kLeastConnections.
+    io_loop->connection_count_.fetch_add(1, std::memory_order_relaxed);
+
+    // The TCPConn is created in the IO thread which owns it,
+    // so its memory comes from the object pools of that EventLoop.
+    io_loop->RunInLoop(std::bind(&TCPServer::CreateConnInLoop, this, io_loop, sockfd, remote_addr, id, true));
+}
+
+void TCPServer::HandleNewConnInLoop(EventLoop* io_loop,
+                                    evpp_socket_t sockfd,
+                                    const std::string& remote_addr) {
+    DLOG_TRACE << "fd=" << sockfd;
+    assert(io_loop->IsInLoopThread());
+    if (IsStopping()) {
+        LOG_WARN << "this=" << this << " The server is at stopping status. Discard this socket fd=" << sockfd << " remote_addr=" << remote_addr;
+        EVUTIL_CLOSESOCKET(sockfd);
+        return;
+    }
+
+    // The connection is accepted by the IO thread which owns it, no handoff is needed
+    uint64_t id = ++next_conn_id_;
+    CreateConnInLoop(io_loop, sockfd, remote_addr, id, false);
+}
+
+void TCPServer::CreateConnInLoop(EventLoop* io_loop,
+                                 evpp_socket_t sockfd,
+                                 const std::string& remote_addr,
+                                 uint64_t id,
+                                 bool counted) {
+    assert(io_loop->IsInLoopThread());
 #ifdef H_DEBUG_MODE
-    std::string n = name_ + "-" + remote_addr + "#" + std::to_string(next_conn_id_);
+    std::string n = name_ + "-" + remote_addr + "#" + std::to_string(id);
 #else
-    std::string n = remote_addr;
+    const std::string& n = remote_addr;
 #endif
-    ++next_conn_id_;
-    TCPConnPtr conn(new TCPConn(io_loop, n, sockfd, listen_addr_, remote_addr, next_conn_id_));
+    TCPConnPtr conn = TCPConn::Create(io_loop, n, sockfd, listen_addr_, remote_addr, id);
     assert(conn->type() == TCPConn::kIncoming);
     conn->SetMessageCallback(msg_fn_);
     conn->SetConnectionCallback(conn_fn_);
     conn->SetCloseCallback(std::bind(&TCPServer::RemoveConnection, this, std::placeholders::_1));
-    io_loop->RunInLoop(std::bind(&TCPConn::OnAttachedToLoop, conn));
+
+    // The count taken by HandleNewConn is handed over to conn
+    conn->attached_ = counted;
+
+    IdleReaper* reaper = GetIdleReaper(io_loop);
+    if (reaper) {
+        reaper->Add(conn);
+    }
+
+    auto it = loop_connections_.find(io_loop);
+    if (it != loop_connections_.end()) {
+        // The multi-acceptor mode : the connection stays in io_loop until it is closed
+        (*it->second)[id] = conn;
+        ++loop_conn_count_;
+    } else {
+        // Register the connection before it can be closed,
+        // so AddConnection always runs before RemoveConnection.
+        loop_->RunInLoop(std::bind(&TCPServer::AddConnection, this, conn));
+    }
+    conn->OnAttachedToLoop();
+}
+
+void TCPServer::AddConnection(const TCPConnPtr& conn) {
+    assert(loop_->IsInLoopThread());
+    assert(pending_conn_count_ > 0);
+    --pending_conn_count_;
     connections_[conn->id()] = conn;
+
+    if (IsStopping() && conn->IsConnected()) {
+        // StopInLoop has closed the other connections before this one is added
+        DLOG_TRACE << "close connection id=" << conn->id() << " fd=" << conn->fd() << " since the server is stopping";
+        conn->Close();
+    }
 }
 
-EventLoop* TCPServer::GetNextLoop(const struct sockaddr_in* raddr) {
+EventLoop* TCPServer::GetNextLoop(evpp_socket_t sockfd, const struct sockaddr_in* raddr) {
     if (IsRoundRobin()) {
         return tpool_->GetNextLoop();
+    } else if (policy_ == kIncomingCPU) {
+        return tpool_->GetLoopForCPU(sock::GetIncomingCPU(sockfd));
+    } else if (policy_ == kLeastConnections) {
+        return tpool_->GetLeastConnectionsLoop();
+    } else if (policy_ == kLeastPendingTasks) {
+        return tpool_->GetLeastPendingTasksLoop();
+    } else if (policy_ == kCustom) {
+        EventLoop* loop = dispatcher_(tpool_.get(), raddr);
+        return loop ? loop : tpool_->GetNextLoop();
     } else {
         return tpool_->GetNextLoopWithHash(raddr->sin_addr.s_addr);
     }
 }
 
 void TCPServer::RemoveConnection(const TCPConnPtr& conn) {
-    DLOG_TRACE << "conn=" << conn.get() << " fd="<< conn->fd() << " connections_.size()=" << connections_.size();
+    DLOG_TRACE << "conn=" << conn.get() << " fd="<< conn->fd();
+    IdleReaper* reaper = GetIdleReaper(conn->loop());
+    if (reaper) {
+        // It is called in the IO thread of conn
+        reaper->Remove(conn->id());
+    }
+
+    auto it = loop_connections_.find(conn->loop());
+    if (it != loop_connections_.end()) {
+        // The multi-acceptor mode : the listening loop is only involved by the last connection when stopping
+        it->second->erase(conn->id());
+        if (--loop_conn_count_ == 0 && IsStopping()) {
+            loop_->RunInLoop(std::bind(&TCPServer::StopThreadPoolIfNoConnections, this));
+        }
+        return;
+    }
+
     auto f = [this, conn]() {
         // Remove the connection in the listening EventLoop
         DLOG_TRACE << "conn=" << conn.get() << " fd="<< conn->fd() << " connections_.size()=" << connections_.size();
         assert(this->loop_->IsInLoopThread());
         this->connections_.erase(conn->id());
-        if (IsStopping() && this->connections_.empty()) {
-            // At last, we stop all the working threads
-            DLOG_TRACE << "stop thread pool";
-            assert(substatus_.load() == kStoppingListener);
-            StopThreadPool();
-            if (stopped_cb_) {
-                stopped_cb_();
-                stopped_cb_ = DoneCallback();
-            }
-            status_.store(kStopped);
-        }
+        StopThreadPoolIfNoConnections();
     };
     loop_->RunInLoop(f);
 }
 
+void TCPServer::StopThreadPoolIfNoConnections() {
+    assert(loop_->IsInLoopThread());
+    // StopInLoop has not run yet if the listeners are still alive
+    if (IsStopping() && !listener_ && acceptors_.empty() &&
+            connections_.empty() && pending_conn_count_ == 0 && loop_conn_count_ == 0) {
+        // At last, we stop all the working threads
+        DLOG_TRACE << "stop thread pool";
+        assert(substatus_.load() == kStoppingListener);
+        StopThreadPool();
+        if (stopped_cb_) {
+            stopped_cb_();
+            stopped_cb_ = DoneCallback();
+        }
+        status_.store(kStopped);
+    }
+}
+
 }
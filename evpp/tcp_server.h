@@ -7,12 +7,12 @@
 
 #include "evpp/thread_dispatch_policy.h"
 #include "evpp/server_status.h"
+#include "evpp/listener.h"
 
 #include <map>
 
 namespace evpp {
 
-class Listener;
 
 // We can use this class to create a TCP server.
 // The typical usage is :
@@ -49,6 +49,7 @@ class Listener;
 class EVPP_EXPORT TCPServer : public ThreadDispatchPolicy, public ServerStatus {
 public:
     typedef std::function<void()> DoneCallback;
+    typedef std::function<bool(const TCPConnPtr&)> ConnectionFilter;
 
     // @brief The constructor of a TCPServer.
     // @param loop -
@@ -76,9 +77,76 @@ public:
     //  the TCP server is totally stopped
     void Stop(DoneCallback cb = DoneCallback());
 
+    // @brief Stop accepting new connections for a while, the connections
+    //  accepted before are not affected. It is thread safe.
+    void Pause();
+
+    // @brief Accept new connections again after Pause(). It is thread safe.
+    void Continue();
+
     // @brief Reinitialize some data fields after a fork
     void AfterFork();
 
+    // @brief Let every working thread own a SO_REUSEPORT listening socket
+    //  and accept the connections by itself, instead of accepting all the
+    //  connections in the listening loop and dispatching them to the working
+    //  threads. The kernel spreads the connections across the threads, so the
+    //  ThreadDispatchPolicy is ignored. If the threads are pinned to CPUs, the
+    //  listening socket of a thread prefers the connections received by its
+    //  CPU (SO_INCOMING_CPU).
+    //  It must be called before Init(). It takes effect only if thread_num > 0
+    //  and SO_REUSEPORT is supported, otherwise the server works as usual.
+    void SetMultiAcceptor(bool on) {
+        assert(status_ == kNull);
+        multi_acceptor_ = on;
+    }
+
+    // @brief Set the max count of connections accepted by a listening
+    //  socket in one readable event. See Listener::SetMaxAcceptsPerWakeup.
+    //  It must be called before Start().
+    void SetMaxAcceptsPerWakeup(int n) {
+        assert(n > 0);
+        max_accepts_per_wakeup_ = n;
+    }
+
+    // @brief The statistics of the connections accepted by this server.
+    //  It can be read in any thread.
+    const AcceptStats& accept_stats() const {
+        return *accept_stats_;
+    }
+
+    // @brief Close the connections which have read or written nothing for
+    //  timeout, see TCPConn::last_active_time(). Every working loop checks
+    //  its own connections with one timer which ticks kIdleBucketCount times
+    //  in timeout, so a connection is closed within [timeout, timeout + tick)
+    //  after it becomes idle, and recording the activity costs only a
+    //  timestamp per read or write.
+    //  It must be called before Start(). A zero timeout, the default, disables
+    //  it. Otherwise it must be at least kIdleBucketCount milliseconds, the
+    //  tick is never shorter than 1ms.
+    // @param busy - A connection for which it returns true is not closed
+    //  however long it is idle, e.g. a request of it is being processed.
+    //  It is invoked in the IO thread of the connection when it is found idle.
+    void SetIdleTimeout(Duration timeout, const ConnectionFilter& busy = ConnectionFilter()) {
+        assert(status_ == kNull || status_ == kInitialized);
+        assert(timeout.IsZero() || timeout.Nanoseconds() >= kIdleBucketCount * Duration::kMillisecond);
+        idle_timeout_ = timeout;
+        idle_busy_fn_ = busy;
+    }
+
+    // @brief Send the same payload to all the connections of this server.
+    //  The connections are grouped by their EventLoop and only one task is
+    //  posted to each loop, and the payload is shared by all the connections
+    //  without copying. It is thread safe.
+    // @param payload - The data to be sent. It must never be modified.
+    // @param filter - Only the connections for which filter returns true
+    //  receive the payload. It is invoked in the IO thread of each connection.
+    //  An empty filter selects all the connections.
+    void Broadcast(const std::shared_ptr<const std::string>& payload,
+                   const ConnectionFilter& filter = ConnectionFilter());
+    void Broadcast(const std::string& payload,
+                   const ConnectionFilter& filter = ConnectionFilter());
+
 public:
     // Set a connection event relative callback when the TCPServer
     // receives a new connection or an exist connection breaks down.
@@ -102,22 +170,60 @@ private:
     void StopThreadPool();
     void StopInLoop(DoneCallback on_stopped_cb);
     void RemoveConnection(const TCPConnPtr& conn);
+    void AddConnection(const TCPConnPtr& conn);
+    void StopThreadPoolIfNoConnections();
+    // counted is true if the connection has been counted in EventLoop::connection_count() of io_loop
+    void CreateConnInLoop(EventLoop* io_loop, evpp_socket_t sockfd, const std::string& remote_addr, uint64_t id, bool counted);
+    void HandleNewConnInLoop(EventLoop* io_loop, evpp_socket_t sockfd, const std::string& remote_addr);
+    void StartAcceptors();
+    void StopAcceptors(DoneCallback on_stopped_cb);
+    void PauseListeners(bool pause);
+    void BroadcastInLoop(const std::shared_ptr<const std::string>& payload,
+                         const ConnectionFilter& filter);
     void HandleNewConn(evpp_socket_t sockfd, const std::string& remote_addr/*ip:port*/, const struct sockaddr_in* raddr);
-    EventLoop* GetNextLoop(const struct sockaddr_in* raddr);
+    EventLoop* GetNextLoop(evpp_socket_t sockfd, const struct sockaddr_in* raddr);
+
+    enum { kIdleBucketCount = 8, };
+    class IdleReaper;
+    void StartIdleReapers();
+    void StopIdleReapers();
+    IdleReaper* GetIdleReaper(EventLoop* io_loop) const;
 private:
     EventLoop* loop_;  // the listening loop
     const std::string listen_addr_; // ip:port
     const std::string name_;
     std::unique_ptr<Listener> listener_;
+
+    // The listeners owned by the working threads in the multi-acceptor mode
+    bool multi_acceptor_ = false;
+    std::vector<std::unique_ptr<Listener>> acceptors_;
+    int max_accepts_per_wakeup_ = 1;
+    std::shared_ptr<AcceptStats> accept_stats_;
+
     std::shared_ptr<EventLoopThreadPool> tpool_;
     ConnectionCallback conn_fn_;
     MessageCallback msg_fn_;
 
     DoneCallback stopped_cb_;
 
+    // Modified by the working threads too in the multi-acceptor mode
+    std::atomic<uint64_t> next_conn_id_;
+    std::atomic<int> pending_conn_count_; // The count of connections being created in the working threads
+
     // always in the listening loop thread
-    uint64_t next_conn_id_ = 0;
     typedef std::map<uint64_t/*the id of the connection*/, TCPConnPtr> ConnectionMap;
     ConnectionMap connections_;
+
+    // The connections of every working loop in the multi-acceptor mode,
+    // each map is only accessed in the thread of its loop, so a connection
+    // is accepted, served and closed without the listening loop.
+    // It is not modified after Start().
+    std::map<EventLoop*, std::unique_ptr<ConnectionMap>> loop_connections_;
+    std::atomic<int> loop_conn_count_; // The count of the connections in loop_connections_
+
+    // One for each working loop, it is not modified after Start().
+    Duration idle_timeout_;
+    ConnectionFilter idle_busy_fn_;
+    std::map<EventLoop*, std::shared_ptr<IdleReaper>> idle_reapers_;
 };
 }
\ No newline at end of file
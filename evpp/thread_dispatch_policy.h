@@ -1,23 +1,64 @@
 #pragma once
 
+#include <functional>
+
+struct sockaddr_in;
+
 namespace evpp {
+class EventLoop;
+class EventLoopThreadPool;
+
 class ThreadDispatchPolicy {
 public:
     enum Policy {
         kRoundRobin,
         kIPAddressHashing,
+
+        // Dispatch a connection to the loop pinned to the CPU which received
+        // it (SO_INCOMING_CPU), so it is handled on the CPU its packets are
+        // processed, which is usually chosen by the RX queue of the NIC.
+        // See EventLoopThreadPool::SetCPUAffinity.
+        // It works as kRoundRobin if the CPU is unknown.
+        kIncomingCPU,
+
+        // Dispatch to the loop serving the least connections, or the least
+        // HTTP requests being processed. See EventLoop::connection_count.
+        // An HTTP request is counted until it is responded, or until its
+        // response callback is destroyed if the handler never responds.
+        kLeastConnections,
+
+        // Dispatch to the loop with the least tasks queued by RunInLoop and
+        // QueueInLoop. See EventLoop::pending_functor_count.
+        kLeastPendingTasks,
+
+        // Dispatch by the callback set by SetDispatcher
+        kCustom,
     };
 
+    // @brief The callback to choose the loop for a new connection or an HTTP request.
+    // @param pool - The loops to choose from.
+    // @param raddr - The remote address. It may be nullptr if it is unknown.
+    // @return The loop. nullptr means to work as kRoundRobin.
+    typedef std::function<EventLoop*(EventLoopThreadPool* pool, const struct sockaddr_in* raddr)> Dispatcher;
+
     ThreadDispatchPolicy() : policy_(kRoundRobin) {}
 
     void SetThreadDispatchPolicy(Policy v) {
         policy_ = v;
     }
 
+    // @brief Set the policy to kCustom with the dispatcher.
+    //  It is called in the listening thread, so it must be fast and thread safe.
+    void SetDispatcher(const Dispatcher& d) {
+        dispatcher_ = d;
+        policy_ = kCustom;
+    }
+
     bool IsRoundRobin() const {
         return policy_ == kRoundRobin;
     }
 protected:
     Policy policy_;
+    Dispatcher dispatcher_;
 };
-}
\ No newline at end of file
+}
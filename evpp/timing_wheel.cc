@@ -0,0 +1,212 @@
+#include "evpp/inner_pre.h"
+
+#include "evpp/timing_wheel.h"
+#include "evpp/event_watcher.h"
+#include "evpp/event_loop.h"
+
+namespace evpp {
+
+const Duration TimingWheel::kDefaultTick = Duration(int64_t(1000 * 1000));
+
+TimingWheel::TimingWheel(EventLoop* loop, Duration tick)
+    : loop_(loop)
+    , tick_(tick)
+    , start_(std::chrono::steady_clock::now())
+    , current_(0)
+    , size_(0)
+    , armed_(false)
+    , armed_tick_(0) {
+    assert(tick_.Nanoseconds() > 0);
+    timer_.reset(new TimerEventWatcher(loop_, std::bind(&TimingWheel::OnTick, this), tick_));
+    timer_->Init();
+}
+
+TimingWheel::~TimingWheel() {
+    // Detach the timers left, so they are not scheduled any more
+    auto clear = [](Slot* s) {
+        while (!s->IsEmpty()) {
+            Unlink(s->next_);
+        }
+    };
+    for (int i = 0; i < kRootSize; ++i) {
+        clear(&root_[i]);
+    }
+    for (int l = 0; l < kLevelCount; ++l) {
+        for (int i = 0; i < kLevelSize; ++i) {
+            clear(&levels_[l][i]);
+        }
+    }
+    timer_.reset();
+}
+
+uint64_t TimingWheel::NowTick() const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+    return static_cast<uint64_t>(elapsed.count()) / static_cast<uint64_t>(tick_.Nanoseconds());
+}
+
+void TimingWheel::Add(Timer* t, Duration timeout) {
+    assert(loop_->IsInLoopThread());
+    Remove(t);
+
+    uint64_t now = NowTick();
+    if (size_ == 0) {
+        // Nothing to run between current_ and now, so skip them
+        current_ = std::max(current_, now);
+    }
+
+    // One more tick to make sure the timer never expires earlier than timeout,
+    // since now is rounded down.
+    int64_t ns = std::max<int64_t>(timeout.Nanoseconds(), 0);
+    uint64_t ticks = static_cast<uint64_t>((ns + tick_.Nanoseconds() - 1) / tick_.Nanoseconds());
+    t->expire_ = now + ticks + 1;
+    Insert(t);
+    ++size_;
+
+    if (!armed_ || t->expire_ < armed_tick_) {
+        Arm(t->expire_);
+    }
+}
+
+void TimingWheel::Remove(Timer* t) {
+    if (t->IsScheduled()) {
+        Unlink(t);
+        --size_;
+    }
+}
+
+void TimingWheel::Insert(Timer* t) {
+    uint64_t expire = t->expire_;
+    if (expire < current_) {
+        // It is expired, run it at the next tick
+        Append(&root_[current_ & (kRootSize - 1)], t);
+        return;
+    }
+
+    uint64_t delta = expire - current_;
+    if (delta < kRootSize) {
+        Append(&root_[expire & (kRootSize - 1)], t);
+        return;
+    }
+
+    if (delta >= kMaxTicks) {
+        // Put it at the end of the range, it will be moved down and
+        // inserted again with the real expiration tick.
+        expire = current_ + kMaxTicks - 1;
+    }
+
+    int shift = kRootBits;
+    for (int l = 0; l < kLevelCount; ++l) {
+        shift += kLevelBits;
+        if (expire - current_ < (uint64_t(1) << shift) || l == kLevelCount - 1) {
+            Append(&levels_[l][(expire >> (shift - kLevelBits)) & (kLevelSize - 1)], t);
+            return;
+        }
+    }
+}
+
+void TimingWheel::Append(Slot* s, Timer* t) {
+    t->prev_ = s->prev_;
+    t->next_ = s;
+    s->prev_->next_ = t;
+    s->prev_ = t;
+}
+
+void TimingWheel::Unlink(Timer* t) {
+    t->prev_->next_ = t->next_;
+    t->next_->prev_ = t->prev_;
+    t->prev_ = t->next_ = nullptr;
+}
+
+int TimingWheel::Cascade(int level, int index) {
+    Slot* s = &levels_[level][index];
+    while (!s->IsEmpty()) {
+        Timer* t = s->next_;
+        Unlink(t);
+        Insert(t);
+    }
+    return index;
+}
+
+void TimingWheel::Advance(uint64_t now) {
+    while (current_ <= now) {
+        if (size_ == 0) {
+            current_ = now + 1;
+            break;
+        }
+
+        int index = static_cast<int>(current_ & (kRootSize - 1));
+        if (index == 0) {
+            // The root goes around, move the timers of the next slot of
+            // the upper level down, and so on.
+            int l = 0;
+            int shift = kRootBits;
+            while (l < kLevelCount && Cascade(l, static_cast<int>((current_ >> shift) & (kLevelSize - 1))) == 0) {
+                ++l;
+                shift += kLevelBits;
+            }
+        }
+        ++current_;
+
+        // Take out the expired timers first, since the callbacks may add
+        // timers into this slot or remove the other expired timers.
+        Slot expired;
+        Slot* s = &root_[index];
+        if (!s->IsEmpty()) {
+            expired.next_ = s->next_;
+            expired.prev_ = s->prev_;
+            expired.next_->prev_ = &expired;
+            expired.prev_->next_ = &expired;
+            s->next_ = s->prev_ = s;
+        }
+
+        while (!expired.IsEmpty()) {
+            Timer* t = expired.next_;
+            Unlink(t);
+            --size_;
+            t->OnTimeout();
+        }
+    }
+}
+
+void TimingWheel::Arm(uint64_t tick) {
+    auto deadline = start_ + std::chrono::nanoseconds(tick * static_cast<uint64_t>(tick_.Nanoseconds()));
+    auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+
+    // A zero timeout means waiting forever for TimerEventWatcher
+    int64_t ns = std::max<int64_t>(delay.count(), Duration::kMicrosecond);
+    timer_->AsyncWait(Duration(ns));
+    armed_ = true;
+    armed_tick_ = tick;
+}
+
+void TimingWheel::ArmNext() {
+    if (size_ == 0) {
+        return;
+    }
+
+    uint64_t index = current_ & (kRootSize - 1);
+    if (index == 0) {
+        // The timers of the upper levels are to be moved down
+        Arm(current_);
+        return;
+    }
+
+    for (uint64_t i = index; i < kRootSize; ++i) {
+        if (!root_[i].IsEmpty()) {
+            Arm(current_ + i - index);
+            return;
+        }
+    }
+
+    // Wake up when the root goes around
+    Arm(current_ + kRootSize - index);
+}
+
+void TimingWheel::OnTick() {
+    armed_ = false;
+    Advance(NowTick());
+
+    // The timers added by the callbacks may have armed a later tick
+    ArmNext();
+}
+}
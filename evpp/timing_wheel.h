@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+
+#include "evpp/inner_pre.h"
+#include "evpp/duration.h"
+
+namespace evpp {
+
+class EventLoop;
+class TimerEventWatcher;
+
+// TimingWheel is a hierarchical timing wheel which schedules lots of timers
+// in an EventLoop with O(1) add and cancel, while the libevent timers are
+// kept in a min-heap with O(log n) add and cancel.
+//
+// There are 4 levels of 256, 64, 64 and 64 slots. A timer is put into the
+// slot of its expiration tick in the lowest level which covers it, and is
+// moved down to the lower levels as the time goes by. A timeout longer than
+// the whole range (2^26 ticks, about 18 hours with the default 1ms tick) is
+// rescheduled when it reaches the end of the range.
+//
+// Only one libevent timer is used by the wheel, it is armed to the next
+// expiration or the next moving down of the timers. The time is read from
+// the monotonic clock on every Add, not from the time cached by
+// EventLoop::Now(), since a timer added late in a long iteration would expire
+// early.
+//
+// It is not thread safe. It must only be used in the thread of the EventLoop.
+class EVPP_EXPORT TimingWheel {
+public:
+    // The timer is a node of the intrusive lists of the wheel,
+    // so adding and canceling it never allocates memory.
+    class EVPP_EXPORT Timer {
+    public:
+        Timer() : prev_(nullptr), next_(nullptr), expire_(0) {}
+        virtual ~Timer() {}
+
+        bool IsScheduled() const {
+            return next_ != nullptr;
+        }
+    protected:
+        // It is invoked when the timer expires, after it is removed from the wheel.
+        virtual void OnTimeout() = 0;
+    private:
+        friend class TimingWheel;
+        Timer* prev_;
+        Timer* next_;
+        uint64_t expire_; // The expiration tick
+    };
+
+    static const Duration kDefaultTick; // = 1ms
+
+    explicit TimingWheel(EventLoop* loop, Duration tick = kDefaultTick);
+    ~TimingWheel();
+
+    // @brief Schedule the timer to expire after timeout. It is rescheduled if
+    //  it has been scheduled. The timer must stay alive until it expires or
+    //  is removed.
+    void Add(Timer* t, Duration timeout);
+
+    // @brief Remove the timer. It does nothing if the timer is not scheduled.
+    void Remove(Timer* t);
+
+    // The count of the scheduled timers
+    size_t size() const {
+        return size_;
+    }
+
+    Duration tick() const {
+        return tick_;
+    }
+
+private:
+    enum {
+        kRootBits = 8,
+        kLevelBits = 6,
+        kRootSize = 1 << kRootBits,
+        kLevelSize = 1 << kLevelBits,
+        kLevelCount = 3, // The levels above the root
+        kMaxTicks = 1 << (kRootBits + kLevelCount * kLevelBits),
+    };
+
+    // The sentinel of a circular list of timers
+    struct Slot : public Timer {
+        Slot() {
+            prev_ = next_ = this;
+        }
+        bool IsEmpty() const {
+            return next_ == this;
+        }
+        virtual void OnTimeout() {}
+    };
+
+    uint64_t NowTick() const;
+    void Insert(Timer* t);
+    static void Append(Slot* s, Timer* t);
+    static void Unlink(Timer* t);
+
+    // Move the timers of a slot to the lower levels.
+    // Return the index of the slot.
+    int Cascade(int level, int index);
+
+    // Run the timers expired before tick
+    void Advance(uint64_t tick);
+
+    // Arm the libevent timer to wake up at tick
+    void Arm(uint64_t tick);
+    void ArmNext();
+    void OnTick();
+
+private:
+    EventLoop* loop_;
+    Duration tick_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t current_; // The next tick to be processed
+    size_t size_;
+
+    Slot root_[kRootSize];
+    Slot levels_[kLevelCount][kLevelSize];
+
+    std::unique_ptr<TimerEventWatcher> timer_;
+    bool armed_;
+    uint64_t armed_tick_;
+};
+}
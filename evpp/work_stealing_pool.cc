@@ -0,0 +1,153 @@
+#include "evpp/inner_pre.h"
+
+#include "evpp/work_stealing_pool.h"
+#include "evpp/event_loop.h"
+
+namespace evpp {
+
+namespace {
+// The pool and the index of the current thread, if it is a thread of a pool
+struct CurrentWorker {
+    WorkStealingPool* pool;
+    size_t index;
+};
+thread_local CurrentWorker g_current_worker = { nullptr, 0 };
+
+// Run work, and then done in the thread of loop
+struct CompletionTask {
+    EventLoop* loop;
+    Task work;
+    Task done;
+
+    void operator()() {
+        work();
+        loop->RunInLoop(std::move(done));
+    }
+};
+}
+
+WorkStealingPool::WorkStealingPool(uint32_t thread_num) {
+    assert(thread_num > 0);
+    for (uint32_t i = 0; i < thread_num; ++i) {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    if (IsRunning()) {
+        Stop();
+    }
+}
+
+bool WorkStealingPool::Start() {
+    assert(status_ == kNull);
+    status_ = kRunning;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->thread = std::thread(&WorkStealingPool::Run, this, i);
+    }
+    return true;
+}
+
+void WorkStealingPool::Stop() {
+    DLOG_TRACE << "pending_count_=" << pending_count_.load();
+    assert(g_current_worker.pool != this);
+    status_ = kStopping;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_all();
+    }
+
+    for (auto& w : workers_) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+    status_ = kStopped;
+}
+
+void WorkStealingPool::Submit(Task&& task) {
+    assert(status_ == kRunning || status_ == kStopping);
+    size_t index = 0;
+    if (g_current_worker.pool == this) {
+        index = g_current_worker.index;
+    } else {
+        index = static_cast<size_t>(next_.fetch_add(1, std::memory_order_relaxed) % workers_.size());
+    }
+
+    // Count it before it is pushed, so an idle thread never misses it
+    // when it checks pending_count_ before sleeping.
+    pending_count_.fetch_add(1);
+    Worker* w = workers_[index].get();
+    {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        w->tasks.push_back(std::move(task));
+    }
+
+    if (idle_count_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_one();
+    }
+}
+
+void WorkStealingPool::Submit(EventLoop* loop, Task&& work, Task&& done) {
+    CompletionTask t;
+    t.loop = loop;
+    t.work = std::move(work);
+    t.done = std::move(done);
+    Submit(Task(std::move(t)));
+}
+
+bool WorkStealingPool::Pop(size_t index, Task* task) {
+    Worker* w = workers_[index].get();
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (w->tasks.empty()) {
+        return false;
+    }
+
+    *task = std::move(w->tasks.back());
+    w->tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(size_t index, Task* task) {
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker* w = workers_[(index + i) % workers_.size()].get();
+        std::lock_guard<std::mutex> lock(w->mutex);
+        if (!w->tasks.empty()) {
+            *task = std::move(w->tasks.front());
+            w->tasks.pop_front();
+            steal_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::Run(size_t index) {
+    g_current_worker.pool = this;
+    g_current_worker.index = index;
+    SetCurrentThreadName(name_prefix_ + std::to_string(index));
+
+    for (;;) {
+        Task task;
+        if (Pop(index, &task) || Steal(index, &task)) {
+            pending_count_.fetch_sub(1);
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++idle_count_;
+        cond_.wait(lock, [this]() {
+            return pending_count_.load() > 0 || !IsRunning();
+        });
+        --idle_count_;
+        if (!IsRunning() && pending_count_.load() == 0) {
+            break;
+        }
+    }
+
+    g_current_worker.pool = nullptr;
+}
+}
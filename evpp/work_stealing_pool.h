@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "evpp/inner_pre.h"
+#include "evpp/server_status.h"
+#include "evpp/task.h"
+
+namespace evpp {
+
+class EventLoop;
+
+// WorkStealingPool runs the CPU-bound tasks out of the IO threads, so a slow
+// task never blocks the other connections of an EventLoop.
+//
+// Every thread has its own deque of tasks. A task submitted in a thread of
+// the pool is pushed to the back of the deque of that thread and is popped
+// from the back, so the tasks split from a task run on the same thread while
+// they are hot in cache. The tasks submitted out of the pool are spread to
+// the deques in turn. A thread with nothing to do steals from the front of
+// the deques of the others before it goes to sleep.
+//
+// Usage :
+//
+//    std::shared_ptr<WorkStealingPool> pool(new WorkStealingPool(4));
+//    pool->Start();
+//    pool->Submit(loop, []() { /* The heavy work */ },
+//                       []() { /* It runs in the thread of loop then */ });
+//    ...
+//    pool->Stop();
+//
+class EVPP_EXPORT WorkStealingPool : public ServerStatus {
+public:
+    explicit WorkStealingPool(uint32_t thread_num);
+    ~WorkStealingPool();
+
+    // @brief Start the threads, named "evpp-compute-<i>" by default.
+    bool Start();
+
+    // @brief Run the tasks left and join the threads.
+    //  It must not be called in a thread of this pool.
+    void Stop();
+
+    // @brief Name the i-th thread prefix + i. It must be called before Start().
+    void SetThreadNamePrefix(const std::string& prefix) {
+        name_prefix_ = prefix;
+    }
+
+    // @brief Run task in a thread of this pool. It is thread safe.
+    //  The tasks must be submitted before Stop(), except by the tasks themselves.
+    void Submit(Task&& task);
+
+    // @brief Run work in a thread of this pool, and then run done in the
+    //  thread of loop by EventLoop::RunInLoop. It is thread safe.
+    void Submit(EventLoop* loop, Task&& work, Task&& done);
+
+public:
+    uint32_t thread_num() const {
+        return static_cast<uint32_t>(workers_.size());
+    }
+
+    // The count of the tasks waiting to be run
+    int64_t pending_count() const {
+        return pending_count_.load();
+    }
+
+    // The count of the tasks run by a thread other than the one they were pushed to
+    uint64_t steal_count() const {
+        return steal_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks; // @Guarded By mutex
+        std::thread thread;
+    };
+
+    void Run(size_t index);
+    bool Pop(size_t index, Task* task);
+    bool Steal(size_t index, Task* task);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::string name_prefix_ = "evpp-compute-";
+    std::atomic<uint64_t> next_ = { 0 };
+    std::atomic<int64_t> pending_count_ = { 0 };
+    std::atomic<uint64_t> steal_count_ = { 0 };
+
+    // The idle threads sleep on cond_
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::atomic<int> idle_count_ = { 0 };
+};
+}
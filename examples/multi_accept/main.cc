@@ -1,5 +1,4 @@
 #include <evpp/tcp_server.h>
-#include <evpp/event_loop_thread_pool.h>
 #include <evpp/buffer.h>
 #include <evpp/tcp_conn.h>
 
@@ -29,20 +28,14 @@ int main(int argc, char* argv[]) {
         thread_num = atoi(argv[2]);
     }
 
+    // Every working thread owns a SO_REUSEPORT listening socket and accepts
+    // the connections by itself, the kernel spreads the connections across them.
     evpp::EventLoop loop;
-    evpp::EventLoopThreadPool tpool(&loop, thread_num);
-    tpool.Start(true);
-
-    std::vector<std::shared_ptr<evpp::TCPServer>> tcp_servers;
-    for (uint32_t i = 0; i < thread_num; i++) {
-        evpp::EventLoop* next = tpool.GetNextLoop();
-        std::shared_ptr<evpp::TCPServer> s(new evpp::TCPServer(next, addr, std::to_string(i) + "#server", 0));
-        s->SetMessageCallback(&OnMessage);
-        s->Init();
-        s->Start();
-        tcp_servers.push_back(s);
-    }
-    
+    evpp::TCPServer server(&loop, addr, "MultiAcceptServer", thread_num);
+    server.SetMultiAcceptor(true);
+    server.SetMessageCallback(&OnMessage);
+    server.Init();
+    server.Start();
     loop.Run();
     return 0;
 }
@@ -0,0 +1,127 @@
+// A TCP relay which forwards the data between its clients and a backend server.
+//
+// Both directions are flow controlled by TCPConn::SetBackpressureSource :
+// when one side can not keep up, the relay stops reading from the other side
+// instead of buffering the data without bound.
+
+#include <evpp/tcp_server.h>
+#include <evpp/tcp_client.h>
+#include <evpp/buffer.h>
+#include <evpp/tcp_conn.h>
+
+#include <map>
+
+static const size_t kHighWaterMark = 1024 * 1024;
+static const size_t kLowWaterMark = 64 * 1024;
+
+class Relay {
+public:
+    Relay(evpp::EventLoop* loop, const std::string& listen_addr, const std::string& backend_addr)
+        : loop_(loop), backend_addr_(backend_addr), server_(loop, listen_addr, "TCPRelay", 0) {
+        server_.SetConnectionCallback(std::bind(&Relay::OnConnection, this, std::placeholders::_1));
+        server_.SetMessageCallback(std::bind(&Relay::OnMessage, this, std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void Start() {
+        server_.Init();
+        server_.Start();
+    }
+
+private:
+    void OnConnection(const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            LOG_INFO << "Accept a new connection from " << conn->remote_addr();
+
+            // Do not read from the client until the backend is connected
+            conn->PauseReading();
+            conn->SetHighWaterMarkCallback(evpp::HighWaterMarkCallback(), kHighWaterMark);
+            conn->SetLowWaterMark(kLowWaterMark);
+
+            std::shared_ptr<evpp::TCPClient> backend(new evpp::TCPClient(loop_, backend_addr_, "TCPRelayBackend"));
+            backend->set_auto_reconnect(false);
+            std::weak_ptr<evpp::TCPConn> wconn(conn);
+            backend->SetConnectionCallback([wconn](const evpp::TCPConnPtr& bconn) {
+                evpp::TCPConnPtr c = wconn.lock();
+                if (!bconn->IsConnected()) {
+                    if (c && c->IsConnected()) {
+                        c->Close();
+                    }
+                    return;
+                }
+
+                if (!c || !c->IsConnected()) {
+                    bconn->Close();
+                    return;
+                }
+
+                bconn->SetHighWaterMarkCallback(evpp::HighWaterMarkCallback(), kHighWaterMark);
+                bconn->SetLowWaterMark(kLowWaterMark);
+
+                // Stop reading from one side while the output of the other side is full
+                bconn->SetBackpressureSource(c);
+                c->SetBackpressureSource(bconn);
+                c->ResumeReading();
+            });
+            backend->SetMessageCallback([wconn](const evpp::TCPConnPtr&, evpp::Buffer* msg) {
+                evpp::TCPConnPtr c = wconn.lock();
+                if (c) {
+                    c->Send(msg);
+                } else {
+                    msg->Reset();
+                }
+            });
+            backends_[conn->id()] = backend;
+            backend->Connect();
+        } else {
+            LOG_INFO << "Disconnected from " << conn->remote_addr();
+            auto it = backends_.find(conn->id());
+            if (it != backends_.end()) {
+                std::shared_ptr<evpp::TCPClient> backend = it->second;
+                backends_.erase(it);
+                backend->Disconnect();
+
+                // Delete the TCPClient after it is totally disconnected
+                loop_->QueueInLoop([backend]() {});
+            }
+        }
+    }
+
+    void OnMessage(const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        auto it = backends_.find(conn->id());
+        if (it == backends_.end()) {
+            msg->Reset();
+            return;
+        }
+
+        evpp::TCPConnPtr bconn = it->second->conn();
+        if (bconn) {
+            bconn->Send(msg);
+        }
+    }
+
+private:
+    evpp::EventLoop* loop_;
+    std::string backend_addr_;
+    evpp::TCPServer server_;
+    std::map<uint64_t, std::shared_ptr<evpp::TCPClient>> backends_;
+};
+
+int main(int argc, char* argv[]) {
+    std::string listen_addr = "0.0.0.0:9098";
+    std::string backend_addr = "127.0.0.1:9099";
+    if (argc == 3) {
+        listen_addr = argv[1];
+        backend_addr = argv[2];
+    } else if (argc != 1) {
+        printf("Usage: %s <listen_ip:port> <backend_ip:port>\n", argv[0]);
+        return -1;
+    }
+
+    evpp::EventLoop loop;
+    Relay relay(&loop, listen_addr, backend_addr);
+    relay.Start();
+    loop.Run();
+    return 0;
+}
+
+#include "../echo/tcpecho/winmain-inl.h"
@@ -1,5 +1,3 @@
-#include <set>
-
 #include <evpp/tcp_server.h>
 #include <evpp/buffer.h>
 #include <evpp/tcp_conn.h>
@@ -34,25 +32,20 @@ private:
             conn->Close();
         }
 
-        for (auto &c : conns_) {
-            c->Send(s);
-        }
+        server_->Broadcast(s);
     }
 
     void OnConnection(const evpp::TCPConnPtr& conn) {
         if (conn->IsConnected()) {
             LOG_INFO << "A new connection from " << conn->remote_addr() << " to " << server_->listen_addr() << " is UP";
-            conns_.insert(conn);
         } else {
             LOG_INFO << "Disconnected from " << conn->remote_addr();
-            conns_.erase(conn);
         }
     }
 
 private:
     std::shared_ptr<evpp::EventLoop> loop_;
     std::shared_ptr<evpp::TCPServer> server_;
-    std::set<evpp::TCPConnPtr> conns_;
 };
 
 int main(int argc, char* argv[]) {
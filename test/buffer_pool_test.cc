@@ -0,0 +1,56 @@
+#include "test_common.h"
+
+#include <evpp/buffer_pool.h>
+
+using evpp::BufferPool;
+
+TEST_UNIT(testBufferPoolSizeClass) {
+    BufferPool pool;
+    size_t n = 0;
+    char* p = pool.Allocate(1, &n);
+    H_TEST_EQUAL(n, BufferPool::kMinBlockSize);
+    pool.Deallocate(p, n);
+
+    p = pool.Allocate(1025, &n);
+    H_TEST_EQUAL(n, 2048);
+    pool.Deallocate(p, n);
+
+    // The big blocks are not cached
+    p = pool.Allocate(BufferPool::kMaxBlockSize + 1, &n);
+    H_TEST_EQUAL(n, BufferPool::kMaxBlockSize + 1);
+    H_TEST_EQUAL(pool.allocated_bytes(), n);
+    pool.Deallocate(p, n);
+    H_TEST_EQUAL(pool.allocated_bytes(), 0);
+    H_TEST_EQUAL(pool.cached_bytes(), BufferPool::kMinBlockSize + 2048);
+}
+
+TEST_UNIT(testBufferPoolReuse) {
+    BufferPool pool;
+    size_t n = 0;
+    char* p = pool.Allocate(1000, &n);
+    H_TEST_EQUAL(pool.miss_count(), 1);
+    pool.Deallocate(p, n);
+
+    size_t n2 = 0;
+    char* p2 = pool.Allocate(600, &n2);
+    H_TEST_ASSERT(p2 == p);
+    H_TEST_EQUAL(n2, n);
+    H_TEST_EQUAL(pool.hit_count(), 1);
+    H_TEST_EQUAL(pool.cached_bytes(), 0);
+    pool.Deallocate(p2, n2);
+
+    pool.Clear();
+    H_TEST_EQUAL(pool.cached_bytes(), 0);
+}
+
+TEST_UNIT(testBufferPoolMaxCachedBytes) {
+    BufferPool pool(4096);
+    size_t n1 = 0, n2 = 0;
+    char* p1 = pool.Allocate(4096, &n1);
+    char* p2 = pool.Allocate(4096, &n2);
+    H_TEST_EQUAL(pool.allocated_bytes(), 8192);
+    pool.Deallocate(p1, n1);
+    pool.Deallocate(p2, n2);
+    H_TEST_EQUAL(pool.allocated_bytes(), 0);
+    H_TEST_EQUAL(pool.cached_bytes(), 4096);
+}
@@ -1,6 +1,8 @@
 #include "test_common.h"
 
+#include <evpp/libevent.h>
 #include <evpp/buffer.h>
+#include <evpp/buffer_pool.h>
 
 using evpp::Buffer;
 using std::string;
@@ -256,3 +258,107 @@ TEST_UNIT(testBufferReserve) {
     H_TEST_EQUAL(buf.PrependableBytes(), Buffer::kCheapPrependSize);
 }
 
+
+TEST_UNIT(testBufferMove) {
+    Buffer buf;
+    buf.Append("HelloWorld");
+    buf.Skip(5);
+    const char* p = buf.data();
+
+    Buffer moved(std::move(buf));
+    H_TEST_EQUAL(moved.length(), 5);
+    H_TEST_ASSERT(moved.data() == p);
+    H_TEST_EQUAL(moved.ToString(), "World");
+    H_TEST_EQUAL(buf.length(), 0);
+    H_TEST_EQUAL(buf.capacity(), 0);
+
+    // The moved-from Buffer is still usable
+    buf.Append("Again");
+    H_TEST_EQUAL(buf.ToString(), "Again");
+
+    moved = std::move(buf);
+    H_TEST_EQUAL(moved.ToString(), "Again");
+    H_TEST_EQUAL(buf.length(), 0);
+}
+
+TEST_UNIT(testBufferReadFromFDWithScratch) {
+    evpp_socket_t fds[2];
+    int r = evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    H_TEST_ASSERT(r >= 0);
+
+    std::string data(Buffer::kInitialSize * 3, 'x');
+    H_TEST_EQUAL(::send(fds[0], data.data(), data.size(), 0), ssize_t(data.size()));
+
+    Buffer buf;
+    char scratch[Buffer::kInitialSize * 4];
+    int serrno = 0;
+    ssize_t n = buf.ReadFromFD(fds[1], scratch, sizeof scratch, &serrno);
+    H_TEST_EQUAL(n, ssize_t(data.size()));
+    H_TEST_EQUAL(buf.ToString(), data);
+
+    EVUTIL_CLOSESOCKET(fds[0]);
+    EVUTIL_CLOSESOCKET(fds[1]);
+}
+
+TEST_UNIT(testBufferLazyStorage) {
+    evpp::BufferPool pool;
+    {
+        Buffer buf(pool);
+        H_TEST_EQUAL(buf.capacity(), 0);
+        H_TEST_EQUAL(buf.length(), 0);
+        H_TEST_EQUAL(pool.allocated_bytes(), 0);
+
+        buf.Append("HelloWorld");
+        H_TEST_EQUAL(buf.ToString(), "HelloWorld");
+        H_TEST_EQUAL(buf.PrependableBytes(), Buffer::kCheapPrependSize);
+        H_TEST_EQUAL(pool.allocated_bytes(), buf.capacity());
+        buf.PrependInt8(1);
+        H_TEST_EQUAL(buf.length(), 11);
+
+        // The storage goes back to the pool when the Buffer is shrunk empty
+        buf.Reset();
+        buf.Shrink(0);
+        H_TEST_EQUAL(buf.capacity(), 0);
+        H_TEST_EQUAL(pool.allocated_bytes(), 0);
+        H_TEST_EQUAL(pool.miss_count(), 1);
+
+        // And it is reused
+        buf.Append("Again");
+        H_TEST_EQUAL(buf.ToString(), "Again");
+        H_TEST_EQUAL(pool.hit_count(), 1);
+    }
+    H_TEST_EQUAL(pool.allocated_bytes(), 0);
+    H_TEST_ASSERT(pool.cached_bytes() > 0);
+
+    // A lazy Buffer without storage can still be prepended
+    Buffer buf(pool);
+    buf.PrependInt32(7);
+    H_TEST_EQUAL(buf.ReadInt32(), 7);
+}
+
+TEST_UNIT(testBufferMoveKeepsPool) {
+    evpp::BufferPool pool;
+    {
+        Buffer buf(pool);
+        buf.Append("HelloWorld");
+        H_TEST_ASSERT(buf.pool() == &pool);
+
+        // Both the moved Buffer and the moved-from one belong to the pool
+        Buffer moved(std::move(buf));
+        H_TEST_ASSERT(moved.pool() == &pool);
+        H_TEST_ASSERT(buf.pool() == &pool);
+        H_TEST_EQUAL(buf.capacity(), 0);
+
+        buf.Append("Again");
+        H_TEST_EQUAL(buf.ToString(), "Again");
+        H_TEST_EQUAL(pool.allocated_bytes(), moved.capacity() + buf.capacity());
+
+        Buffer assigned;
+        assigned = std::move(buf);
+        H_TEST_ASSERT(assigned.pool() == &pool);
+        H_TEST_ASSERT(buf.pool() == &pool);
+        buf.Append("More");
+        H_TEST_EQUAL(pool.allocated_bytes(), moved.capacity() + buf.capacity() + assigned.capacity());
+    }
+    H_TEST_EQUAL(pool.allocated_bytes(), 0);
+}
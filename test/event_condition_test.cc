@@ -5,6 +5,7 @@
 #include <evpp/event_watcher.h>
 #include <evpp/event_loop.h>
 #include <thread>
+#include <atomic>
 
 // namespace {
 // static bool g_event_handler_called = false;
@@ -66,3 +67,35 @@ TEST_UNIT(testPipeEventWatcher) {
 
 
 
+#ifdef __linux__
+namespace {
+static std::atomic<int> g_eventfd_handler_count;
+static void HandleEventFd(evpp::EventLoop* loop) {
+    g_eventfd_handler_count++;
+    loop->Stop();
+}
+
+static void MyEventFdThread(evpp::EventLoop* loop, evpp::EventFdWatcher* ev) {
+    ev->AsyncWait();
+    loop->Run();
+    delete ev;
+}
+}
+
+TEST_UNIT(testEventFdWatcher) {
+    g_eventfd_handler_count = 0;
+    std::unique_ptr<evpp::EventLoop> loop(new evpp::EventLoop);
+    evpp::EventFdWatcher* ev = new evpp::EventFdWatcher(loop.get(), std::bind(&HandleEventFd, loop.get()));
+    H_TEST_ASSERT(ev->Init());
+
+    // The notifications before the handler is called are merged into one call
+    for (int i = 0; i < 10; ++i) {
+        ev->Notify();
+    }
+    std::thread th(MyEventFdThread, loop.get(), ev);
+    th.join();
+    loop.reset();
+    H_TEST_ASSERT(g_eventfd_handler_count == 1);
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+#endif
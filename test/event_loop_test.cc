@@ -4,9 +4,11 @@
 #include <evpp/libevent.h>
 #include <evpp/event_watcher.h>
 #include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
 #include <evpp/timestamp.h>
 
 #include <thread>
+#include <atomic>
 
 namespace evloop {
 static std::shared_ptr<evpp::EventLoop> loop;
@@ -158,4 +160,159 @@ TEST_UNIT(TestEventLoop6) {
 
 
 
- 
\ No newline at end of file
+ 
+// Test EventLoop::SetMaxTasksPerIteration
+TEST_UNIT(TestEventLoopTaskBudget) {
+    evpp::EventLoop loop;
+    loop.SetMaxTasksPerIteration(10);
+    int count = 0;
+    for (int i = 0; i < 100; ++i) {
+        loop.QueueInLoop([&count]() {
+            count++;
+        });
+    }
+    loop.QueueInLoop([&loop]() {
+        loop.Stop();
+    });
+    loop.Run();
+    H_TEST_EQUAL(count, 100);
+
+    const evpp::PendingTaskStats& st = loop.pending_task_stats();
+    H_TEST_ASSERT(st.task_count.load() >= 101);
+    H_TEST_ASSERT(st.batch_count.load() >= 11);
+    H_TEST_ASSERT(st.deferred_count.load() >= 10);
+    H_TEST_ASSERT(st.max_depth.load() >= 101);
+}
+
+// Test EventLoop::SetPendingQueueCapacity
+TEST_UNIT(TestEventLoopBoundedQueue) {
+    const int kCapacity = 4;
+    evpp::EventLoop loop;
+    loop.SetPendingQueueCapacity(kCapacity);
+
+    // The tasks queued before Run are only rejected by TryQueueInLoop
+    std::atomic<int> count(0);
+    for (int i = 0; i < kCapacity; ++i) {
+        H_TEST_ASSERT(loop.TryQueueInLoop([&count]() { count++; }));
+    }
+    H_TEST_ASSERT(!loop.TryQueueInLoop([&count]() { count++; }));
+    H_TEST_EQUAL(loop.pending_task_stats().rejected_count.load(), 1);
+
+    // The producer waits for the loop when the queue is full
+    const int kTaskCount = 1000;
+    std::thread producer([&loop, &count]() {
+        while (!loop.IsRunning()) {
+            usleep(1000);
+        }
+        for (int i = 0; i < kTaskCount; ++i) {
+            loop.QueueInLoop([&count]() { count++; });
+        }
+        loop.QueueInLoop([&loop]() {
+            loop.Stop();
+        });
+    });
+    loop.Run();
+    producer.join();
+    H_TEST_EQUAL(count.load(), kCapacity + kTaskCount);
+    H_TEST_ASSERT(loop.pending_task_stats().max_depth.load() <= kCapacity);
+}
+
+// Another EventLoop does not wait for a full queue
+TEST_UNIT(TestEventLoopBoundedQueueFromLoop) {
+    const int kCapacity = 4;
+    const int kTaskCount = 100;
+    evpp::EventLoop target;
+    target.SetPendingQueueCapacity(kCapacity);
+    std::thread t([&target]() {
+        target.Run();
+    });
+    while (!target.IsRunning()) {
+        usleep(1000);
+    }
+
+    // Block the target loop, so its queue is full
+    std::atomic<bool> release(false);
+    target.QueueInLoop([&release]() {
+        while (!release.load()) {
+            usleep(1000);
+        }
+    });
+
+    std::atomic<int> count(0);
+    evpp::EventLoop source;
+    source.QueueInLoop([&]() {
+        for (int i = 0; i < kTaskCount; ++i) {
+            target.QueueInLoop([&count]() { count++; });
+        }
+        release.store(true);
+        source.Stop();
+    });
+    source.Run();
+
+    for (int i = 0; i < 1000 && count.load() < kTaskCount; ++i) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(count.load(), kTaskCount);
+    H_TEST_ASSERT(target.pending_task_stats().overflow_count.load() >= uint64_t(kTaskCount - kCapacity));
+    target.Stop();
+    t.join();
+}
+
+TEST_UNIT(TestEventLoopNow) {
+    evpp::EventLoop loop;
+
+    // Not cached out of Run
+    std::chrono::steady_clock::time_point t0 = loop.Now();
+    usleep(2000);
+    H_TEST_ASSERT(t0 < loop.Now());
+
+    std::chrono::steady_clock::time_point t1;
+    bool same_in_iteration = false;
+    bool updated_in_next_iteration = false;
+    loop.RunAfter(evpp::Duration(0.01), [&]() {
+        t1 = loop.Now();
+        usleep(2000);
+        same_in_iteration = (t1 == loop.Now());
+        loop.QueueInLoop([&]() {
+            updated_in_next_iteration = !(loop.Now() < t1 + std::chrono::milliseconds(2));
+            loop.Stop();
+        });
+    });
+    loop.Run();
+    H_TEST_ASSERT(same_in_iteration);
+    H_TEST_ASSERT(updated_in_next_iteration);
+}
+
+// Test EventLoop::SetBusyPollDuration
+TEST_UNIT(TestEventLoopBusyPoll) {
+    evpp::EventLoopThread t;
+    t.Start(true);
+    evpp::EventLoop* loop = t.loop();
+    loop->SetBusyPollDuration(evpp::Duration(0.05));
+    H_TEST_EQUAL(loop->busy_poll_duration().Milliseconds(), 50);
+
+    // The tasks are run while the loop is spinning, or after it goes back to sleep
+    std::atomic<int> count(0);
+    for (int i = 0; i < 20; ++i) {
+        loop->QueueInLoop([&count]() {
+            count++;
+        });
+        usleep(i % 2 == 0 ? 1000 : 60 * 1000);
+    }
+
+    std::atomic<bool> fired(false);
+    loop->RunAfter(evpp::Duration(0.01), [&fired]() {
+        fired = true;
+    });
+    for (int i = 0; i < 1000 && (count.load() < 20 || !fired.load()); ++i) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(count.load(), 20);
+    H_TEST_ASSERT(fired.load());
+
+    // Stop it while it is spinning
+    loop->SetBusyPollDuration(evpp::Duration(10.0));
+    usleep(1000);
+    t.Stop(true);
+    H_TEST_ASSERT(t.IsStopped());
+}
@@ -74,3 +74,97 @@ TEST_UNIT(testEventLoopThreadPool2) {
     H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
 }
 
+TEST_UNIT(testEventLoopThreadPoolLeastPendingTasks) {
+    std::unique_ptr<evpp::EventLoopThread> loop(new evpp::EventLoopThread);
+    loop->Start(true);
+    std::unique_ptr<evpp::EventLoopThreadPool> pool(new evpp::EventLoopThreadPool(loop->loop(), 2));
+    H_TEST_ASSERT(pool->Start(true));
+    evpp::EventLoop* busy = pool->GetNextLoopWithHash(0);
+    evpp::EventLoop* idle = pool->GetNextLoopWithHash(1);
+
+    // Block the busy loop and queue some tasks behind
+    std::atomic<bool> blocked(false);
+    std::atomic<bool> released(false);
+    busy->RunInLoop([&]() {
+        blocked = true;
+        while (!released) {
+            usleep(1000);
+        }
+    });
+    while (!blocked) {
+        usleep(1000);
+    }
+    std::atomic<int> done(0);
+    for (int i = 0; i < 3; i++) {
+        busy->QueueInLoop([&done]() {
+            done++;
+        });
+    }
+
+    for (int i = 0; i < 4; i++) {
+        H_TEST_ASSERT(pool->GetLeastPendingTasksLoop() == idle);
+    }
+    H_TEST_EQUAL(pool->GetLeastConnectionsLoop()->connection_count(), 0);
+
+    released = true;
+    while (done.load() < 3) {
+        usleep(1000);
+    }
+
+    pool->Stop(true);
+    loop->Stop(true);
+    pool.reset();
+    loop.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+
+TEST_UNIT(testEventLoopThreadPoolAffinity) {
+    std::unique_ptr<evpp::EventLoopThread> loop(new evpp::EventLoopThread);
+    loop->Start(true);
+
+    // Pin all the threads to the CPU we are running on, which is surely allowed
+    int cpu = sched_getcpu();
+    H_TEST_ASSERT(cpu >= 0);
+    int thread_num = 2;
+    std::unique_ptr<evpp::EventLoopThreadPool> pool(new evpp::EventLoopThreadPool(loop->loop(), thread_num));
+    pool->SetCPUAffinity(std::vector<int>(1, cpu));
+    pool->SetThreadNamePrefix("evpp-io-");
+    H_TEST_ASSERT(pool->Start(true));
+    H_TEST_EQUAL(pool->GetCPU(0), cpu);
+    H_TEST_EQUAL(pool->GetCPU(1), cpu);
+
+    // The first thread pinned to the CPU takes its connections
+    evpp::EventLoop* first = pool->GetNextLoopWithHash(0);
+    H_TEST_ASSERT(pool->GetLoopForCPU(cpu) == first);
+    H_TEST_ASSERT(pool->GetLoopForCPU(-1) != nullptr);
+
+    for (int i = 0; i < thread_num; i++) {
+        std::atomic<bool> done(false);
+        std::string name;
+        cpu_set_t set;
+        pool->GetNextLoopWithHash(i)->RunInLoop([&]() {
+            char buf[16] = {};
+            pthread_getname_np(pthread_self(), buf, sizeof buf);
+            name = buf;
+            pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+            done = true;
+        });
+        while (!done) {
+            usleep(1000);
+        }
+        H_TEST_EQUAL(name, "evpp-io-" + std::to_string(i));
+        H_TEST_EQUAL(CPU_COUNT(&set), 1);
+        H_TEST_ASSERT(CPU_ISSET(cpu, &set));
+    }
+
+    pool->Stop(true);
+    loop->Stop(true);
+    pool.reset();
+    loop.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+#endif
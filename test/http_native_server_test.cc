@@ -0,0 +1,576 @@
+#include "test_common.h"
+
+#include <evpp/libevent.h>
+#include <evpp/buffer.h>
+#include <evpp/sockets.h>
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/event_loop_thread_pool.h>
+#include <evpp/work_stealing_pool.h>
+
+#include "evpp/http/context.h"
+#include "evpp/http/request_parser.h"
+#include "evpp/http/native_service.h"
+#include "evpp/http/response_writer.h"
+#include "evpp/http/http_server.h"
+
+#include <mutex>
+#include <set>
+#include <thread>
+
+using evpp::http::RequestParser;
+
+TEST_UNIT(testHTTPRequestParser) {
+    // The request comes byte by byte
+    const std::string req = "POST /echo?a=1 HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\nX-Empty:\r\n\r\nhello"
+                            "GET /next HTTP/1.1\r\n\r\n";
+    evpp::Buffer buf;
+    RequestParser parser;
+    size_t i = 0;
+    RequestParser::Result r = RequestParser::kNeedMore;
+    for (; i < req.size() && r == RequestParser::kNeedMore; ++i) {
+        buf.Append(req.data() + i, 1);
+        r = parser.Parse(&buf);
+    }
+    H_TEST_EQUAL(r, RequestParser::kComplete);
+    H_TEST_EQUAL(i, req.find("GET"));
+    H_TEST_ASSERT(parser.method() == "POST");
+    H_TEST_ASSERT(parser.uri() == "/echo?a=1");
+    H_TEST_EQUAL(parser.minor_version(), 1);
+    H_TEST_ASSERT(parser.keep_alive());
+    H_TEST_EQUAL(parser.headers().size(), 3U);
+    H_TEST_ASSERT(parser.headers()[0].name == "Host");
+    H_TEST_ASSERT(parser.headers()[0].value == "localhost");
+    H_TEST_ASSERT(parser.headers()[2].name == "X-Empty");
+    H_TEST_ASSERT(parser.headers()[2].value.empty());
+    H_TEST_ASSERT(parser.body() == "hello");
+
+    // The views point into the buffer
+    H_TEST_ASSERT(parser.uri().data() >= buf.data() && parser.uri().data() < buf.data() + buf.length());
+
+    // The pipelined one
+    buf.Retrieve(parser.size());
+    parser.Reset();
+    buf.Append(req.data() + i, req.size() - i);
+    H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kComplete);
+    H_TEST_ASSERT(parser.method() == "GET");
+    H_TEST_ASSERT(parser.uri() == "/next");
+    H_TEST_ASSERT(parser.body().empty());
+    H_TEST_EQUAL(parser.size(), buf.length());
+
+    // A chunked body is decoded in place
+    buf.Reset();
+    parser.Reset();
+    buf.Append("PUT /c HTTP/1.0\r\nTransfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n"
+               "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n");
+    H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kComplete);
+    H_TEST_EQUAL(parser.minor_version(), 0);
+    H_TEST_ASSERT(parser.keep_alive());
+    H_TEST_ASSERT(parser.body() == "hello world");
+    H_TEST_EQUAL(parser.size(), buf.length());
+
+    // HTTP/1.1 with Connection: close
+    buf.Reset();
+    parser.Reset();
+    buf.Append("GET / HTTP/1.1\r\nconnection: Close\r\n\r\n");
+    H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kComplete);
+    H_TEST_ASSERT(!parser.keep_alive());
+
+    // The malformed ones
+    struct {
+        const char* request;
+        int code;
+    } errors[] = {
+        { "GET /\r\n\r\n", 400 },
+        { "GET / HTTP/2.0\r\n\r\n", 505 },
+        { "GET / HTTP/1.1\r\nNoColon\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nContent-Length: x\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 501 },
+        { "POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 400 },
+    };
+    for (auto& e : errors) {
+        buf.Reset();
+        parser.Reset();
+        buf.Append(e.request, strlen(e.request));
+        H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kError);
+        H_TEST_EQUAL(parser.error_code(), e.code);
+    }
+
+    // The limits
+    buf.Reset();
+    parser.Reset();
+    parser.set_max_header_size(32);
+    buf.Append("GET / HTTP/1.1\r\nX-Long: 0123456789012345678901234567890123456789\r\n");
+    H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kError);
+    H_TEST_EQUAL(parser.error_code(), 431);
+
+    buf.Reset();
+    parser.Reset();
+    parser.set_max_header_size(RequestParser::kDefaultMaxHeaderSize);
+    parser.set_max_body_size(4);
+    buf.Append("POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\n");
+    H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kError);
+    H_TEST_EQUAL(parser.error_code(), 413);
+}
+
+TEST_UNIT(testHTTPRequestParserReadBody) {
+    const std::string reqs[] = {
+        "POST /up HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world",
+        "POST /up HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n",
+    };
+    for (auto& req : reqs) {
+        // The body is not limited, and it comes byte by byte
+        evpp::Buffer buf;
+        RequestParser parser;
+        parser.set_max_body_size(4);
+        parser.set_stop_at_head(true);
+        size_t i = 0;
+        RequestParser::Result r = RequestParser::kNeedMore;
+        for (; i < req.size() && r == RequestParser::kNeedMore; ++i) {
+            buf.Append(req.data() + i, 1);
+            r = parser.Parse(&buf);
+        }
+        H_TEST_EQUAL(r, RequestParser::kHeadComplete);
+        H_TEST_ASSERT(parser.method() == "POST");
+        H_TEST_ASSERT(parser.uri() == "/up");
+
+        std::string body;
+        int pieces = 0;
+        for (;;) {
+            evpp::Slice piece;
+            r = parser.ReadBody(&buf, &piece);
+            H_TEST_ASSERT(r != RequestParser::kError);
+            body.append(piece.data(), piece.size());
+            pieces += piece.empty() ? 0 : 1;
+            if (r == RequestParser::kComplete) {
+                break;
+            }
+            if (piece.empty()) {
+                H_TEST_ASSERT(i < req.size());
+                buf.Append(req.data() + i++, 1);
+            }
+        }
+        H_TEST_EQUAL(body, std::string("hello world"));
+        H_TEST_EQUAL(pieces, 11);
+        H_TEST_EQUAL(i, req.size());
+
+        // Only the bytes after the last piece are left
+        buf.Retrieve(parser.size());
+        H_TEST_EQUAL(buf.length(), 0U);
+
+        // The body may be parsed as usual after the head
+        buf.Reset();
+        parser.Reset();
+        parser.set_max_body_size(RequestParser::kDefaultMaxBodySize);
+        buf.Append(req);
+        H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kHeadComplete);
+        H_TEST_EQUAL(parser.Parse(&buf), RequestParser::kComplete);
+        H_TEST_ASSERT(parser.body() == "hello world");
+        H_TEST_EQUAL(parser.size(), buf.length());
+    }
+}
+
+namespace {
+const int g_native_port = 29099;
+
+// Send the requests in one write and read the responses until the server closes the connection.
+// The responses are read after read_delay, so the server may be blocked by the client.
+std::string RoundTrip(const std::string& requests, int port = g_native_port, double read_delay = 0) {
+    std::string addr = "127.0.0.1:" + std::to_string(port);
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(addr.data());
+    evpp_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    std::string responses;
+    if (::connect(fd, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)) == 0 &&
+        ::send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size())) {
+        evpp::sock::SetTimeout(fd, evpp::Duration(5.0));
+        if (read_delay > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(read_delay * 1000)));
+        }
+        char b[4096];
+        ssize_t n = 0;
+        while ((n = ::recv(fd, b, sizeof(b), 0)) > 0) {
+            responses.append(b, n);
+        }
+    }
+    EVUTIL_CLOSESOCKET(fd);
+    return responses;
+}
+}
+
+TEST_UNIT(testNativeHTTPServer) {
+    evpp::http::Server ph(2);
+    ph.SetEngine(evpp::http::Server::kNative);
+    ph.RegisterHandler("/echo", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        // The first request is replied later than the second one
+        std::string reply = ctx->original_uri() + std::string(" ") + ctx->body().ToString();
+        const char* h = ctx->FindRequestHeader("x-delay");
+        ctx->AddResponseHeader("X-Seq", reply);
+        if (h) {
+            loop->RunAfter(evpp::Duration(std::atof(h)), [cb, reply]() {
+                cb(reply);
+            });
+        } else {
+            cb(reply);
+        }
+    });
+    ph.RegisterHandler("/empty", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        cb("");
+    });
+    H_TEST_ASSERT(ph.RegisterRoute("GET", "/users/:id/items/*rest", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        cb(ctx->method().ToString() + " id=" + ctx->FindParam("id").ToString() + " rest=" + ctx->FindParam("rest").ToString());
+    }));
+    H_TEST_ASSERT(!ph.RegisterRoute("GET", "/users/*rest/x", nullptr));
+    H_TEST_ASSERT(ph.Init(g_native_port));
+    H_TEST_ASSERT(ph.Start());
+    H_TEST_ASSERT(ph.service() == nullptr);
+    H_TEST_ASSERT(ph.native_service() != nullptr);
+
+    // The pipelined requests are replied in order on one connection
+    std::string r = RoundTrip("GET /echo?i=1 HTTP/1.1\r\nX-Delay: 0.2\r\n\r\n"
+                              "POST /echo?i=2 HTTP/1.1\r\nContent-Length: 4\r\n\r\nbody"
+                              "GET /echo?i=3 HTTP/1.1\r\nConnection: close\r\n\r\n");
+    size_t p1 = r.find("X-Seq: /echo?i=1 \r\n");
+    size_t p2 = r.find("X-Seq: /echo?i=2 body\r\n");
+    size_t p3 = r.find("X-Seq: /echo?i=3 \r\n");
+    H_TEST_ASSERT(p1 != std::string::npos);
+    H_TEST_ASSERT(p2 != std::string::npos);
+    H_TEST_ASSERT(p3 != std::string::npos);
+    H_TEST_ASSERT(p1 < p2 && p2 < p3);
+    H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+    H_TEST_ASSERT(r.find("Content-Length: 14\r\n") != std::string::npos);
+    H_TEST_ASSERT(r.find("Connection: close\r\n") > p2);
+
+    // An HTTP/1.0 request is not kept alive, and the body of HEAD is not sent
+    r = RoundTrip("HEAD /echo HTTP/1.0\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.0 200 OK\r\n") == 0);
+    H_TEST_ASSERT(r.find("Content-Length: 6\r\n") != std::string::npos);
+    H_TEST_EQUAL(r.substr(r.size() - 4), std::string("\r\n\r\n"));
+
+    // The parameters of the route
+    r = RoundTrip("GET /users/42/items/a/b?x=1 HTTP/1.1\r\nConnection: close\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+    H_TEST_ASSERT(r.find("\r\n\r\nGET id=42 rest=a/b") != std::string::npos);
+    r = RoundTrip("POST /users/42/items/a/b HTTP/1.1\r\nConnection: close\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 400 Bad Request\r\n") == 0);
+
+    // No handler, empty reply and malformed request
+    r = RoundTrip("GET /nothing HTTP/1.1\r\nConnection: close\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 400 Bad Request\r\n") == 0);
+    r = RoundTrip("GET /empty HTTP/1.1\r\nConnection: close\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 404 Not Found\r\n") == 0);
+    r = RoundTrip("GET /echo HTTP/1.1\r\nBad\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 400 Bad Request\r\n") == 0);
+
+    ph.Stop();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testHTTPServerMultiAcceptor) {
+    evpp::http::Server::Engine engines[] = { evpp::http::Server::kEvhttp, evpp::http::Server::kNative };
+    for (auto engine : engines) {
+        evpp::http::Server ph(2);
+        ph.SetEngine(engine);
+        ph.SetMultiAcceptor(true);
+        std::mutex mutex;
+        std::set<evpp::EventLoop*> handler_loops;
+        ph.RegisterHandler("/loop", [&mutex, &handler_loops](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+            std::lock_guard<std::mutex> guard(mutex);
+            handler_loops.insert(loop);
+            cb("loop");
+        });
+        ph.RegisterRoute("", "/users/:id", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+            cb(ctx->FindParam("id").ToString());
+        });
+        H_TEST_ASSERT(ph.Init(std::vector<int>({ g_native_port, g_native_port + 1 })));
+        H_TEST_ASSERT(ph.Start());
+
+        // Two working threads listen at two ports
+        std::set<evpp::EventLoop*> service_loops;
+        for (int i = 0; i < 4; i++) {
+            if (engine == evpp::http::Server::kNative) {
+                H_TEST_ASSERT(ph.native_service(i) != nullptr);
+                service_loops.insert(ph.native_service(i)->loop());
+            } else {
+                H_TEST_ASSERT(ph.service(i) != nullptr);
+                service_loops.insert(ph.service(i)->loop());
+            }
+        }
+        H_TEST_ASSERT(ph.service(4) == nullptr && ph.native_service(4) == nullptr);
+        H_TEST_EQUAL(service_loops.size(), 2U);
+
+        for (int i = 0; i < 8; i++) {
+            std::string r = RoundTrip("GET /loop HTTP/1.1\r\nConnection: close\r\n\r\n", g_native_port + i % 2);
+            H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+            H_TEST_EQUAL(r.substr(r.size() - 4), std::string("loop"));
+        }
+
+        std::string r = RoundTrip("PUT /users/42 HTTP/1.1\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", g_native_port);
+        H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+        H_TEST_EQUAL(r.substr(r.size() - 2), std::string("42"));
+
+        // The requests are handled in the working threads which accepted them
+        ph.Stop();
+        for (auto l : handler_loops) {
+            H_TEST_ASSERT(service_loops.count(l) == 1);
+        }
+    }
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+namespace {
+// Decode the chunked body of the response at r[pos, ...), and set pos after it
+std::string DecodeChunked(const std::string& r, size_t* pos) {
+    std::string body;
+    size_t p = r.find("\r\n\r\n", *pos);
+    if (p == std::string::npos) {
+        return "<no head>";
+    }
+    p += 4;
+    for (;;) {
+        size_t eol = r.find("\r\n", p);
+        if (eol == std::string::npos) {
+            return "<bad chunk>";
+        }
+        size_t n = std::strtoul(r.substr(p, eol - p).data(), nullptr, 16);
+        p = eol + 2;
+        if (n == 0) {
+            *pos = p + 2;
+            return body;
+        }
+        body.append(r, p, n);
+        p += n + 2;
+    }
+}
+
+const size_t kPieceSize = 64 * 1024;
+const size_t kHighWaterMark = 256 * 1024;
+
+struct DownloadStats {
+    std::atomic<int> writable = { 0 };
+    std::atomic<size_t> max_buffered = { 0 };
+};
+
+// Write the pieces 'a', 'b', ... until the writer is blocked
+void Produce(const evpp::http::ResponseWriterPtr& w, const std::shared_ptr<int>& left, DownloadStats* st) {
+    while (*left > 0 && !w->closed()) {
+        --*left;
+        bool more = w->WriteChunk(std::string(kPieceSize, static_cast<char>('a' + *left % 26)));
+        if (w->buffered_bytes() > st->max_buffered.load()) {
+            st->max_buffered.store(w->buffered_bytes());
+        }
+        if (!more) {
+            return;
+        }
+    }
+    w->Finish();
+}
+}
+
+TEST_UNIT(testHTTPStreamHandler) {
+    evpp::http::Server::Engine engines[] = { evpp::http::Server::kEvhttp, evpp::http::Server::kNative };
+    for (auto engine : engines) {
+        evpp::http::Server ph(1);
+        ph.SetEngine(engine);
+        std::atomic<int> upload_pieces(0);
+        DownloadStats st;
+        H_TEST_ASSERT(ph.RegisterStreamHandler("POST", "/upload/:name", [&upload_pieces](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::ResponseWriterPtr& w) {
+            H_TEST_ASSERT(loop->IsInLoopThread());
+            H_TEST_ASSERT(ctx->body().empty());
+            std::shared_ptr<size_t> size = std::make_shared<size_t>(0);
+            std::shared_ptr<uint32_t> sum = std::make_shared<uint32_t>(0);
+            ctx->SetBodyCallback([w, size, sum, &upload_pieces](const evpp::Slice& data, bool last) {
+                upload_pieces++;
+                *size += data.size();
+                for (size_t i = 0; i < data.size(); ++i) {
+                    *sum = *sum * 31 + static_cast<unsigned char>(data[i]);
+                }
+                if (last) {
+                    w->context()->AddResponseHeader("X-Name", w->context()->FindParam("name").ToString());
+                    w->WriteHeaders(201);
+                    w->WriteChunk(std::to_string(*size));
+                    w->WriteChunk(evpp::Slice(" " + std::to_string(*sum)));
+                    w->Finish();
+                }
+            });
+        }));
+        H_TEST_ASSERT(ph.RegisterStreamHandler("GET", "/download/:n", [&ph, &st](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::ResponseWriterPtr& w) {
+            std::shared_ptr<int> left = std::make_shared<int>(std::atoi(ctx->FindParam("n").ToString().data()));
+            DownloadStats* s = &st;
+            w->SetHighWaterMark(kHighWaterMark);
+            w->SetWritableCallback([w, left, s]() {
+                s->writable++;
+                Produce(w, left, s);
+            });
+
+            // The writer is used in another thread
+            ph.pool()->GetNextLoop()->RunInLoop([w, left, s]() {
+                Produce(w, left, s);
+            });
+        }));
+        H_TEST_ASSERT(!ph.RegisterStreamHandler("GET", "/x/*rest/y", nullptr));
+        ph.RegisterHandler("/echo", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+            cb("echo " + ctx->body().ToString());
+        });
+        H_TEST_ASSERT(ph.Init(g_native_port));
+        H_TEST_ASSERT(ph.Start());
+
+        // A large chunked upload, followed by a pipelined request
+        std::string body;
+        std::string upload = "POST /upload/f1?x=1 HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+        uint32_t sum = 0;
+        for (int i = 0; i < 64; i++) {
+            std::string piece(16 * 1024 + i, static_cast<char>('A' + i % 26));
+            for (char c : piece) {
+                sum = sum * 31 + static_cast<unsigned char>(c);
+            }
+            body += piece;
+            char line[32];
+            snprintf(line, sizeof(line), "%x\r\n", static_cast<unsigned>(piece.size()));
+            upload += line + piece + "\r\n";
+        }
+        upload += "0\r\n\r\n";
+        std::string r = RoundTrip(upload + "POST /echo HTTP/1.1\r\nContent-Length: 2\r\nConnection: close\r\n\r\nhi");
+        H_TEST_ASSERT(r.find("HTTP/1.1 201 ") == 0);
+        H_TEST_ASSERT(r.find("X-Name: f1\r\n") != std::string::npos);
+        H_TEST_ASSERT(r.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+        size_t pos = 0;
+        H_TEST_EQUAL(DecodeChunked(r, &pos), std::to_string(body.size()) + " " + std::to_string(sum));
+        H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n", pos) == pos);
+        H_TEST_EQUAL(r.substr(r.size() - 7), std::string("echo hi"));
+        if (engine == evpp::http::Server::kNative) {
+            // The body is passed as it is read
+            H_TEST_ASSERT(upload_pieces.load() > 1);
+        }
+
+        // A large download to a slow client is held back by the high water mark
+        const int n = 128;
+        r = RoundTrip("GET /download/" + std::to_string(n) + " HTTP/1.1\r\nConnection: close\r\n\r\n", g_native_port, 0.5);
+        H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+        pos = 0;
+        std::string download = DecodeChunked(r, &pos);
+        H_TEST_EQUAL(download.size(), n * kPieceSize);
+        H_TEST_EQUAL(pos, r.size());
+        for (int i = 0; i < n && download.size() == n * kPieceSize; i++) {
+            H_TEST_EQUAL(download[i * kPieceSize], static_cast<char>('a' + (n - 1 - i) % 26));
+        }
+        H_TEST_ASSERT(st.writable.load() > 0);
+        H_TEST_ASSERT(st.max_buffered.load() < kHighWaterMark + kPieceSize);
+
+        // An HTTP/1.0 client gets the body as it is
+        r = RoundTrip("GET /download/2 HTTP/1.0\r\n\r\n");
+        H_TEST_ASSERT(r.find("HTTP/1.0 200 OK\r\n") == 0 || r.find("HTTP/1.1 200 OK\r\n") == 0);
+        H_TEST_ASSERT(r.find("Transfer-Encoding") == std::string::npos);
+        H_TEST_EQUAL(r.size() - r.find("\r\n\r\n") - 4, 2 * kPieceSize);
+
+        ph.Stop();
+    }
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+// A request is counted in the connections of its working loop until it is
+// responded, or until the handler drops its response callback
+TEST_UNIT(testHTTPServerRequestCount) {
+    evpp::http::Server ph(1);
+    ph.SetEngine(evpp::http::Server::kNative);
+    ph.SetThreadDispatchPolicy(evpp::ThreadDispatchPolicy::kLeastConnections);
+    std::atomic<int> dropped(0);
+    ph.RegisterHandler("/drop", [&dropped](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        dropped++;
+    });
+    ph.RegisterHandler("/ok", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        H_TEST_EQUAL(loop->connection_count(), 1);
+        cb("ok");
+    });
+    H_TEST_ASSERT(ph.Init(g_native_port));
+    H_TEST_ASSERT(ph.Start());
+    evpp::EventLoop* worker = ph.pool()->GetNextLoop();
+
+    std::string r = RoundTrip("GET /ok HTTP/1.1\r\nConnection: close\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+    H_TEST_EQUAL(worker->connection_count(), 0);
+
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(("127.0.0.1:" + std::to_string(g_native_port)).data());
+    evpp_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    H_TEST_EQUAL(::connect(fd, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+    std::string req = "GET /drop HTTP/1.1\r\n\r\n";
+    H_TEST_EQUAL(::send(fd, req.data(), req.size(), 0), ssize_t(req.size()));
+    for (int i = 0; i < 5000 && dropped.load() == 0; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(dropped.load(), 1);
+    for (int i = 0; i < 1000 && worker->connection_count() > 0; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(worker->connection_count(), 0);
+    EVUTIL_CLOSESOCKET(fd);
+
+    ph.Stop();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testHTTPServerComputeHandler) {
+    evpp::http::Server ph(1);
+    ph.SetEngine(evpp::http::Server::kNative);
+    ph.RegisterComputeHandler("/compute", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        H_TEST_ASSERT(!loop->IsInLoopThread());
+        std::string name = "unknown";
+#ifdef __linux__
+        char n[16] = { 0 };
+        pthread_getname_np(pthread_self(), n, sizeof(n));
+        name = n;
+#endif
+        cb(name);
+    });
+    H_TEST_ASSERT(ph.Init(g_native_port));
+
+    // It fails without the compute pool, and works after the pool is set
+    H_TEST_ASSERT(!ph.Start());
+    std::shared_ptr<evpp::WorkStealingPool> pool = std::make_shared<evpp::WorkStealingPool>(1);
+    pool->SetThreadNamePrefix("compute-");
+    H_TEST_ASSERT(pool->Start());
+    ph.SetComputePool(pool);
+    H_TEST_ASSERT(ph.Start());
+
+    std::string r = RoundTrip("GET /compute HTTP/1.1\r\nConnection: close\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+#ifdef __linux__
+    H_TEST_EQUAL(r.substr(r.size() - 9), std::string("compute-0"));
+#endif
+
+    ph.Stop();
+    pool->Stop();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testNativeServiceIdleTimeout) {
+    evpp::EventLoopThread t;
+    evpp::http::NativeService ns(t.loop());
+    ns.SetIdleTimeout(evpp::Duration(0.1));
+    ns.RegisterHandler("/slow", [](evpp::EventLoop* loop, const evpp::http::ContextPtr& ctx, const evpp::http::HTTPSendResponseCallback& cb) {
+        loop->RunAfter(evpp::Duration(0.5), [cb]() {
+            cb("slow");
+        });
+    });
+    H_TEST_ASSERT(ns.Listen(g_native_port));
+    H_TEST_ASSERT(t.Start(true));
+
+    // The connection is not closed while its request is handled, however
+    // long it is idle, and it is closed as idle after the response is sent.
+    std::string r = RoundTrip("GET /slow HTTP/1.1\r\n\r\n");
+    H_TEST_ASSERT(r.find("HTTP/1.1 200 OK\r\n") == 0);
+    H_TEST_EQUAL(r.substr(r.size() - 4), std::string("slow"));
+
+    std::atomic<bool> stopped(false);
+    t.loop()->RunInLoop([&ns, &stopped]() {
+        ns.Stop([&stopped]() {
+            stopped.store(true);
+        });
+    });
+    for (int i = 0; i < 1000 && !stopped.load(); i++) {
+        usleep(1000);
+    }
+    H_TEST_ASSERT(stopped.load());
+    t.Stop(true);
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
@@ -0,0 +1,116 @@
+#include "test_common.h"
+
+#include "evpp/http/router.h"
+
+using evpp::http::Router;
+using evpp::http::RouteParams;
+
+namespace {
+// Each handler is identified by the address of its name
+evpp::http::HTTPRequestCallback Handler(std::string* name) {
+    return [name](evpp::EventLoop*, const evpp::http::ContextPtr&, const evpp::http::HTTPSendResponseCallback&) {
+        name->clear();
+    };
+}
+
+std::string g_names[16];
+
+// Return the index of the matched handler in g_names, or -1
+int MatchedIndex(const Router& router, const char* method, const char* path, RouteParams* params) {
+    const evpp::http::HTTPRequestCallback* cb = router.Match(method, path, params);
+    if (!cb) {
+        return -1;
+    }
+    for (int i = 0; i < 16; i++) {
+        g_names[i] = "x";
+    }
+    (*cb)(nullptr, evpp::http::ContextPtr(), evpp::http::HTTPSendResponseCallback());
+    for (int i = 0; i < 16; i++) {
+        if (g_names[i].empty()) {
+            return i;
+        }
+    }
+    return -1;
+}
+}
+
+TEST_UNIT(testHTTPRouter) {
+    Router router;
+    H_TEST_ASSERT(router.empty());
+    H_TEST_ASSERT(router.Add("", "/users", Handler(&g_names[0])));
+    H_TEST_ASSERT(router.Add("GET", "/users/:id", Handler(&g_names[1])));
+    H_TEST_ASSERT(router.Add("DELETE", "/users/:id", Handler(&g_names[2])));
+    H_TEST_ASSERT(router.Add("GET", "/users/:id/items/*rest", Handler(&g_names[3])));
+    H_TEST_ASSERT(router.Add("GET", "/users/new", Handler(&g_names[4])));
+    H_TEST_ASSERT(router.Add("GET", "/user", Handler(&g_names[5])));
+    H_TEST_ASSERT(router.Add("GET", "/files/*path", Handler(&g_names[6])));
+    H_TEST_ASSERT(router.Add("GET", "/users/:name/profile", Handler(&g_names[7])));
+    router.AddExact("/status.html", Handler(&g_names[8]));
+    router.AddExact("/a:b", Handler(&g_names[9]));
+    H_TEST_EQUAL(router.size(), 10U);
+
+    // The malformed patterns
+    H_TEST_ASSERT(!router.Add("GET", "users", Handler(&g_names[15])));
+    H_TEST_ASSERT(!router.Add("GET", "/users/x:id", Handler(&g_names[15])));
+    H_TEST_ASSERT(!router.Add("GET", "/users/:", Handler(&g_names[15])));
+    H_TEST_ASSERT(!router.Add("GET", "/files/*path/x", Handler(&g_names[15])));
+    H_TEST_EQUAL(router.size(), 10U);
+
+    RouteParams params;
+    H_TEST_EQUAL(MatchedIndex(router, "POST", "/users", &params), 0);
+    H_TEST_EQUAL(params.size(), 0U);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/user", &params), 5);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/", &params), -1);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/use", &params), -1);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/status.html", &params), 8);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/a:b", &params), 9);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/a", &params), -1);
+
+    // The method-specific handlers
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/42", &params), 1);
+    H_TEST_EQUAL(params.size(), 1U);
+    H_TEST_ASSERT(params.Find("id") == "42");
+    H_TEST_EQUAL(MatchedIndex(router, "DELETE", "/users/42", &params), 2);
+    H_TEST_EQUAL(MatchedIndex(router, "PUT", "/users/42", &params), -1);
+
+    // The static segment is preferred, and the parameter is matched by backtracking
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/new", &params), 4);
+    H_TEST_EQUAL(params.size(), 0U);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/new/profile", &params), 7);
+    H_TEST_ASSERT(params.Find("name") == "new");
+    H_TEST_ASSERT(params.Find("id").empty());
+
+    // The catch-all parameters
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/7/items/a/b/c", &params), 3);
+    H_TEST_EQUAL(params.size(), 2U);
+    H_TEST_ASSERT(params.Find("id") == "7");
+    H_TEST_ASSERT(params.Find("rest") == "a/b/c");
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/7/items/", &params), 3);
+    H_TEST_ASSERT(params.Find("rest").empty());
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/files/", &params), 6);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/files/x.txt", &params), 6);
+    H_TEST_ASSERT(params.Find("path") == "x.txt");
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/7/items", &params), -1);
+
+    // The handler of the same method and pattern is replaced
+    H_TEST_ASSERT(router.Add("GET", "/users/:uid", Handler(&g_names[10])));
+    H_TEST_EQUAL(router.size(), 10U);
+    H_TEST_EQUAL(MatchedIndex(router, "GET", "/users/42", &params), 10);
+    H_TEST_ASSERT(params.Find("uid") == "42");
+
+    // Many routes
+    Router r;
+    for (int i = 0; i < 300; i++) {
+        H_TEST_ASSERT(r.Add("GET", "/api/v1/resource" + std::to_string(i) + "/:id", Handler(&g_names[i % 16])));
+    }
+    for (int i = 0; i < 300; i++) {
+        std::string path = "/api/v1/resource" + std::to_string(i) + "/abc";
+        H_TEST_EQUAL(MatchedIndex(r, "GET", path.data(), &params), i % 16);
+        H_TEST_ASSERT(params.Find("id") == "abc");
+    }
+    H_TEST_EQUAL(MatchedIndex(r, "GET", "/api/v1/resource300/abc", &params), -1);
+
+    r.Clear();
+    H_TEST_ASSERT(r.empty());
+    H_TEST_ASSERT(r.Match("GET", "/api/v1/resource1/abc", nullptr) == nullptr);
+}
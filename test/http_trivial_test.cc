@@ -1,5 +1,6 @@
 #include "test_common.h"
 
+#include <evpp/libevent.h>
 #include <evpp/httpc/url_parser.h>
 #include <evpp/http/context.h>
 
@@ -84,3 +85,53 @@ TEST_UNIT(TestFindClientIPFromURI) {
         H_TEST_ASSERT(ip == cases[i].ip);
     }
 }
+
+TEST_UNIT(testContextQueryIndex) {
+    struct evhttp_request* req = evhttp_request_new(nullptr, nullptr);
+    req->type = EVHTTP_REQ_GET;
+    req->uri = strdup("/query?a=1&b=x%20y+z&c&a=2&d=100%25&clientip=10.0.0.1&e=%e4%b8%ad");
+    req->uri_elems = evhttp_uri_parse(req->uri);
+    req->remote_host = strdup("127.0.0.1");
+    evhttp_add_header(req->input_headers, "Content-Type", "text/plain");
+    evhttp_add_header(req->input_headers, "X-Empty", "");
+
+    evpp::http::Context ctx(req);
+    H_TEST_ASSERT(ctx.Init());
+    H_TEST_EQUAL(ctx.uri(), std::string("/query"));
+    H_TEST_ASSERT(ctx.method() == "GET");
+
+    // The first value of a key
+    H_TEST_ASSERT(ctx.FindQuery("a") == "1");
+    H_TEST_EQUAL(ctx.GetQuery("a"), std::string("1"));
+    H_TEST_ASSERT(ctx.FindQuery("b") == "x%20y+z");
+    H_TEST_ASSERT(ctx.FindQuery("c").empty());
+    H_TEST_ASSERT(ctx.FindQuery("ab").empty());
+    H_TEST_ASSERT(ctx.FindQuery("none").empty());
+
+    // The views point into the URI
+    H_TEST_ASSERT(ctx.FindQuery("a").data() > ctx.original_uri());
+
+    // Percent-decoding
+    evpp::Slice b = ctx.FindDecodedQuery("b");
+    H_TEST_ASSERT(b == "x y z");
+    H_TEST_ASSERT(ctx.FindDecodedQuery("b").data() == b.data());
+    H_TEST_ASSERT(ctx.FindDecodedQuery("a").data() == ctx.FindQuery("a").data());
+    H_TEST_ASSERT(ctx.FindDecodedQuery("d") == "100%");
+    H_TEST_ASSERT(ctx.FindDecodedQuery("e") == "\xe4\xb8\xad");
+    H_TEST_ASSERT(b == "x y z");
+
+    // They can be read through a const context
+    const evpp::http::Context& cctx = ctx;
+    H_TEST_EQUAL(cctx.remote_ip(), std::string("10.0.0.1"));
+    H_TEST_ASSERT(cctx.FindQuery("a") == "1");
+
+    // The header names are case-insensitive
+    H_TEST_ASSERT(ctx.FindHeader("content-type") == "text/plain");
+    H_TEST_EQUAL(std::string(ctx.FindRequestHeader("CONTENT-TYPE")), std::string("text/plain"));
+    H_TEST_ASSERT(ctx.FindRequestHeader("X-Empty") != nullptr);
+    H_TEST_ASSERT(ctx.FindHeader("X-Empty").empty());
+    H_TEST_ASSERT(ctx.FindRequestHeader("Content") == nullptr);
+    H_TEST_ASSERT(ctx.FindHeader("Content-Type-X").empty());
+
+    evhttp_request_free(req);
+}
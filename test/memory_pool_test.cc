@@ -0,0 +1,86 @@
+#include "test_common.h"
+
+#include <evpp/memory_pool.h>
+
+#include <thread>
+
+using evpp::MemoryPool;
+using evpp::PoolAllocator;
+
+TEST_UNIT(testMemoryPoolReuse) {
+    MemoryPool pool;
+    void* p = pool.Allocate(100);
+    H_TEST_EQUAL(pool.block_size(), 100);
+    H_TEST_EQUAL(pool.miss_count(), 1);
+    pool.Deallocate(p, 100);
+    H_TEST_EQUAL(pool.cached_count(), 1);
+
+    // A smaller block is served by the cached one
+    void* p2 = pool.Allocate(50);
+    H_TEST_ASSERT(p2 == p);
+    H_TEST_EQUAL(pool.hit_count(), 1);
+    H_TEST_EQUAL(pool.cached_count(), 0);
+    pool.Deallocate(p2, 50);
+
+    // A bigger block is not cached
+    void* p3 = pool.Allocate(200);
+    pool.Deallocate(p3, 200);
+    H_TEST_EQUAL(pool.miss_count(), 2);
+    H_TEST_EQUAL(pool.cached_count(), 1);
+}
+
+TEST_UNIT(testMemoryPoolMaxCachedCount) {
+    MemoryPool pool(1);
+    void* p1 = pool.Allocate(64);
+    void* p2 = pool.Allocate(64);
+    pool.Deallocate(p1, 64);
+    pool.Deallocate(p2, 64);
+    H_TEST_EQUAL(pool.cached_count(), 1);
+}
+
+TEST_UNIT(testMemoryPoolRemoteDeallocate) {
+    const int kCount = 1000;
+    MemoryPool pool;
+    std::vector<void*> blocks;
+    for (int i = 0; i < kCount; ++i) {
+        blocks.push_back(pool.Allocate(32));
+    }
+
+    // The blocks are given back in other threads and reused in this thread
+    std::thread t1([&]() {
+        for (int i = 0; i < kCount / 2; ++i) {
+            pool.Deallocate(blocks[i], 32);
+        }
+    });
+    std::thread t2([&]() {
+        for (int i = kCount / 2; i < kCount; ++i) {
+            pool.Deallocate(blocks[i], 32);
+        }
+    });
+    t1.join();
+    t2.join();
+    H_TEST_EQUAL(pool.cached_count(), size_t(kCount));
+
+    for (int i = 0; i < kCount; ++i) {
+        blocks[i] = pool.Allocate(32);
+    }
+    H_TEST_EQUAL(pool.hit_count(), uint64_t(kCount));
+    H_TEST_EQUAL(pool.cached_count(), 0);
+    for (int i = 0; i < kCount; ++i) {
+        pool.Deallocate(blocks[i], 32);
+    }
+}
+
+TEST_UNIT(testMemoryPoolAllocateShared) {
+    std::shared_ptr<MemoryPool> pool = std::make_shared<MemoryPool>();
+    std::weak_ptr<MemoryPool> wpool(pool);
+    std::shared_ptr<std::string> s = std::allocate_shared<std::string>(PoolAllocator<std::string>(pool), "hello");
+    H_TEST_EQUAL(*s, "hello");
+    H_TEST_EQUAL(pool->miss_count(), 1);
+
+    // The object keeps the pool alive
+    pool.reset();
+    H_TEST_ASSERT(!wpool.expired());
+    s.reset();
+    H_TEST_ASSERT(wpool.expired());
+}
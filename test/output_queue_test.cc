@@ -0,0 +1,178 @@
+#include "test_common.h"
+
+#include <evpp/libevent.h>
+#include <evpp/output_queue.h>
+
+using evpp::OutputQueue;
+using std::string;
+
+namespace {
+string ReadAll(evpp_socket_t fd, size_t len) {
+    string r;
+    char buf[4096];
+    while (r.size() < len) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        r.append(buf, n);
+    }
+    return r;
+}
+}
+
+TEST_UNIT(testOutputQueueCopyCoalesce) {
+    OutputQueue q;
+    H_TEST_ASSERT(q.empty());
+    q.Append("hello", 5);
+    q.Append(evpp::Slice(" world"));
+    q.Append(string(10, 'x'));
+    H_TEST_EQUAL(q.length(), 21);
+    H_TEST_EQUAL(q.chunk_count(), 1);
+
+    q.Skip(6);
+    H_TEST_EQUAL(q.length(), 15);
+    H_TEST_EQUAL(q.chunk_count(), 1);
+
+    q.Skip(15);
+    H_TEST_ASSERT(q.empty());
+    H_TEST_EQUAL(q.chunk_count(), 0);
+}
+
+TEST_UNIT(testOutputQueueMoveAndShare) {
+    OutputQueue q;
+    string big(OutputQueue::kMaxCopySize * 4, 'a');
+    q.Append("head", 4);
+    q.Append(std::move(big), 1);
+    H_TEST_EQUAL(q.length(), 4 + OutputQueue::kMaxCopySize * 4 - 1);
+    H_TEST_EQUAL(q.chunk_count(), 2);
+
+    std::shared_ptr<const string> shared(new string(OutputQueue::kMaxCopySize * 2, 'b'));
+    q.Append(shared);
+    H_TEST_EQUAL(shared.use_count(), 2);
+    H_TEST_EQUAL(q.chunk_count(), 3);
+
+    // The small tail is copied into a new Buffer after the shared chunk
+    q.Append("tail", 4);
+    H_TEST_EQUAL(q.chunk_count(), 4);
+
+    // Skip across the chunk boundaries
+    q.Skip(4 + OutputQueue::kMaxCopySize * 4 - 1 + 10);
+    H_TEST_EQUAL(q.chunk_count(), 2);
+    H_TEST_EQUAL(shared.use_count(), 2);
+
+    q.Reset();
+    H_TEST_ASSERT(q.empty());
+    H_TEST_EQUAL(shared.use_count(), 1);
+}
+
+TEST_UNIT(testOutputQueueMoveBuffer) {
+    OutputQueue q;
+    evpp::Buffer small;
+    small.Append("small");
+    q.Append(std::move(small));
+    H_TEST_EQUAL(q.chunk_count(), 1);
+    H_TEST_EQUAL(small.length(), 0);
+
+    evpp::Buffer big;
+    big.Append(string(OutputQueue::kMaxCopySize * 2, 'c'));
+    q.Append(std::move(big));
+    H_TEST_EQUAL(q.chunk_count(), 2);
+    H_TEST_EQUAL(big.length(), 0);
+    H_TEST_EQUAL(q.length(), 5 + OutputQueue::kMaxCopySize * 2);
+
+    // The moved Buffer is the tail now, small data is coalesced into it
+    q.Append("tail", 4);
+    H_TEST_EQUAL(q.chunk_count(), 2);
+
+    q.Skip(5);
+    H_TEST_EQUAL(q.chunk_count(), 1);
+    q.Skip(1);
+    H_TEST_EQUAL(q.length(), OutputQueue::kMaxCopySize * 2 + 3);
+}
+
+TEST_UNIT(testOutputQueueWriteToFD) {
+    evpp_socket_t fds[2];
+    int r = evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    H_TEST_ASSERT(r >= 0);
+
+    OutputQueue q;
+    string expected;
+    for (int i = 0; i < 100; ++i) {
+        string s(OutputQueue::kMaxCopySize + 1 + i, static_cast<char>('a' + i % 26));
+        expected += s;
+        q.Append(std::move(s));
+        string small = std::to_string(i);
+        expected += small;
+        q.Append(small.data(), small.size());
+    }
+    H_TEST_EQUAL(q.length(), expected.size());
+    H_TEST_EQUAL(q.chunk_count(), 200);
+
+    string received;
+    while (!q.empty()) {
+        int serrno = 0;
+        ssize_t n = q.WriteToFD(fds[0], &serrno);
+        H_TEST_ASSERT(n > 0);
+        received += ReadAll(fds[1], static_cast<size_t>(n));
+    }
+    H_TEST_EQUAL(received, expected);
+    H_TEST_EQUAL(q.chunk_count(), 0);
+
+    EVUTIL_CLOSESOCKET(fds[0]);
+    EVUTIL_CLOSESOCKET(fds[1]);
+}
+
+TEST_UNIT(testOutputQueueSendFile) {
+    evpp_socket_t fds[2];
+    int r = evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    H_TEST_ASSERT(r >= 0);
+
+    string content;
+    for (int i = 0; i < 10000; ++i) {
+        content += std::to_string(i);
+    }
+    FILE* fp = tmpfile();
+    H_TEST_ASSERT(fp);
+    H_TEST_EQUAL(fwrite(content.data(), 1, content.size(), fp), content.size());
+    fflush(fp);
+    int file_fd = fileno(fp);
+
+    int done = 0;
+    bool completed = false;
+    OutputQueue q;
+    q.Append("head", 4);
+    q.AppendFile(file_fd, 3, content.size() - 3, [&](bool c) {
+        done++;
+        completed = c;
+    });
+    q.Append("tail", 4);
+    H_TEST_EQUAL(q.length(), content.size() + 5);
+    H_TEST_EQUAL(q.buffered_length(), 8);
+
+    string received;
+    while (!q.empty()) {
+        int serrno = 0;
+        ssize_t n = q.WriteToFD(fds[0], &serrno);
+        H_TEST_ASSERT(n > 0);
+        received += ReadAll(fds[1], static_cast<size_t>(n));
+    }
+    H_TEST_EQUAL(received, "head" + content.substr(3) + "tail");
+    H_TEST_EQUAL(done, 1);
+    H_TEST_ASSERT(completed);
+
+    // The dropped file region is notified
+    q.AppendFile(file_fd, 0, content.size(), [&](bool c) {
+        done++;
+        completed = c;
+    });
+    q.Skip(10);
+    H_TEST_EQUAL(q.length(), content.size() - 10);
+    q.Reset();
+    H_TEST_EQUAL(done, 2);
+    H_TEST_ASSERT(!completed);
+
+    fclose(fp);
+    EVUTIL_CLOSESOCKET(fds[0]);
+    EVUTIL_CLOSESOCKET(fds[1]);
+}
@@ -0,0 +1,38 @@
+#include "test_common.h"
+
+#include <evpp/read_size_predictor.h>
+
+using evpp::ReadSizePredictor;
+
+TEST_UNIT(testReadSizePredictorGrow) {
+    ReadSizePredictor p;
+    H_TEST_EQUAL(p.next(), ReadSizePredictor::kDefaultInitial);
+
+    // Grows quickly when the reads fill the guess
+    p.Record(p.next());
+    H_TEST_EQUAL(p.next(), 16 * 1024);
+    p.Record(p.next());
+    H_TEST_EQUAL(p.next(), ReadSizePredictor::kDefaultMaximum);
+    p.Record(p.next());
+    H_TEST_EQUAL(p.next(), ReadSizePredictor::kDefaultMaximum);
+}
+
+TEST_UNIT(testReadSizePredictorShrink) {
+    ReadSizePredictor p(8192);
+    H_TEST_EQUAL(p.next(), 8192);
+
+    // Shrinks one step after two consecutive small reads
+    p.Record(100);
+    H_TEST_EQUAL(p.next(), 8192);
+    p.Record(100);
+    H_TEST_EQUAL(p.next(), 4096);
+
+    // A read between the previous step and the guess resets nothing
+    p.Record(3000);
+    H_TEST_EQUAL(p.next(), 4096);
+
+    for (int i = 0; i < 100; i++) {
+        p.Record(1);
+    }
+    H_TEST_EQUAL(p.next(), ReadSizePredictor::kDefaultMinimum);
+}
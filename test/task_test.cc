@@ -0,0 +1,78 @@
+#include "test_common.h"
+
+#include <evpp/task.h>
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+
+#include <array>
+
+using evpp::Task;
+
+TEST_UNIT(testTaskInline) {
+    std::shared_ptr<int> counter(new int(0));
+    std::string message(100, 'x');
+    Task t([counter, message]() {
+        *counter += static_cast<int>(message.size());
+    });
+    H_TEST_ASSERT(static_cast<bool>(t));
+    H_TEST_ASSERT(t.IsInline());
+    t();
+    H_TEST_EQUAL(*counter, 100);
+
+    // The captured objects are moved with the task
+    Task t2(std::move(t));
+    H_TEST_ASSERT(!t);
+    H_TEST_ASSERT(t2.IsInline());
+    H_TEST_EQUAL(counter.use_count(), 2);
+    t2();
+    H_TEST_EQUAL(*counter, 200);
+    t2.Reset();
+    H_TEST_EQUAL(counter.use_count(), 1);
+}
+
+TEST_UNIT(testTaskHeap) {
+    std::shared_ptr<int> counter(new int(0));
+    std::array<char, Task::kInlineSize> big;
+    big.fill(1);
+    Task t([counter, big]() {
+        *counter += big[0];
+    });
+    H_TEST_ASSERT(!t.IsInline());
+
+    Task t2;
+    t2 = std::move(t);
+    H_TEST_ASSERT(!t);
+    t2();
+    H_TEST_EQUAL(*counter, 1);
+    t2 = Task();
+    H_TEST_EQUAL(counter.use_count(), 1);
+}
+
+namespace {
+// A move-only callable object which can not be held by std::function
+struct MoveOnlyFunctor {
+    std::unique_ptr<int> value;
+    std::shared_ptr<std::atomic<int>> result;
+    void operator()() {
+        result->store(*value);
+    }
+};
+}
+
+TEST_UNIT(testTaskMoveOnly) {
+    std::shared_ptr<std::atomic<int>> result(new std::atomic<int>(0));
+    MoveOnlyFunctor f;
+    f.value.reset(new int(42));
+    f.result = result;
+
+    evpp::EventLoopThread t;
+    t.Start(true);
+    t.loop()->QueueInLoop(std::move(f));
+    t.loop()->RunInLoop([&t]() {
+        t.Stop();
+    });
+    while (!t.IsStopped()) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(result->load(), 42);
+}
@@ -10,6 +10,12 @@
 #include <evpp/tcp_client.h>
 
 #include <thread>
+#include <set>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
 
 namespace {
 static bool connected = false;
@@ -131,3 +137,784 @@ TEST_UNIT(testTCPServerSilenceShutdown2) {
     H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
 }
 
+
+TEST_UNIT(testTCPServerBroadcast) {
+    const int kClientCount = 4;
+    std::atomic<int> server_connected(0);
+    std::atomic<int> client_recved(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_client_thread(new evpp::EventLoopThread);
+    tcp_client_thread->Start(true);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 2));
+    tsrv->SetConnectionCallback([&server_connected](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            server_connected++;
+        }
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    std::vector<std::shared_ptr<evpp::TCPClient>> clients;
+    for (int i = 0; i < kClientCount; i++) {
+        std::shared_ptr<evpp::TCPClient> client(new evpp::TCPClient(tcp_client_thread->loop(), addr, "TCPBroadcastClient"));
+        client->SetMessageCallback([&client_recved](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+            H_TEST_EQUAL(msg->NextAllString(), "broadcast");
+            client_recved++;
+        });
+        client->Connect();
+        clients.push_back(client);
+    }
+
+    while (server_connected.load() < kClientCount) {
+        usleep(1000);
+    }
+
+    // Skip the first connection
+    tsrv->Broadcast("broadcast", [](const evpp::TCPConnPtr& conn) {
+        return conn->id() != 1;
+    });
+
+    for (int i = 0; i < 1000 && client_recved.load() < kClientCount - 1; i++) {
+        usleep(1000);
+    }
+    usleep(100 * 1000);
+    H_TEST_EQUAL(client_recved.load(), kClientCount - 1);
+
+    for (auto& c : clients) {
+        tcp_client_thread->loop()->RunInLoop(std::bind(&evpp::TCPClient::Disconnect, c));
+    }
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_client_thread->Stop(true);
+    clients.clear();
+    tcp_client_thread.reset();
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPServerSendFile) {
+    std::string content;
+    for (int i = 0; i < 100000; ++i) {
+        content += std::to_string(i);
+    }
+    FILE* fp = tmpfile();
+    H_TEST_ASSERT(fp);
+    H_TEST_EQUAL(fwrite(content.data(), 1, content.size(), fp), content.size());
+    fflush(fp);
+    int file_fd = fileno(fp);
+
+    std::atomic<bool> send_done(false);
+    std::atomic<bool> write_completed(false);
+    std::string received;
+    std::atomic<size_t> received_len(0);
+    std::string expected = "head" + content + "tail";
+    evpp::TCPConnPtr server_conn;
+    std::atomic<bool> server_conn_closed(false);
+    std::unique_ptr<evpp::EventLoopThread> tcp_client_thread(new evpp::EventLoopThread);
+    tcp_client_thread->Start(true);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 1));
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->SetWriteCompleteCallback([&](const evpp::TCPConnPtr&) {
+                write_completed = true;
+            });
+            conn->Send("head");
+            conn->SendFile(file_fd, 0, content.size(), [&](const evpp::TCPConnPtr&, bool completed) {
+                send_done = completed;
+            });
+            conn->Send("tail");
+            server_conn = conn;
+        } else {
+            server_conn_closed = true;
+        }
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    std::shared_ptr<evpp::TCPClient> client(new evpp::TCPClient(tcp_client_thread->loop(), addr, "TCPSendFileClient"));
+    client->SetConnectionCallback([](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->SetMaxReadsPerWakeup(4);
+            conn->SetReleaseIdleBuffers(true);
+        }
+    });
+    client->SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        received += msg->NextAllString();
+        received_len = received.size();
+    });
+    client->Connect();
+
+    for (int i = 0; i < 5000 && !(send_done && write_completed && received_len.load() >= expected.size()); i++) {
+        usleep(1000);
+    }
+    H_TEST_ASSERT(send_done);
+    H_TEST_ASSERT(write_completed);
+
+    tcp_client_thread->loop()->RunInLoop(std::bind(&evpp::TCPClient::Disconnect, client));
+    for (int i = 0; i < 5000 && !server_conn_closed; i++) {
+        usleep(1000);
+    }
+    H_TEST_ASSERT(server_conn_closed);
+
+    // The file is dropped by a closed connection, in its IO thread too
+    std::atomic<int> dropped(0);
+    server_conn->SendFile(file_fd, 0, content.size(), [&dropped](const evpp::TCPConnPtr& conn, bool completed) {
+        dropped = (!completed && conn->loop()->IsInLoopThread()) ? 1 : -1;
+    });
+    for (int i = 0; i < 5000 && dropped.load() == 0; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(dropped.load(), 1);
+    server_conn.reset();
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_client_thread->Stop(true);
+    H_TEST_ASSERT(received == expected);
+    client.reset();
+    tcp_client_thread.reset();
+    tcp_server_thread.reset();
+    tsrv.reset();
+    fclose(fp);
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPConnInputWaterMark) {
+    const size_t kHigh = 4096;
+    const size_t kTotal = 1024 * 1024;
+    std::atomic<size_t> max_input(0);
+    std::atomic<size_t> consumed(0);
+    std::atomic<bool> consume(false);
+    evpp::TCPConnPtr server_conn;
+    evpp::Buffer* server_input = nullptr;
+    std::unique_ptr<evpp::EventLoopThread> tcp_client_thread(new evpp::EventLoopThread);
+    tcp_client_thread->Start(true);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 0));
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->SetInputWaterMark(kHigh, 0);
+            server_conn = conn;
+        }
+    });
+    tsrv->SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        server_input = msg;
+        if (msg->length() > max_input) {
+            max_input = msg->length();
+        }
+        if (consume) {
+            consumed += msg->length();
+            msg->Reset();
+        }
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    std::shared_ptr<evpp::TCPClient> client(new evpp::TCPClient(tcp_client_thread->loop(), addr, "TCPWaterMarkClient"));
+    client->SetConnectionCallback([kTotal](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->Send(std::string(kTotal, 'x'));
+        }
+    });
+    client->Connect();
+
+    // The server does not consume the input, so it stops reading
+    // after the input buffer reaches the high water mark.
+    usleep(500 * 1000);
+    H_TEST_ASSERT(max_input.load() >= kHigh);
+    H_TEST_ASSERT(max_input.load() < kTotal);
+
+    // Consume the input buffer out of the message callback and resume reading
+    consume = true;
+    tcp_server_thread->loop()->RunInLoop([&]() {
+        consumed += server_input->length();
+        server_input->Reset();
+        server_conn->ResumeReading();
+    });
+    for (int i = 0; i < 5000 && consumed.load() < kTotal; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(consumed.load(), kTotal);
+
+    tcp_client_thread->loop()->RunInLoop(std::bind(&evpp::TCPClient::Disconnect, client));
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_client_thread->Stop(true);
+    server_conn.reset();
+    client.reset();
+    tcp_client_thread.reset();
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPConnReleaseIdleBuffers) {
+    std::atomic<int> echoed(0);
+    std::atomic<size_t> busy_usage(0);
+    std::atomic<size_t> idle_usage(1);
+    std::atomic<size_t> received(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_client_thread(new evpp::EventLoopThread);
+    tcp_client_thread->Start(true);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    evpp::EventLoop* server_loop = tcp_server_thread->loop();
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(server_loop, addr, "tcp_server", 0));
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            // No storage is allocated before the first message arrives
+            H_TEST_EQUAL(conn->memory_usage(), 0);
+            conn->SetReleaseIdleBuffers(true);
+        }
+    });
+    tsrv->SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        busy_usage = conn->memory_usage();
+        conn->Send(msg);
+        conn->loop()->QueueInLoop([conn, &idle_usage, &echoed]() {
+            idle_usage = conn->memory_usage();
+            echoed++;
+        });
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    std::shared_ptr<evpp::TCPClient> client(new evpp::TCPClient(tcp_client_thread->loop(), addr, "TCPReleaseClient"));
+    client->SetConnectionCallback([](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            conn->Send("hello");
+        }
+    });
+    client->SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        received += msg->length();
+        msg->Reset();
+    });
+    client->Connect();
+
+    for (int i = 0; i < 5000 && (echoed.load() == 0 || received.load() < 5); i++) {
+        usleep(1000);
+    }
+    H_TEST_ASSERT(busy_usage.load() > 0);
+    H_TEST_EQUAL(idle_usage.load(), 0);
+    H_TEST_EQUAL(received.load(), 5);
+
+    tcp_client_thread->loop()->RunInLoop(std::bind(&evpp::TCPClient::Disconnect, client));
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_client_thread->Stop(true);
+
+    // All the storage has been given back to the pools
+    H_TEST_EQUAL(server_loop->buffer_pool()->allocated_bytes(), 0);
+    H_TEST_EQUAL(tcp_client_thread->loop()->buffer_pool()->allocated_bytes(), 0);
+    H_TEST_ASSERT(server_loop->buffer_pool()->cached_bytes() > 0);
+    client.reset();
+    tcp_client_thread.reset();
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPServerConnPool) {
+    std::atomic<int> connected_count(0);
+    std::atomic<int> disconnected_count(0);
+    std::atomic<evpp::EventLoop*> io_loop(nullptr);
+    std::unique_ptr<evpp::EventLoopThread> tcp_client_thread(new evpp::EventLoopThread);
+    tcp_client_thread->Start(true);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 1));
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            // The connection is created in its own IO thread
+            H_TEST_ASSERT(conn->loop()->IsInLoopThread());
+            io_loop = conn->loop();
+            connected_count++;
+        } else {
+            disconnected_count++;
+        }
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    for (int n = 1; n <= 2; ++n) {
+        std::shared_ptr<evpp::TCPClient> client(new evpp::TCPClient(tcp_client_thread->loop(), addr, "TCPConnPoolClient"));
+        client->Connect();
+        for (int i = 0; i < 5000 && connected_count.load() < n; i++) {
+            usleep(1000);
+        }
+        H_TEST_EQUAL(connected_count.load(), n);
+
+        tcp_client_thread->loop()->RunInLoop(std::bind(&evpp::TCPClient::Disconnect, client));
+        for (int i = 0; i < 5000 && disconnected_count.load() < n; i++) {
+            usleep(1000);
+        }
+        H_TEST_EQUAL(disconnected_count.load(), n);
+
+        // Wait for the TCPConn to be destructed in the listening thread
+        for (int i = 0; i < 5000 && io_loop.load()->tcp_conn_pool()->cached_count() == 0; i++) {
+            usleep(1000);
+        }
+        H_TEST_EQUAL(io_loop.load()->tcp_conn_pool()->cached_count(), 1);
+        tcp_client_thread->loop()->RunInLoop([client]() {});
+    }
+
+    // The second connection reuses the memory of the first one
+    H_TEST_EQUAL(io_loop.load()->tcp_conn_pool()->miss_count(), 1);
+    H_TEST_EQUAL(io_loop.load()->tcp_conn_pool()->hit_count(), 1);
+    H_TEST_EQUAL(io_loop.load()->fd_channel_pool()->hit_count(), 1);
+
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_client_thread->Stop(true);
+    tcp_client_thread.reset();
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPServerMultiAcceptor) {
+    const int kClientCount = 8;
+    const int kThreadCount = 2;
+    std::atomic<int> connected_count(0);
+    std::atomic<int> message_count(0);
+    std::mutex mutex;
+    std::set<evpp::EventLoop*> loops;
+    std::unique_ptr<evpp::EventLoopThread> tcp_client_thread(new evpp::EventLoopThread);
+    tcp_client_thread->Start(true);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    evpp::EventLoop* listening_loop = tcp_server_thread->loop();
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(listening_loop, addr, "tcp_server", kThreadCount));
+    tsrv->SetMultiAcceptor(true);
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            // Accepted by a working thread directly
+            H_TEST_ASSERT(conn->loop()->IsInLoopThread());
+            H_TEST_ASSERT(conn->loop() != listening_loop);
+            std::lock_guard<std::mutex> guard(mutex);
+            loops.insert(conn->loop());
+            connected_count++;
+        }
+    });
+    tsrv->SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        conn->Send(msg);
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    std::vector<std::shared_ptr<evpp::TCPClient>> clients;
+    for (int i = 0; i < kClientCount; ++i) {
+        std::shared_ptr<evpp::TCPClient> client(new evpp::TCPClient(tcp_client_thread->loop(), addr, "TCPMultiAcceptorClient"));
+        client->set_auto_reconnect(false);
+        client->SetConnectionCallback([](const evpp::TCPConnPtr& conn) {
+            if (conn->IsConnected()) {
+                conn->Send("ping");
+            }
+        });
+        client->SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+            if (msg->length() >= 4) {
+                message_count++;
+                msg->Reset();
+            }
+        });
+        client->Connect();
+        clients.push_back(client);
+    }
+
+    for (int i = 0; i < 5000 && message_count.load() < kClientCount; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(connected_count.load(), kClientCount);
+    H_TEST_EQUAL(message_count.load(), kClientCount);
+    H_TEST_ASSERT(loops.size() <= size_t(kThreadCount));
+
+    // The connections are kept by their own loops
+    tsrv->Broadcast("pong");
+    for (int i = 0; i < 5000 && message_count.load() < 2 * kClientCount; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(message_count.load(), 2 * kClientCount);
+
+    // Stop the server while the connections are alive
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    for (auto& c : clients) {
+        tcp_client_thread->loop()->RunInLoop(std::bind(&evpp::TCPClient::Disconnect, c));
+    }
+    tcp_server_thread->Stop(true);
+    tcp_client_thread->Stop(true);
+    clients.clear();
+    tcp_client_thread.reset();
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPServerAcceptBatch) {
+    const int kClientCount = 10;
+    std::atomic<int> connected_count(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 0));
+    tsrv->SetMaxAcceptsPerWakeup(16);
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            connected_count++;
+        }
+    });
+    bool rc = tsrv->Init();
+    H_TEST_ASSERT(rc);
+    rc = tsrv->Start();
+    H_TEST_ASSERT(rc);
+
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(addr.data());
+    std::vector<evpp_socket_t> clients;
+    for (int i = 0; i < kClientCount; ++i) {
+        evpp_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        H_TEST_ASSERT(fd >= 0);
+        H_TEST_EQUAL(::connect(fd, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+        clients.push_back(fd);
+    }
+
+    for (int i = 0; i < 5000 && connected_count.load() < kClientCount; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(connected_count.load(), kClientCount);
+    H_TEST_EQUAL(tsrv->accept_stats().accepted_count.load(), uint64_t(kClientCount));
+    H_TEST_ASSERT(tsrv->accept_stats().wakeup_count.load() <= uint64_t(kClientCount));
+    H_TEST_EQUAL(tsrv->accept_stats().shed_count.load(), 0);
+
+#ifdef __linux__
+    // Run out of fds : the lowest free fd is not less than the limit
+    evpp_socket_t shed = ::socket(AF_INET, SOCK_STREAM, 0);
+    int lowest = ::dup(0);
+    ::close(lowest);
+    struct rlimit old_limit;
+    getrlimit(RLIMIT_NOFILE, &old_limit);
+    struct rlimit limit = old_limit;
+    limit.rlim_cur = lowest;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    H_TEST_EQUAL(::connect(shed, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+
+    // The connection is closed at once instead of staying in the backlog
+    char c = 0;
+    ssize_t n = ::recv(shed, &c, 1, 0);
+    setrlimit(RLIMIT_NOFILE, &old_limit);
+    H_TEST_ASSERT(n <= 0);
+    H_TEST_EQUAL(tsrv->accept_stats().shed_count.load(), 1);
+    H_TEST_EQUAL(connected_count.load(), kClientCount);
+    EVUTIL_CLOSESOCKET(shed);
+#endif
+
+    for (auto fd : clients) {
+        EVUTIL_CLOSESOCKET(fd);
+    }
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPServerIdleTimeout) {
+    evpp::Duration idle_timeout(0.2);
+    std::atomic<int> connected_count(0);
+    std::atomic<int> closed_count(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 2));
+    tsrv->SetIdleTimeout(idle_timeout);
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            connected_count++;
+        } else {
+            closed_count++;
+        }
+    });
+    tsrv->SetMessageCallback([](const evpp::TCPConnPtr& conn, evpp::Buffer* msg) {
+        conn->Send(msg);
+    });
+    H_TEST_ASSERT(tsrv->Init());
+    H_TEST_ASSERT(tsrv->Start());
+
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(addr.data());
+    evpp_socket_t idle = ::socket(AF_INET, SOCK_STREAM, 0);
+    evpp_socket_t active = ::socket(AF_INET, SOCK_STREAM, 0);
+    H_TEST_EQUAL(::connect(idle, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+    H_TEST_EQUAL(::connect(active, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+    for (int i = 0; i < 5000 && connected_count.load() < 2; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(connected_count.load(), 2);
+
+    // The active connection talks every 50ms for 3 timeouts
+    evpp::Timestamp start = evpp::Timestamp::Now();
+    for (int i = 0; i < 12; i++) {
+        char c = 'x';
+        H_TEST_EQUAL(::send(active, &c, 1, 0), 1);
+        H_TEST_EQUAL(::recv(active, &c, 1, 0), 1);
+        usleep(50 * 1000);
+    }
+
+    // The idle connection has been closed by the server
+    char c = 0;
+    H_TEST_EQUAL(::recv(idle, &c, 1, 0), 0);
+    H_TEST_EQUAL(closed_count.load(), 1);
+    H_TEST_ASSERT(idle_timeout <= evpp::Timestamp::Now() - start);
+
+    EVUTIL_CLOSESOCKET(idle);
+    EVUTIL_CLOSESOCKET(active);
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+// A connection which only sends is not idle
+TEST_UNIT(testTCPServerIdleTimeoutPushOnly) {
+    evpp::Duration idle_timeout(0.2);
+    std::atomic<int> closed_count(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 1));
+    tsrv->SetIdleTimeout(idle_timeout);
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            // The bytes go to the socket directly since the client reads them all
+            std::weak_ptr<evpp::TCPConn> wc = conn;
+            evpp::InvokeTimerPtr t = conn->loop()->RunEvery(evpp::Duration(0.05), [wc]() {
+                evpp::TCPConnPtr c = wc.lock();
+                if (c) {
+                    c->Send("x");
+                }
+            });
+            conn->set_context(evpp::Any(t));
+        } else {
+            evpp::any_cast<evpp::InvokeTimerPtr>(conn->context())->Cancel();
+            closed_count++;
+        }
+    });
+    H_TEST_ASSERT(tsrv->Init());
+    H_TEST_ASSERT(tsrv->Start());
+
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(addr.data());
+    evpp_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    H_TEST_EQUAL(::connect(fd, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+
+    // Read for 3 timeouts
+    int n = 0;
+    for (int i = 0; i < 12; i++) {
+        char c = 0;
+        H_TEST_EQUAL(::recv(fd, &c, 1, 0), 1);
+        n++;
+    }
+    H_TEST_EQUAL(n, 12);
+    H_TEST_EQUAL(closed_count.load(), 0);
+
+    EVUTIL_CLOSESOCKET(fd);
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+TEST_UNIT(testTCPServerLeastConnections) {
+    std::mutex mutex;
+    std::map<uint16_t, evpp::EventLoop*> loops; // remote port -> loop
+    std::atomic<int> closed_count(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 2));
+    tsrv->SetThreadDispatchPolicy(evpp::ThreadDispatchPolicy::kLeastConnections);
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            std::string port = conn->remote_addr().substr(conn->remote_addr().rfind(':') + 1);
+            std::lock_guard<std::mutex> guard(mutex);
+            loops[static_cast<uint16_t>(std::stoi(port))] = conn->loop();
+        } else {
+            closed_count++;
+        }
+    });
+    H_TEST_ASSERT(tsrv->Init());
+    H_TEST_ASSERT(tsrv->Start());
+
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(addr.data());
+    // Return the socket and the loop of its TCPConn
+    typedef std::pair<evpp_socket_t, evpp::EventLoop*> Client;
+    auto connect = [&]() -> Client {
+        evpp_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)) != 0) {
+            return Client(fd, nullptr);
+        }
+        struct sockaddr_in local;
+        socklen_t len = sizeof(local);
+        ::getsockname(fd, evpp::sock::sockaddr_cast(&local), &len);
+        uint16_t port = ntohs(local.sin_port);
+        for (int i = 0; i < 5000; i++) {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (loops.count(port)) {
+                    return Client(fd, loops[port]);
+                }
+            }
+            usleep(1000);
+        }
+        return Client(fd, nullptr);
+    };
+
+    auto c1 = connect();
+    auto c2 = connect();
+    H_TEST_ASSERT(c1.second && c2.second && c1.second != c2.second);
+    H_TEST_EQUAL(c1.second->connection_count(), 1);
+
+    // The loop of the closed one serves the least connections
+    EVUTIL_CLOSESOCKET(c2.first);
+    for (int i = 0; i < 5000 && closed_count.load() < 1; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(c2.second->connection_count(), 0);
+    auto c3 = connect();
+    H_TEST_ASSERT(c3.second == c2.second);
+
+    // A custom dispatcher takes over
+    evpp::EventLoop* chosen = c1.second;
+    tsrv->SetDispatcher([chosen](evpp::EventLoopThreadPool*, const struct sockaddr_in* raddr) {
+        return raddr ? chosen : nullptr;
+    });
+    auto c4 = connect();
+    H_TEST_ASSERT(c4.second == chosen);
+    H_TEST_EQUAL(chosen->connection_count(), 2);
+
+    EVUTIL_CLOSESOCKET(c1.first);
+    EVUTIL_CLOSESOCKET(c3.first);
+    EVUTIL_CLOSESOCKET(c4.first);
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+// The connections dispatched before they are attached to their loops are
+// spread by kLeastConnections too
+TEST_UNIT(testTCPServerLeastConnectionsBurst) {
+    const int kClientCount = 8;
+    std::mutex mutex;
+    std::map<evpp::EventLoop*, int> loops;
+    std::atomic<int> connected_count(0);
+    std::unique_ptr<evpp::EventLoopThread> tcp_server_thread(new evpp::EventLoopThread);
+    tcp_server_thread->Start(true);
+    std::unique_ptr<evpp::TCPServer> tsrv(new evpp::TCPServer(tcp_server_thread->loop(), addr, "tcp_server", 2));
+    tsrv->SetThreadDispatchPolicy(evpp::ThreadDispatchPolicy::kLeastConnections);
+    tsrv->SetMaxAcceptsPerWakeup(kClientCount);
+    tsrv->SetConnectionCallback([&](const evpp::TCPConnPtr& conn) {
+        if (conn->IsConnected()) {
+            std::lock_guard<std::mutex> guard(mutex);
+            loops[conn->loop()]++;
+            connected_count++;
+        }
+    });
+    H_TEST_ASSERT(tsrv->Init());
+    H_TEST_ASSERT(tsrv->Start());
+
+    struct sockaddr_storage ss = evpp::sock::ParseFromIPPort(addr.data());
+    std::vector<evpp_socket_t> fds;
+    auto connect = [&](int n) {
+        for (int i = 0; i < n; i++) {
+            evpp_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            H_TEST_EQUAL(::connect(fd, evpp::sock::sockaddr_cast(&ss), sizeof(struct sockaddr_in)), 0);
+            fds.push_back(fd);
+        }
+    };
+
+    // 2 connections in one loop and 1 in the other
+    for (int i = 0; i < 3; i++) {
+        connect(1);
+        for (int j = 0; j < 5000 && connected_count.load() < i + 1; j++) {
+            usleep(1000);
+        }
+    }
+    H_TEST_EQUAL(connected_count.load(), 3);
+    H_TEST_EQUAL(loops.size(), 2U);
+
+    // Hold the working loops, so the new connections are not attached yet
+    // when the next ones are dispatched
+    std::atomic<bool> release(false);
+    for (auto& l : loops) {
+        l.first->RunInLoop([&release]() {
+            while (!release.load()) {
+                usleep(1000);
+            }
+        });
+    }
+    connect(kClientCount);
+    usleep(100 * 1000);
+    release.store(true);
+    for (int i = 0; i < 5000 && connected_count.load() < kClientCount + 3; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(connected_count.load(), kClientCount + 3);
+    H_TEST_EQUAL(loops.size(), 2U);
+    int a = loops.begin()->second;
+    int b = loops.rbegin()->second;
+    H_TEST_ASSERT(std::abs(a - b) <= 1);
+    H_TEST_EQUAL(loops.begin()->first->connection_count(), a);
+    H_TEST_EQUAL(loops.rbegin()->first->connection_count(), b);
+
+    for (auto fd : fds) {
+        EVUTIL_CLOSESOCKET(fd);
+    }
+    tsrv->Stop();
+    while (!tsrv->IsStopped()) {
+        usleep(1);
+    }
+    tcp_server_thread->Stop(true);
+    tcp_server_thread.reset();
+    tsrv.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
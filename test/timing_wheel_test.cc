@@ -0,0 +1,151 @@
+#include "test_common.h"
+
+#include <evpp/libevent.h>
+#include <evpp/event_loop.h>
+#include <evpp/timing_wheel.h>
+#include <evpp/timestamp.h>
+
+namespace {
+class TestTimer : public evpp::TimingWheel::Timer {
+public:
+    typedef std::function<void(TestTimer*)> Callback;
+    TestTimer(int id, evpp::Duration timeout, const Callback& cb)
+        : id_(id), timeout_(timeout), cb_(cb) {}
+
+    int id() const {
+        return id_;
+    }
+    evpp::Duration timeout() const {
+        return timeout_;
+    }
+    evpp::Duration cost() const {
+        return cost_;
+    }
+    void Start(evpp::TimingWheel* wheel) {
+        start_ = evpp::Timestamp::Now();
+        wheel->Add(this, timeout_);
+    }
+private:
+    virtual void OnTimeout() {
+        cost_ = evpp::Timestamp::Now() - start_;
+        cb_(this);
+    }
+private:
+    int id_;
+    evpp::Duration timeout_;
+    Callback cb_;
+    evpp::Timestamp start_;
+    evpp::Duration cost_;
+};
+}
+
+TEST_UNIT(testTimingWheelOrder) {
+    std::vector<int> fired;
+    {
+        evpp::EventLoop loop;
+        // A tick of 1us puts the timers into all the levels of the wheel
+        evpp::TimingWheel wheel(&loop, evpp::Duration(int64_t(1000)));
+        auto cb = [&fired, &loop, &wheel](TestTimer* t) {
+            fired.push_back(t->id());
+            H_TEST_ASSERT(t->timeout() <= t->cost());
+            if (wheel.size() == 0) {
+                loop.Stop();
+            }
+        };
+
+        TestTimer t1(1, evpp::Duration(0.0003), cb); // The root level
+        TestTimer t2(2, evpp::Duration(0.03), cb); // The 2nd level
+        TestTimer t3(3, evpp::Duration(0.3), cb); // The 3rd level
+        TestTimer t4(4, evpp::Duration(1.1), cb); // The 4th level
+        TestTimer t5(5, evpp::Duration(0.2), cb); // Removed
+        TestTimer t6(6, evpp::Duration(0.01), cb); // Rescheduled
+        t4.Start(&wheel);
+        t3.Start(&wheel);
+        t5.Start(&wheel);
+        t2.Start(&wheel);
+        t1.Start(&wheel);
+        t6.Start(&wheel);
+        H_TEST_EQUAL(wheel.size(), 6U);
+
+        wheel.Remove(&t5);
+        H_TEST_ASSERT(!t5.IsScheduled());
+        wheel.Remove(&t5);
+        t6.Start(&wheel);
+        H_TEST_EQUAL(wheel.size(), 5U);
+
+        loop.Run();
+        H_TEST_EQUAL(wheel.size(), 0U);
+    }
+    H_TEST_EQUAL(fired.size(), 5U);
+    H_TEST_EQUAL(fired[0], 1);
+    H_TEST_EQUAL(fired[1], 6);
+    H_TEST_EQUAL(fired[2], 2);
+    H_TEST_EQUAL(fired[3], 3);
+    H_TEST_EQUAL(fired[4], 4);
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
+
+// A timer added late in a long iteration of the loop does not expire early
+TEST_UNIT(testTimingWheelLongIteration) {
+    evpp::EventLoop loop;
+    evpp::TimingWheel wheel(&loop);
+    std::vector<int> fired;
+    auto cb = [&fired, &loop, &wheel](TestTimer* t) {
+        fired.push_back(t->id());
+        H_TEST_ASSERT(t->timeout() <= t->cost());
+        if (wheel.size() == 0) {
+            loop.Stop();
+        }
+    };
+    TestTimer t1(1, evpp::Duration(0.005), cb);
+    TestTimer t2(2, evpp::Duration(0.01), cb);
+    loop.QueueInLoop([&]() {
+        // Cache the time of this iteration, and arm the wheel early
+        loop.Now();
+        t1.Start(&wheel);
+        usleep(20 * 1000);
+        t2.Start(&wheel);
+    });
+    loop.Run();
+    H_TEST_EQUAL(fired.size(), 2U);
+}
+
+TEST_UNIT(testTimingWheelInvokeTimer) {
+    int periodic_count = 0;
+    int canceled_count = 0;
+    bool canceled_called = false;
+    {
+        evpp::EventLoop loop;
+        loop.SetTimerBackend(evpp::InvokeTimer::kTimingWheel);
+
+        evpp::InvokeTimerPtr periodic = loop.RunEvery(evpp::Duration(0.1), [&periodic_count]() {
+            periodic_count++;
+        });
+        H_TEST_EQUAL(periodic->backend(), evpp::InvokeTimer::kTimingWheel);
+
+        evpp::InvokeTimerPtr canceled = loop.RunAfter(evpp::Duration(0.05), [&canceled_count]() {
+            canceled_count++;
+        });
+        canceled->set_cancel_callback([&canceled_called]() {
+            canceled_called = true;
+        });
+        canceled->Cancel();
+
+        // Cancel itself in the callback
+        evpp::InvokeTimerPtr self_canceled;
+        self_canceled = loop.RunEvery(evpp::Duration(0.02), [&self_canceled, &canceled_count]() {
+            canceled_count++;
+            self_canceled->Cancel();
+        });
+
+        loop.RunAfter(evpp::Duration(0.35), [&loop, periodic]() {
+            periodic->Cancel();
+            loop.Stop();
+        });
+        loop.Run();
+    }
+    H_TEST_EQUAL(periodic_count, 3);
+    H_TEST_EQUAL(canceled_count, 1);
+    H_TEST_ASSERT(canceled_called);
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}
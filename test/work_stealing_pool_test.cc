@@ -0,0 +1,72 @@
+#include "test_common.h"
+
+#include <evpp/libevent.h>
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/work_stealing_pool.h>
+
+#include <atomic>
+
+TEST_UNIT(testWorkStealingPool) {
+    std::unique_ptr<evpp::EventLoopThread> loop(new evpp::EventLoopThread);
+    loop->Start(true);
+    std::unique_ptr<evpp::WorkStealingPool> pool(new evpp::WorkStealingPool(2));
+    H_TEST_ASSERT(pool->Start());
+
+    // The work runs in the pool and the completion runs in the loop
+    std::atomic<int> worked(0);
+    std::atomic<int> completed(0);
+    std::atomic<int> wrong_thread(0);
+    evpp::EventLoop* l = loop->loop();
+    for (int i = 0; i < 100; i++) {
+        pool->Submit(l, [&worked, &wrong_thread, l]() {
+            if (l->IsInLoopThread()) {
+                wrong_thread++;
+            }
+            worked++;
+        }, [&completed, &wrong_thread, l]() {
+            if (!l->IsInLoopThread()) {
+                wrong_thread++;
+            }
+            completed++;
+        });
+    }
+    for (int i = 0; i < 5000 && completed.load() < 100; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(worked.load(), 100);
+    H_TEST_EQUAL(completed.load(), 100);
+    H_TEST_EQUAL(wrong_thread.load(), 0);
+
+    // The subtasks are pushed to the deque of the busy thread, so the idle one steals them
+    std::atomic<int> subtasks(0);
+    evpp::WorkStealingPool* p = pool.get();
+    pool->Submit([p, &subtasks]() {
+        for (int i = 0; i < 100; i++) {
+            p->Submit([&subtasks]() {
+                subtasks++;
+            });
+        }
+        usleep(100 * 1000);
+    });
+    for (int i = 0; i < 5000 && subtasks.load() < 100; i++) {
+        usleep(1000);
+    }
+    H_TEST_EQUAL(subtasks.load(), 100);
+    H_TEST_ASSERT(pool->steal_count() > 0);
+
+    // Stop runs the tasks left
+    for (int i = 0; i < 100; i++) {
+        pool->Submit([&subtasks]() {
+            subtasks++;
+        });
+    }
+    pool->Stop();
+    H_TEST_ASSERT(pool->IsStopped());
+    H_TEST_EQUAL(subtasks.load(), 200);
+    H_TEST_EQUAL(pool->pending_count(), 0);
+
+    loop->Stop(true);
+    loop.reset();
+    H_TEST_ASSERT(evpp::GetActiveEventCount() == 0);
+}